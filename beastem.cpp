@@ -1,17 +1,17 @@
+#include <chrono>
 #include <iostream>
 #include <sstream>
 #include <fstream>
 #include <SDL.h>
 #include <SDL_net.h>
 #include <regex>
-#define CHIPS_IMPL
-#include "src/z80.h"
-#include "src/z80pio.h"
-#include "src/uart16c550.h"
 #include "src/assets.hpp"
 #include "src/beast.hpp"
+#include "src/fanout.hpp"
+#include "src/testrunner.hpp"
 #include "src/binaryFile.hpp"
 #include "src/videobeast.hpp"
+#include "src/videoWindow.hpp"
 #include "src/i2c.hpp"
 #include "src/display.hpp"
 #include "src/rtc.hpp"
@@ -55,13 +55,29 @@ void printHelp() {
     std::cout << "   -a <audio-device-num>            : Override the default audio device selection" << std::endl;
     std::cout << "   -s <audio-sample-rate>           : Override the default audio sample rate (22050)" << std::endl;
     std::cout << "   -v <Audio volume>                : Value 0 to 10 (default 4)" << std::endl;
-    std::cout << "   -k <CPU speed>                   : Integer KHz (default 8000)" << std::endl;
+    std::cout << "   -k <CPU speed> | -k max          : Integer KHz (default 8000), or max to run unthrottled" << std::endl;
     std::cout << "   -b <breakpoint>                  : Stop at address (hex)" << std::endl;
     std::cout << "   -z <zoom-level>                  : Zoom the user interface by the given value" << std::endl;
     std::cout << "   -d <filename> | -d2 <filename>   : Start VideoBeast with the given file in video ram" << std::endl;
     std::cout << "   -A <asset-path>                  : Path to asset files (default: BEASTEM_ASSETS env or cwd)" << std::endl;
     std::cout << "   -r                               : Run MicroBeast on launch" << std::endl;
     std::cout << "   -g                               : Open Debug page on launch" << std::endl;
+    std::cout << "   --headless                       : Run without window or audio until breakpoint or interrupt" << std::endl;
+    std::cout << "   --stats <filename>               : Write performance statistics as JSON lines, once a second" << std::endl;
+    std::cout << "   --fast                           : Run whole instructions at a time instead of every clock cycle" << std::endl;
+    std::cout << "   --load-state <filename>          : Start from a machine state saved earlier" << std::endl;
+    std::cout << "   --save-state <filename>          : Save the machine state on exit" << std::endl;
+    std::cout << "   --record <filename>              : Record every key, UART byte and other input to a journal" << std::endl;
+    std::cout << "   --replay <filename>              : Run again with the inputs from a journal, from the same start" << std::endl;
+    std::cout << "   --flash-image <filename>         : Keep the flash ROM in this file, so programming it persists" << std::endl;
+    std::cout << "   --rewind <MB>                    : Memory kept for stepping backwards in the debugger (default 64, 0 for none)" << std::endl;
+    std::cout << "   --boot-cache <directory>         : Start from a cached boot of the same images, or boot and cache it" << std::endl;
+    std::cout << "   --ready <address>                : Where a boot is ready to cache, in hex (default 0343, waiting for a key)" << std::endl;
+    std::cout << "   --fan-out <filename>             : Run each scenario in the file from the starting state, in parallel, and report" << std::endl;
+    std::cout << "   --pass <condition>               : Headless test, passes when break=<address>, uart=<regex> or mem=<address>:<value>" << std::endl;
+    std::cout << "   --fail <condition>               : Headless test, fails when the condition is met, as for --pass" << std::endl;
+    std::cout << "   --cycles <n>                     : Headless test, fails after this many CPU cycles unless only --fail was given" << std::endl;
+    std::cout << "   --report <filename>              : Write the test result as JUnit XML (.xml) or else JSON" << std::endl;
 }
 
 int main( int argc, char *argv[] ) {
@@ -71,6 +87,24 @@ int main( int argc, char *argv[] ) {
     int sampleRate = Beast::AUDIO_FREQ;
     int volume = 4;
     float zoom = 1.0;
+    float videoZoom = 0;
+    bool headless = false;
+    bool maxSpeed = false;
+    bool fastEngine = false;
+    std::string statsFile;
+    std::string loadStateFile;
+    std::string saveStateFile;
+    std::string recordFile;
+    std::string replayFile;
+    std::string flashImageFile;
+    std::string fanOutFile;
+    std::string bootCacheDir;
+    uint16_t    readyPc = Beast::DEFAULT_READY_PC;
+    int         rewindMegabytes = 64;
+    std::vector<std::pair<std::string, bool>> testConditions;
+    uint64_t    testCycles = 0;
+    std::string reportFile;
+    bool        testing = false;
     std::string assetPathArg;
 
     GUI::Mode startMode = GUI::HELP;
@@ -140,9 +174,7 @@ int main( int argc, char *argv[] ) {
                 printHelp();
                 exit(1);
             }
-            float zoom = strcmp(argv[index], "-d") == 0 ? 1.0 : 2.0;
-
-            videoBeast = new VideoBeast(zoom);
+            videoZoom = strcmp(argv[index], "-d") == 0 ? 1.0 : 2.0;
             binaries.push_back(BinaryFile(argv[++index], 0, false, BinaryFile::VIDEO_RAM));
         }
         else if( strcmp(argv[index], "-v") == 0 ) {
@@ -153,6 +185,10 @@ int main( int argc, char *argv[] ) {
             }
             volume = std::stoi(argv[index], nullptr, 10);
         }
+        else if( strcmp(argv[index], "-k") == 0 && index+1 < argc && strcmp(argv[index+1], "max") == 0 ) {
+            index++;
+            maxSpeed = true;
+        }
         else if( strcmp(argv[index], "-k") == 0 ) {
             if( index+1 >= argc || !isNum(argv[++index]) ) {
                 std::cout << "CPU Speed: missing argument. Expected kilohertz speed, eg. 8000" << std::endl;
@@ -211,6 +247,115 @@ int main( int argc, char *argv[] ) {
         else if( strcmp(argv[index], "-g") == 0 ) {
             startMode = GUI::DEBUG;
         }
+        else if( strcmp(argv[index], "--headless") == 0 ) {
+            headless = true;
+        }
+        else if( strcmp(argv[index], "--fast") == 0 ) {
+            fastEngine = true;
+        }
+        else if( strcmp(argv[index], "--stats") == 0 ) {
+            if( index+1 >= argc ) {
+                std::cout << "Stats: missing argument. Expected filename" << std::endl;
+                printHelp();
+                exit(1);
+            }
+            statsFile = argv[++index];
+        }
+        else if( strcmp(argv[index], "--load-state") == 0 || strcmp(argv[index], "--save-state") == 0 ) {
+            if( index+1 >= argc ) {
+                std::cout << "State: missing argument. Expected filename" << std::endl;
+                printHelp();
+                exit(1);
+            }
+            if( strcmp(argv[index], "--load-state") == 0 ) {
+                loadStateFile = argv[++index];
+            }
+            else {
+                saveStateFile = argv[++index];
+            }
+        }
+        else if( strcmp(argv[index], "--record") == 0 || strcmp(argv[index], "--replay") == 0 ) {
+            if( index+1 >= argc ) {
+                std::cout << "Journal: missing argument. Expected filename" << std::endl;
+                printHelp();
+                exit(1);
+            }
+            if( strcmp(argv[index], "--record") == 0 ) {
+                recordFile = argv[++index];
+            }
+            else {
+                replayFile = argv[++index];
+            }
+        }
+        else if( strcmp(argv[index], "--flash-image") == 0 ) {
+            if( index+1 >= argc ) {
+                std::cout << "Flash image: missing argument. Expected filename" << std::endl;
+                printHelp();
+                exit(1);
+            }
+            flashImageFile = argv[++index];
+        }
+        else if( strcmp(argv[index], "--boot-cache") == 0 ) {
+            if( index+1 >= argc ) {
+                std::cout << "Boot cache: missing argument. Expected directory" << std::endl;
+                printHelp();
+                exit(1);
+            }
+            bootCacheDir = argv[++index];
+        }
+        else if( strcmp(argv[index], "--ready") == 0 ) {
+            if( index+1 >= argc || !isHexNum(argv[++index]) ) {
+                std::cout << "Ready: missing argument. Expected address in hex." << std::endl;
+                printHelp();
+                exit(1);
+            }
+            readyPc = std::stoi(argv[index], nullptr, 16);
+        }
+        else if( strcmp(argv[index], "--fan-out") == 0 ) {
+            if( index+1 >= argc ) {
+                std::cout << "Fan out: missing argument. Expected scenario filename" << std::endl;
+                printHelp();
+                exit(1);
+            }
+            fanOutFile = argv[++index];
+            headless = true;
+        }
+        else if( strcmp(argv[index], "--pass") == 0 || strcmp(argv[index], "--fail") == 0 ) {
+            bool pass = strcmp(argv[index], "--pass") == 0;
+            if( index+1 >= argc ) {
+                std::cout << "Test condition: missing argument. Expected break=, uart= or mem=" << std::endl;
+                printHelp();
+                exit(TestRunner::ERROR);
+            }
+            testConditions.push_back({argv[++index], pass});
+            testing = headless = true;
+        }
+        else if( strcmp(argv[index], "--cycles") == 0 ) {
+            if( index+1 >= argc || !isNum(argv[++index]) ) {
+                std::cout << "Cycles: missing argument. Expected number of CPU cycles to test for" << std::endl;
+                printHelp();
+                exit(TestRunner::ERROR);
+            }
+            testCycles = std::stoull(argv[index], nullptr, 10);
+            testing = headless = true;
+        }
+        else if( strcmp(argv[index], "--report") == 0 ) {
+            if( index+1 >= argc ) {
+                std::cout << "Report: missing argument. Expected filename" << std::endl;
+                printHelp();
+                exit(TestRunner::ERROR);
+            }
+            reportFile = argv[++index];
+            testing = headless = true;
+        }
+        else if( strcmp(argv[index], "--rewind") == 0 ) {
+            if( index+1 >= argc || !isNum(argv[++index]) ) {
+                std::cout << "Rewind: missing argument. Expected megabytes of history to keep" << std::endl;
+                printHelp();
+                exit(1);
+            }
+            rewindMegabytes = std::stoi(argv[index], nullptr, 10);
+        }
         else {
             std::cout << "** Unknown option: " << argv[index] << std::endl;
             printHelp();
@@ -221,14 +366,26 @@ int main( int argc, char *argv[] ) {
 
     initAssetPath(assetPathArg);
 
-    NFD_Init();
-    SDL_Init( SDL_INIT_EVERYTHING );
+    if( videoZoom > 0 ) {
+        // Headless it still runs, but has nothing to show
+        videoBeast = headless ? new VideoBeast() : new VideoWindow(videoZoom);
+    }
 
-    SDL_Window *window = SDL_CreateWindow("Feersum MicroBeast Emulator v1.3rc2", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, WIDTH*zoom, HEIGHT*zoom, SDL_WINDOW_ALLOW_HIGHDPI);
+    SDL_Window *window = nullptr;
 
-    if( NULL == window ) {
-        std::cout << "Could not create window: " << SDL_GetError() << std::endl;
-        return 1;
+    if( headless ) {
+        SDL_Init( SDL_INIT_TIMER );
+    }
+    else {
+        NFD_Init();
+        SDL_Init( SDL_INIT_EVERYTHING );
+
+        window = SDL_CreateWindow("Feersum MicroBeast Emulator v" BEASTEM_VERSION, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, WIDTH*zoom, HEIGHT*zoom, SDL_WINDOW_ALLOW_HIGHDPI);
+
+        if( NULL == window ) {
+            std::cout << "Could not create window: " << SDL_GetError() << std::endl;
+            return 1;
+        }
     }
 
     if (SDLNet_Init() == -1) {
@@ -239,17 +396,91 @@ int main( int argc, char *argv[] ) {
         std::cout << "No file or listing arguments, loading firmware" << std::endl;
         listing.addFile(assetPath("firmware.lst"), 0, false);
         listing.addFile(assetPath("monitor.lst"), 35, false);
-        binaries.push_back(BinaryFile(assetPath("flash_v1.7.bin"), 0, false));
+        // A flash image already holds whatever was last programmed into it
+        if( flashImageFile.empty() || !std::ifstream(flashImageFile).good() ) {
+            binaries.push_back(BinaryFile(assetPath("flash_v1.7.bin"), 0, false));
+        }
     }
 
     Beast beast = Beast(window, WIDTH, HEIGHT, zoom, listing, binaries, startMode);
+    if( !flashImageFile.empty() && !beast.openFlashImage(flashImageFile.c_str()) ) {
+        exit(1);
+    }
  
     beast.init(targetSpeed*ONE_KILOHERTZ, breakpoint, audioDevice, volume, sampleRate, videoBeast);
 
-    beast.mainLoop();
+    // Labels are looked up once init() has loaded every listing
+    TestRunner testRunner;
+    for( auto &condition : testConditions ) {
+        if( !testRunner.addCondition(condition.first, condition.second, listing) ) {
+            exit(TestRunner::ERROR);
+        }
+    }
+    testRunner.setCycleBudget(testCycles);
+    if( testing && !testRunner.hasConditions() ) {
+        std::cout << "Test: nothing to stop it. Expected --pass, --fail or --cycles" << std::endl;
+        exit(TestRunner::ERROR);
+    }
+    if( testing && binaries.size() > 0 ) {
+        testRunner.setName(binaries.back().getShortname());
+    }
+
+    if( maxSpeed ) {
+        beast.setSpeedMultiplier(Beast::SPEED_MAX);
+    }
+    if( fastEngine ) {
+        beast.setEngine(Beast::ENGINE_FAST);
+    }
+    if( !statsFile.empty() ) {
+        beast.openStatsFile(statsFile.c_str());
+    }
+    beast.setRewindBudget(rewindMegabytes);
+    if( !loadStateFile.empty() && !beast.loadState(loadStateFile.c_str()) ) {
+        exit(1);
+    }
+    // A saved state is already past booting
+    if( !bootCacheDir.empty() && loadStateFile.empty() ) {
+        beast.bootFromCache(bootCacheDir.c_str(), readyPc);
+    }
+    // Replay first, so a new recording starts with the inputs being replayed
+    if( !replayFile.empty() && !beast.replayJournal(replayFile.c_str()) ) {
+        exit(1);
+    }
+    if( !recordFile.empty() && !beast.recordJournal(recordFile.c_str()) ) {
+        exit(1);
+    }
 
-    SDL_DestroyWindow( window );
+    int exitCode = EXIT_SUCCESS;
+    if( !fanOutFile.empty() ) {
+        FanOut fanOut;
+        if( !fanOut.load(fanOutFile.c_str()) ) {
+            exit(1);
+        }
+        auto start = std::chrono::steady_clock::now();
+        fanOut.run(beast, 0);
+        fanOut.report(std::cout);
+        std::cout << "Ran " << fanOut.size() << " scenarios in "
+                  << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << "s" << std::endl;
+    }
+    else if( testing ) {
+        exitCode = testRunner.run(beast);
+        testRunner.report(std::cout);
+        if( !reportFile.empty() && !testRunner.writeReport(reportFile.c_str()) ) {
+            exitCode = TestRunner::ERROR;
+        }
+    }
+    else {
+        beast.mainLoop();
+    }
+
+    if( !saveStateFile.empty() ) {
+        beast.saveState(saveStateFile.c_str());
+    }
+
+    if( window ) {
+        SDL_DestroyWindow( window );
+    }
     SDL_Quit();
 
-    return EXIT_SUCCESS;
+    return exitCode;
 }
\ No newline at end of file
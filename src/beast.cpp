@@ -3,45 +3,45 @@
 #include "assets.hpp"
 #include "listing.hpp"
 #include "nfd.h"
+#include "uartNet.hpp"
 #include "z80.h"
 #include "z80pio.h"
 #include <algorithm>
 #include <cstdarg>
 #include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <stdio.h>
+#include <thread>
 
 Beast::Beast(SDL_Window *window, int screenWidth, int screenHeight, float zoom,
              Listing &listing, std::vector<BinaryFile> files, GUI::Mode startMode)
-    : rom{}, ram{}, memoryPage{0}, listing(listing), binaryFiles(files),
+    : Machine(listing, files),
       gui(&listing, createRenderer(window), screenWidth, screenHeight) {
 
-  windowId = SDL_GetWindowID(window);
+  // No window means headless: the machine runs, but nothing is drawn
+  headless = (window == nullptr);
 
   this->window = window;
   this->screenWidth = screenWidth;
   this->screenHeight = screenHeight;
-  this->zoom = checkZoomFactor(screenWidth, screenHeight, zoom);
+  this->zoom = headless ? zoom : checkZoomFactor(screenWidth, screenHeight, zoom);
 
   this->mode = startMode;
-  
-  TTF_Init();
-  gui.init(this->zoom);
 
-  instr = new Instructions();
-  debugManager = new DebugManager();
+  setUartNetwork(&UART_SDLNET);
   breakpointGui = new BreakpointGui(sdlRenderer, screenWidth, screenHeight, this->zoom, &gui, debugManager);
 
-  i2c = new I2c(Z80PIO_PB6, Z80PIO_PB7);
-  display1 = new I2cDisplay(0x50);
-  display2 = new I2cDisplay(0x53);
-  rtc = new I2cRTC(0x6f, Z80PIO_PB5);
+  if (headless) {
+    return;
+  }
+
+  windowId = SDL_GetWindowID(window);
 
-  i2c->addDevice(display1);
-  i2c->addDevice(display2);
-  i2c->addDevice(rtc);
+  TTF_Init();
+  gui.init(this->zoom);
 
   std::string fontPath = assetPath(BEAST_FONT);
   font = TTF_OpenFont(fontPath.c_str(), FONT_SIZE * zoom);
@@ -77,7 +77,7 @@ Beast::Beast(SDL_Window *window, int screenWidth, int screenHeight, float zoom,
 
   drawKeys();
   for (int i = 0; i < DISPLAY_CHARS; i++) {
-    display.push_back(Digit(sdlRenderer, zoom));
+    shownDisplay.push_back(DigitView(sdlRenderer, zoom));
   }
 }
 
@@ -95,6 +95,10 @@ SDL_Texture *Beast::loadTexture(SDL_Renderer *sdlRenderer,
 }
 
 SDL_Renderer *Beast::createRenderer(SDL_Window *window) {
+  if (!window) {
+    sdlRenderer = nullptr;
+    return sdlRenderer;
+  }
   sdlRenderer = SDL_CreateRenderer(
       window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
 
@@ -130,78 +134,27 @@ float Beast::checkZoomFactor(int screenWidth, int screenHeight, float zoom) {
 
 void Beast::init(uint64_t targetSpeedHz, uint64_t breakpoint, int audioDevice,
                  int volume, int sampleRate, VideoBeast *videoBeast) {
-  this->videoBeast = videoBeast;
-
-  pins = z80_init(&cpu);
-
-  z80pio_init(&pio);
-
-  this->targetSpeedHz = targetSpeedHz;
-  clock_cycle_ps = ONE_SECOND_PS / targetSpeedHz;
-
-  float speed = targetSpeedHz / 1000000.0f;
-
-  std::cout << "Clock cycle time ps = " << clock_cycle_ps
-            << ", speed = " << std::setprecision(2) << std::fixed << speed
-            << "MHz" << std::endl;
-  clock_time_ps = 0;
-
-  // Set command-line breakpoint as system breakpoint 0
-  if (breakpoint != NOT_SET) {
-    debugManager->setSystemBreakpoint(0, (uint32_t)breakpoint, false);
-  }
-
-  portB = 0xFF;
-
-  for (int i = 0; i < 12; i++) {
-    display1->addDigit(getDigit(i));
-    display2->addDigit(getDigit(i + 12));
-  }
+  videoWindow = dynamic_cast<VideoWindow *>(videoBeast);
 
-  uart_init(&uart, UART_CLOCK_HZ, clock_time_ps);
+  Machine::init(targetSpeedHz, breakpoint, videoBeast);
+  placeVideoWindow();
 
-  if (videoBeast) {
-    initVideoBeast();
-  }
-
-  for (auto &bf : binaryFiles) {
-    bf.load(rom, ram, pagingEnabled, memoryPage, videoRam);
-  }
-
-  for (auto &source : listing.getFiles()) {
-    listing.loadFile(source);
-  }
-
-  setupAudio(audioDevice, sampleRate, volume);
+  setupAudio(audioDevice, headless ? 0 : sampleRate, volume);
 }
 
-void Beast::initVideoBeast() {
-  videoRam = videoBeast->memoryPtr();
-  int leftBorder = videoBeast->init(clock_time_ps, screenWidth * zoom);
-  nextVideoBeastTickPs = 0;
+// Side by side with the VideoBeast window, if the desktop has room
+void Beast::placeVideoWindow() {
+  if (!videoWindow)
+    return;
 
+  int leftBorder = videoWindow->place(screenWidth * zoom);
   if (leftBorder > 0)
     SDL_SetWindowPosition(window, leftBorder, SDL_WINDOWPOS_CENTERED);
   SDL_RaiseWindow(window);
 }
 
-void Beast::reset() {
-  z80_reset(&cpu);
-  uart_reset(&uart, UART_CLOCK_HZ);
-  keySet.clear();
-  pagingEnabled = false;
-  for (int i = 0; i < 4; i++) {
-    memoryPage[i] = 0;
-  }
-  historyCount = 0;
-  listMode = LM_CPU;
-
-  debugManager->clearAllLogs();
-  tickCount = 0;
-}
-
 void audio_callback(void *_beast, Uint8 *_stream, int _length) {
-  Sint16 *stream = (Sint16 *)_stream;
+  int16_t *stream = (int16_t *)_stream;
   int length = _length / 2;
   Beast *beast = (Beast *)_beast;
 
@@ -209,9 +162,8 @@ void audio_callback(void *_beast, Uint8 *_stream, int _length) {
 }
 
 void Beast::setupAudio(int audioDevice, int sampleRate, int volume) {
+  setAudio(sampleRate, volume);
   if (sampleRate > 0) {
-    audioSampleRatePs = UINT64_C(1000000000000) / sampleRate;
-    this->volume = volume;
     SDL_AudioSpec desiredSpec;
 
     desiredSpec.freq = sampleRate;
@@ -236,55 +188,19 @@ void Beast::setupAudio(int audioDevice, int sampleRate, int volume) {
 
     // start play audio
     SDL_PauseAudioDevice(id, 0);
-  } else {
-    audioSampleRatePs = 0;
-  }
-}
-
-void Beast::loadSamples(Sint16 *stream, int length) {
-  std::fill(stream, stream + length, audioLastSample);
-
-  if (audioAvailable < length)
-    return;
-
-  int block1Length = length;
-  int block2Length = 0;
-  if (audioRead + length > AUDIO_BUFFER_SIZE) {
-    block1Length = AUDIO_BUFFER_SIZE - audioRead;
-    block2Length = length - block1Length;
-  }
-
-  SDL_memcpy(stream, audioBuffer + audioRead, block1Length * 2);
-  SDL_memcpy(stream + block1Length, audioBuffer, block2Length * 2);
-
-  audioLastSample = audioBuffer[((audioRead + length - 1) % AUDIO_BUFFER_SIZE)];
-
-  audioRead = (audioRead + length) % AUDIO_BUFFER_SIZE;
-  audioAvailable -= length;
-  if (audioFile) {
-    fwrite(stream, 2, length, audioFile);
   }
 }
 
 Beast::~Beast() {
   pageMap.close();
-  SDL_CloseAudio();
-  if (audioFile) {
-    fclose(audioFile);
-    audioFile = nullptr;
+  if (audioSampleRatePs != 0) {
+    SDL_CloseAudio();
   }
   if (indicatorFont) {
     TTF_CloseFont(indicatorFont);
   }
-  delete debugManager;
 }
 
-uint8_t *Beast::getRom() { return rom; }
-
-uint8_t *Beast::getRam() { return ram; }
-
-Digit *Beast::getDigit(int index) { return &display[index]; }
-
 void Beast::drawKeys() {
 
   SDL_SetRenderTarget(sdlRenderer, keyboardTexture);
@@ -381,43 +297,27 @@ void Beast::drawKey(int col, int row, int offsetX, int offsetY, bool pressed) {
 
 void Beast::mainLoop() {
   run(false); // One tick to get going...
+  if (headless) {
+    headlessLoop();
+    return;
+  }
   while (mode != GUI::QUIT) {
     if (mode == GUI::RUN) {
-      uint64_t start_time = SDL_GetPerformanceCounter();
-
-      uint64_t startTime = tickCount;
-      run(true);
-
-      uint64_t end_time = SDL_GetPerformanceCounter();
-      double duration =
-          ((double)(end_time - start_time)) / SDL_GetPerformanceFrequency();
-      double mhz = ((double)(tickCount-startTime)) / 1000000 / duration;
+      runOnThread();
 
       listMode = LM_CPU;
-      std::cout << "Speed " << mhz << " Mhz" << std::endl;
-      while (!z80_opdone(&cpu)) {
-        run(false);
-      }
+      pacer.report(targetSpeedHz);
     } else if (mode == GUI::STEP) {
-      do {
-        run(false);
-      } while (!z80_opdone(&cpu));
+      runUntil(StopCondition{StopCondition::INSTRUCTION});
 
       mode = GUI::DEBUG;
     } else if (mode == GUI::OUT) {
       instr->resetStack();
-      bool isOut = false;
-      do {
-        if (z80_opdone(&cpu)) {
-          isOut = instr->isOut(readMem(cpu.pc - 1), readMem(cpu.pc));
-        }
-        run(false);
-      } while (!z80_opdone(&cpu) || (!isOut && mode == GUI::OUT));
-      mode = GUI::DEBUG;
+      runUntil(StopCondition{StopCondition::OUT});
+      finishInstruction();
+      stepComplete();
     } else if (mode == GUI::OVER) {
-      while (!z80_opdone(&cpu)) {
-        run(false);
-      }
+      finishInstruction();
       if (instr->isJumpOrReturn(readMem(cpu.pc - 1), readMem(cpu.pc))) {
         // Unconditional jump/return.. always step..
         std::cout << "Unconditional jump, stepping" << std::endl;
@@ -437,25 +337,21 @@ void Beast::mainLoop() {
         std::cout << "Breakpoint for OVER is " << breakPoint << " PC " << cpu.pc
                   << " Length " << length << std::endl;
 
-        do {
-          run(false);
-        } while (!z80_opdone(&cpu) || (cpu.pc != breakPoint && mode == GUI::OVER));
+        runUntil(StopCondition{StopCondition::ADDRESS, breakPoint});
+        finishInstruction();
       }
-      mode = GUI::DEBUG;
+      stepComplete();
     } else if (mode == GUI::TAKE) {
-      uint16_t branchAddress = cpu.pc - 1;
-      bool isTaken = false;
-      do {
-        if (z80_opdone(&cpu) && (cpu.pc - 1 == branchAddress)) {
-          isTaken = instr->isTaken(readMem(cpu.pc - 1), readMem(cpu.pc), cpu.f);
-        }
-        run(false);
-      } while (!z80_opdone(&cpu) || (!isTaken && mode == GUI::TAKE));
-      mode = GUI::DEBUG;
+      runUntil(StopCondition{StopCondition::TAKEN, (uint16_t)(cpu.pc - 1)});
+      finishInstruction();
+      stepComplete();
     }
 
     if ((mode == GUI::DEBUG) || (mode == GUI::FILES) || (mode == GUI::BREAKPOINTS) ||
         (mode == GUI::WATCHPOINTS) || (mode == GUI::TRACELOG) || (mode == GUI::HELP)) {
+      FrameSnapshot frame;
+      captureFrame(frame);
+      showFrame(frame);
       drawBeast();
 
       if (mode == GUI::DEBUG) {
@@ -517,8 +413,8 @@ void Beast::mainLoop() {
         continue; // Don't process page map events as main window events
       }
 
-      if (windowEvent.window.windowID != windowId && videoBeast) {
-        videoBeast->handleEvent(windowEvent);
+      if (windowEvent.window.windowID != windowId && videoWindow) {
+        videoWindow->handleEvent(windowEvent);
       }
 
       if (windowEvent.window.event == SDL_WINDOWEVENT_CLOSE &&
@@ -591,6 +487,196 @@ void Beast::mainLoop() {
   }
 }
 
+// Back to the debugger after a multi-instruction step, unless it was closed meanwhile
+void Beast::stepComplete() {
+  if (mode != GUI::QUIT) {
+    mode = GUI::DEBUG;
+  }
+}
+
+void Beast::runOnThread() {
+  if (videoWindow) {
+    videoWindow->setDeferredPresent(true);
+  }
+  onEmulationThread = true;
+  emulationDone = false;
+  stopRequested = false;
+  quitRequested = false;
+
+  std::thread emulation([this]() {
+    run(true);
+    while (!z80_opdone(&cpu)) {
+      run(false);
+    }
+    emulationDone = true;
+  });
+
+  // The UI thread only sees the machine through published frames until the
+  // emulation thread stops
+  while (!emulationDone) {
+    SDL_Event windowEvent;
+    if (SDL_WaitEventTimeout(&windowEvent, 1000 / (2 * FRAME_RATE)) != 0) {
+      handleRunEvent(windowEvent);
+    }
+    sendUnsentKeys();
+
+    if (frames.update()) {
+      changed |= showFrame(frames.front());
+    }
+    if (changed) {
+      drawBeast();
+      SDL_RenderPresent(sdlRenderer);
+      changed = false;
+    }
+    if (videoWindow) {
+      videoWindow->present();
+    }
+
+    size_t fileIndex;
+    while (reloadedFiles.pop(fileIndex)) {
+      reportReload(binaryFiles[fileIndex]);
+    }
+    checkWatchedListings();
+  }
+
+  emulation.join();
+  onEmulationThread = false;
+
+  // Keys the emulation thread never got to still count, now the machine is this thread's
+  EmuCommand command;
+  while (commands.pop(command)) {
+    applyKey(command);
+  }
+  for (const EmuCommand &key : unsentKeys) {
+    applyKey(key);
+  }
+  unsentKeys.clear();
+
+  if (videoWindow) {
+    videoWindow->setDeferredPresent(false);
+    videoWindow->present();
+  }
+}
+
+void Beast::handleRunEvent(SDL_Event windowEvent) {
+  if (windowEvent.window.windowID != windowId && videoWindow) {
+    videoWindow->handleEvent(windowEvent);
+  }
+
+  if (SDL_QUIT == windowEvent.type ||
+      (SDL_WINDOWEVENT == windowEvent.type &&
+       windowEvent.window.event == SDL_WINDOWEVENT_CLOSE)) {
+    quitRequested = true;
+  } else if (SDL_KEYDOWN == windowEvent.type) {
+    if (windowEvent.key.keysym.sym == SDLK_ESCAPE) {
+      stopRequested = true;
+    } else if (windowEvent.key.keysym.sym == SDLK_F3) {
+      showStats = !showStats;
+      stats.setTiming(showStats);
+      changed = true;
+    } else if (windowEvent.key.keysym.sym == SDLK_F4) {
+      profiler.requestReport();
+    } else {
+      sendKey(EmuCommand::KEY_DOWN, windowEvent.key.keysym.sym);
+    }
+  } else if (SDL_KEYUP == windowEvent.type) {
+    sendKey(EmuCommand::KEY_UP, windowEvent.key.keysym.sym);
+  } else if (SDL_RENDER_TARGETS_RESET == windowEvent.type) {
+    redrawScreen();
+    changed = true;
+  }
+}
+
+// In order, behind any that are still waiting for the emulation thread to catch up
+void Beast::sendKey(EmuCommand::Type type, SDL_Keycode key) {
+  unsentKeys.push_back(EmuCommand{type, key});
+  sendUnsentKeys();
+}
+
+void Beast::sendUnsentKeys() {
+  while (!unsentKeys.empty() && commands.push(unsentKeys.front())) {
+    unsentKeys.pop_front();
+  }
+}
+
+void Beast::applyKey(const EmuCommand &command) {
+  if (command.type == EmuCommand::KEY_DOWN) {
+    keyDown(command.key);
+  } else {
+    keyUp(command.key);
+  }
+}
+
+// Once a frame while running, the UI gets its turn: here when it shares the thread,
+// or through the queues to it when emulation runs on a thread of its own
+bool Beast::onFrame() {
+  if (headless) {
+    return Machine::onFrame();
+  }
+  bool run = true;
+  if (onEmulationThread) {
+    EmuCommand command;
+    while (commands.pop(command)) {
+      applyKey(command);
+    }
+    if (quitRequested.exchange(false)) {
+      mode = GUI::QUIT;
+      run = false;
+    } else if (stopRequested.exchange(false)) {
+      stopReason = STOP_ESCAPE;
+      mode = GUI::DEBUG;
+      run = false;
+    }
+
+    // Reload on this thread so memory is never written under the CPU
+    for (size_t i = 0; i < binaryFiles.size(); i++) {
+      if (binaryFiles[i].isUpdated()) {
+        binaryFiles[i].load(rom, ram, pagingEnabled, memoryPage, videoRam);
+        reloadedFiles.push(i);
+        memoryReloaded();
+      }
+    }
+
+    captureFrame(frames.back());
+    frames.publish();
+  } else {
+    SDL_Event windowEvent;
+    if (SDL_PollEvent(&windowEvent) != 0) {
+      if (windowEvent.window.windowID != windowId && videoWindow) {
+        videoWindow->handleEvent(windowEvent);
+      }
+
+      if (SDL_WINDOWEVENT == windowEvent.type) {
+        if (windowEvent.window.event == SDL_WINDOWEVENT_CLOSE) {
+          mode = GUI::QUIT;
+          run = false;
+        }
+      } else if (SDL_KEYDOWN == windowEvent.type) {
+        if (windowEvent.key.keysym.sym == SDLK_ESCAPE) {
+          stopReason = STOP_ESCAPE;
+          mode = GUI::DEBUG;
+          run = false;
+        } else
+          keyDown(windowEvent.key.keysym.sym);
+      } else if (SDL_KEYUP == windowEvent.type) {
+        keyUp(windowEvent.key.keysym.sym);
+      } else if (SDL_RENDER_TARGETS_RESET == windowEvent.type) {
+        redrawScreen();
+      }
+    }
+    onDraw();
+    checkWatchedFiles();
+  }
+  return run;
+}
+
+void Beast::onBreak() { mode = GUI::DEBUG; }
+
+void Beast::onRestore() {
+  listMode = LM_CPU;
+  changed = true;
+}
+
 void Beast::debugMenu(SDL_Event windowEvent) {
   int maxSelection = static_cast<int>(SEL_BREAKPOINT);
 
@@ -679,6 +765,31 @@ void Beast::debugMenu(SDL_Event windowEvent) {
   case SDLK_p:
     pageMap.toggle();
     break;
+  case SDLK_k:
+    // Cycle x1, x2, x4, x8 then unthrottled
+    if (speedMultiplier == SPEED_MAX) {
+      setSpeedMultiplier(1);
+    } else if (speedMultiplier >= 8) {
+      setSpeedMultiplier(SPEED_MAX);
+    } else {
+      setSpeedMultiplier(speedMultiplier * 2);
+    }
+    break;
+  case SDLK_x:
+    setEngine(engine == ENGINE_FAST ? ENGINE_CYCLE : ENGINE_FAST);
+    break;
+  case SDLK_F5:
+    saveState(stateFile.c_str());
+    break;
+  case SDLK_F9:
+    loadState(stateFile.c_str());
+    break;
+  case SDLK_z:
+    stepBack();
+    break;
+  case SDLK_j:
+    reverseContinue();
+    break;
   case SDLK_q:
     mode = GUI::QUIT;
     break;
@@ -834,8 +945,9 @@ void Beast::fileMenu(SDL_Event windowEvent) {
     if (videoBeast) {
       binaryFilePrompt(PROMPT_BINARY_VIDEO);
     } else {
-      videoBeast = new VideoBeast(1.0f);
+      videoBeast = videoWindow = new VideoWindow(1.0f);
       initVideoBeast();
+      placeVideoWindow();
       std::string videoFile = assetPath(DEFAULT_VIDEO_FILE);
       std::ifstream myfile(videoFile);
 
@@ -845,6 +957,7 @@ void Beast::fileMenu(SDL_Event windowEvent) {
             BinaryFile(videoFile.c_str(), 0, false, BinaryFile::VIDEO_RAM);
         binaryFiles.push_back(file);
         file.load(rom, ram, pagingEnabled, memoryPage, videoRam);
+        memoryReloaded();
       }
     }
     break;
@@ -1016,6 +1129,7 @@ void Beast::promptComplete() {
       gui.drawPrompt(true);
       binaryFiles[fileActionIndex].load(rom, ram, pagingEnabled, memoryPage,
                                         videoRam);
+      memoryReloaded();
       gui.endPrompt(true);
     } else if (gui.getEditValue() == 1) {
       binaryFiles[fileActionIndex].toggleWatch();
@@ -1037,6 +1151,7 @@ void Beast::promptComplete() {
   case PROMPT_BINARY_ADDRESS: {
     BinaryFile binary = BinaryFile(*listingPath, gui.getEditValue(), false);
     reportLoad(binary.load(rom, ram, pagingEnabled, memoryPage, videoRam));
+    memoryReloaded();
     binaryFiles.push_back(binary);
     break;
   }
@@ -1044,6 +1159,7 @@ void Beast::promptComplete() {
     BinaryFile binary = BinaryFile(*listingPath, gui.getEditValue(), false,
                                    BinaryFile::LOGICAL);
     reportLoad(binary.load(rom, ram, pagingEnabled, memoryPage, videoRam));
+    memoryReloaded();
     binaryFiles.push_back(binary);
     break;
   }
@@ -1057,6 +1173,7 @@ void Beast::promptComplete() {
     BinaryFile binary = BinaryFile(*listingPath, gui.getEditValue(), false,
                                    BinaryFile::PAGE_OFFSET, loadBinaryPage);
     reportLoad(binary.load(rom, ram, pagingEnabled, memoryPage, videoRam));
+    memoryReloaded();
     binaryFiles.push_back(binary);
     break;
   }
@@ -1064,6 +1181,7 @@ void Beast::promptComplete() {
     BinaryFile binary = BinaryFile(*listingPath, gui.getEditValue(), false,
                                    BinaryFile::VIDEO_RAM);
     reportLoad(binary.load(rom, ram, pagingEnabled, memoryPage, videoRam));
+    memoryReloaded();
     binaryFiles.push_back(binary);
     break;
   }
@@ -1170,285 +1288,10 @@ void Beast::updateSelection(int direction, int maxSelection) {
   } while (skip);
 }
 
-void Beast::run(bool run) {
-  SDL_Event windowEvent;
-
-  uint64_t startTime = SDL_GetTicks();
-  uint64_t startClockPs = clock_time_ps;
-  uint64_t lastAudioSample = clock_time_ps;
-
-  do {
-    clock_time_ps += clock_cycle_ps;
-
-    pins = z80_tick(&cpu, pins) & Z80_PIN_MASK;
-
-    pins |= Z80_IEIO;
-
-    if ((pins & PIO_SEL_MASK) == PIO_SEL_PINS) {
-      pins |= Z80PIO_CE;
-    }
-    if (pins & Z80_A0) {
-      pins |= Z80PIO_BASEL;
-    }
-    if (pins & Z80_A1) {
-      pins |= Z80PIO_CDSEL;
-    }
-
-    Z80PIO_SET_PAB(pins, 0xFF, portB); /// Set uart_int, i2c_clk, i2c_data
-
-    pins = z80pio_tick(&pio, pins);
-    i2c->tick(&pins, clock_time_ps);
-    rtc->tick(&pins, clock_time_ps);
-
-    pins = (pins & ~Z80_INT) | ((pins & Z80PIO_INT) ? Z80_INT : 0);
-
-    portB = Z80PIO_GET_PB(pins);
-    portB &= ~0x10; // Clear the UART int pin...
-
-    uart_tick(&uart, clock_time_ps);
-
-    if (pins & Z80_MREQ) {
-      const uint16_t addr = Z80_GET_ADDR(pins);
-      int page = memoryPage[(addr >> 14) & 0x03];
-      // Physical address for watchpoint comparison (full page << 14)
-      uint32_t physicalAddr = (addr & 0x3FFF) | (page << 14);
-      bool isRam = false;
-      bool isVb = false;
-      uint32_t mappedAddr;
-
-      if (pagingEnabled) {
-        isRam = (page & 0xE0) == 0x20;
-        isVb = (page & 0xE0) == 0x40;
-        // Array index uses bank-relative address (page & 0x1F)
-        mappedAddr = (addr & 0x3FFF) | ((page & 0x1F) << 14);
-      } else {
-        // When paging disabled, physical address equals logical address
-        // (flat 64K ROM address space)
-        mappedAddr = addr;
-      }
-
-      // Check watchpoints for memory read/write operations
-      // Always use physical address based on current page mappings
-      if ((pins & (Z80_RD | Z80_WR)) && debugManager->hasActiveWatchpoints()) {
-        bool isRead = (pins & Z80_RD) != 0;
-        if (debugManager->checkWatchpoint(addr, physicalAddr, isRead, watchpointTriggerIndex)) {
-          stopReason = STOP_WATCHPOINT;
-          // Use tracked instruction start PC for accurate trigger address
-          watchpointTriggerAddress = currentInstructionPC;
-          mode = GUI::DEBUG;
-          run = false;
-        }
-      }
-
-      if (pins & Z80_RD) {
-        if (isRam) {
-          uint8_t data = ram[mappedAddr];
-          Z80_SET_DATA(pins, data);
-        } else if (videoBeast && isVb) {
-          uint8_t data = videoBeast->read(mappedAddr, clock_time_ps);
-          Z80_SET_DATA(pins, data);
-        } else if (romOperation) {
-          if (clock_time_ps >= romCompletePs) {
-            romSequence = 0;
-            romOperation = false;
-            uint8_t data = rom[mappedAddr];
-            Z80_SET_DATA(pins, data);
-          } else {
-            uint8_t data = rom[mappedAddr] ^ romOperationMask;
-            romOperationMask ^= 0x40;
-            Z80_SET_DATA(pins, data);
-          }
-        } else {
-          uint8_t data = rom[mappedAddr];
-          Z80_SET_DATA(pins, data);
-        }
-      } else if (pins & Z80_WR) {
-        uint8_t data = Z80_GET_DATA(pins);
-        if (isRam) {
-          ram[mappedAddr] = data;
-        } else if (videoBeast && isVb) {
-          videoBeast->write(mappedAddr, data, clock_time_ps);
-        } else {
-          if (romSequence == 3 && clock_time_ps >= romCompletePs) {
-            romSequence = 0;
-            romOperation = false;
-          }
-
-          switch (romSequence) {
-          case 0:
-            if (mappedAddr == 0x5555 && data == 0xaa) {
-              romSequence = 1;
-            } else {
-              romSequence = 0;
-            }
-            break;
-          case 1:
-            if (mappedAddr == 0x2AAA && data == 0x55) {
-              romSequence = 2;
-            } else {
-              romSequence = 0;
-            }
-            break;
-          case 2:
-            if (mappedAddr == 0x5555 && ((data & 0xF0) != 0)) {
-              romSequence = data;
-            } else {
-              romSequence = 0;
-            }
-            break;
-          case 3:
-            break;
-          case 0xA0:
-            rom[mappedAddr] = data;
-            romOperation = true;
-            romCompletePs = clock_time_ps + ROM_BYTE_WRITE_PS;
-            romSequence = 3;
-            break;
-          case 0x80:
-            if (mappedAddr == 0x5555 && data == 0xaa) {
-              romSequence = 0x81;
-            } else {
-              romSequence = 0;
-            }
-            break;
-          case 0x81:
-            if (mappedAddr == 0x2AAA && data == 0x55) {
-              romSequence = 0x82;
-            } else {
-              romSequence = 0;
-            }
-            break;
-          case 0x82:
-            if (mappedAddr == 0x5555 && data == 0x10) { // Chip erase
-              std::cout << "Erasing chip " << std::endl;
-              for (int i = 1 << 19; i > 0;) {
-                rom[--i] = 0xFF;
-              }
-              romOperation = true;
-              romCompletePs = clock_time_ps + ROM_CHIP_ERASE_PS;
-              romSequence = 3;
-            } else if (data == 0x30) { // Sector erase
-              uint32_t sectorAddress = mappedAddr & ~0x0FFFULL;
-              std::cout << "Erasing sector " << (sectorAddress >> 12)
-                        << std::endl;
-              for (int i = 0; i < 0x1000; i++) {
-                rom[sectorAddress + i] = 0xFF;
-              }
-              romOperation = true;
-              romCompletePs = clock_time_ps + ROM_SECTOR_ERASE_PS;
-              romSequence = 3;
-            } else {
-              romSequence = 0;
-            }
-            break;
-          default:
-            romSequence = 0;
-          }
-        }
-      }
-    } else if (pins & Z80_IORQ) {
-      const uint16_t port = Z80_GET_ADDR(pins);
-      if (pins & Z80_RD) {
-        // handle IO input request at port
-        //...
-        if ((port & 0xF0) == 0x00) {
-          Z80_SET_DATA(pins, readKeyboard(port));
-        } else if ((port & 0xF0) == 0x20) {
-          Z80_SET_DATA(pins, uart_read(&uart, port & 0x07));
-        }
-      } else if (pins & Z80_WR) {
-        // handle IO output request at port
-        //...
-        if ((port & 0x0F0) == 0x70) {
-          // Memory system.
-          if ((port & 0x04) == 0) {
-            memoryPage[port & 0x03] = Z80_GET_DATA(pins);
-          } else {
-            pagingEnabled = (pins & Z80_D0) != 0;
-          }
-        } else if ((port & 0xF0) == 0x20) {
-          uart_write(&uart, port & 0x07, Z80_GET_DATA(pins), clock_time_ps);
-        } else if ((port & 0xF0) == 0x10) {
-        }
-      }
-    }
-
-    if (videoBeast && (nextVideoBeastTickPs <= clock_time_ps)) {
-      nextVideoBeastTickPs = videoBeast->tick(clock_time_ps);
-    }
-
-    uint64_t elapsed = SDL_GetTicks() - startTime;
-    if (elapsed < (clock_time_ps - startClockPs) / 1000000000ULL) {
-      SDL_Delay(1);
-    }
-
-    if ((audioSampleRatePs != 0) &&
-        clock_time_ps - lastAudioSample > audioSampleRatePs) {
-      lastAudioSample += audioSampleRatePs;
-      int next = (audioWrite + 1) % AUDIO_BUFFER_SIZE;
-      if (next != audioRead) {
-        audioBuffer[audioWrite] = (uart.modem_control_register & MCR_OUT2)
-                                      ? 400 * volume
-                                      : -400 * volume;
-        audioWrite = next;
-        audioAvailable++;
-      }
-    }
-
-    if (tickCount % (targetSpeedHz / FRAME_RATE) == 0) {
-      if (SDL_PollEvent(&windowEvent) != 0) {
-        if (windowEvent.window.windowID != windowId && videoBeast) {
-          videoBeast->handleEvent(windowEvent);
-        }
-
-        if (SDL_WINDOWEVENT == windowEvent.type) {
-          if (windowEvent.window.event == SDL_WINDOWEVENT_CLOSE) {
-            mode = GUI::QUIT;
-          }
-          break;
-        } else if (SDL_KEYDOWN == windowEvent.type) {
-          if (windowEvent.key.keysym.sym == SDLK_ESCAPE) {
-            stopReason = STOP_ESCAPE;
-            mode = GUI::DEBUG;
-            run = false;
-          } else
-            keyDown(windowEvent.key.keysym.sym);
-        } else if (SDL_KEYUP == windowEvent.type) {
-          keyUp(windowEvent.key.keysym.sym);
-        } else if (SDL_RENDER_TARGETS_RESET == windowEvent.type) {
-          redrawScreen();
-        }
-      }
-      onDraw();
-      checkWatchedFiles();
-    }
-    tickCount++;
-    if (z80_opdone(&cpu)) {
-      // Track the PC for the next instruction (used for accurate watchpoint
-      // trigger address)
-      currentInstructionPC = cpu.pc - 1;
-      history[historyIndex] = currentInstructionPC;
-      historyIndex = (historyIndex+1) % HISTORY_SIZE;
-      if (historyCount<HISTORY_SIZE) historyCount++;
-
-      // Check all breakpoints (user + system) via DebugManager
-      if (const Breakpoint* bp=debugManager->checkBreakpoint(cpu.pc - 1, memoryPage)) {
-        if (bp->isTrace ) {
-          int page = memoryPage[(currentInstructionPC >> 14) & 0x03];
-          uint32_t physicalAddr = (currentInstructionPC & 0x3FFF) | (page << 14);
-
-          debugManager->logTrace(bp, cpu, physicalAddr, memoryPage, pagingEnabled, tickCount, [this](uint16_t address){ return this->readMem(address); });
-        } else {
-          stopReason = STOP_BREAKPOINT;
-          mode = GUI::DEBUG;
-          run = false;
-        }
-      }
-    }
-  } while (run);
-}
-
 void Beast::keyDown(SDL_Keycode keyCode) {
+  if (inputFromJournal()) {
+    return;
+  }
   for (int i = 0; i < KEY_MAP_LENGTH; i++) {
     if (KEY_MAP[i].key == keyCode) {
       switch (KEY_MAP[i].mod) {
@@ -1477,10 +1320,13 @@ void Beast::keyDown(SDL_Keycode keyCode) {
       break;
     }
   }
-  changed = true;
+  journalKeys();
 }
 
 void Beast::keyUp(SDL_Keycode keyCode) {
+  if (inputFromJournal()) {
+    return;
+  }
   for (int i = 0; i < KEY_MAP_LENGTH; i++) {
     if (KEY_MAP[i].key == keyCode) {
       if (KEY_MAP[i].mod != NONE) {
@@ -1492,27 +1338,7 @@ void Beast::keyUp(SDL_Keycode keyCode) {
       break;
     }
   }
-  changed = true;
-}
-
-uint8_t Beast::readKeyboard(uint16_t port) {
-  uint8_t result = 0x3F;
-
-  for (int key : keySet) {
-    int row = key / 12;
-    int col = key % 12;
-    if (col >= 6) {
-      // Right hand side...
-      if (((port >> (row + 12)) & 0x01) == 0) {
-        result &= ~(0x01 << (col - 6));
-      }
-    } else {
-      if (((port >> (11 - row)) & 0x01) == 0) {
-        result &= ~(0x020 >> (col));
-      }
-    }
-  }
-  return result;
+  journalKeys();
 }
 
 void Beast::startMemoryEdit(int view) {
@@ -1590,7 +1416,10 @@ bool Beast::itemEdit(bool getLabel) {
     break;
 
   case SEL_PAGING:
-    if (!getLabel) pagingEnabled = !pagingEnabled;
+    if (!getLabel) {
+      pagingEnabled = !pagingEnabled;
+      updateBanks();
+    }
     break;
   case SEL_PAGE0:
     editValue(memoryPage[0], GUI::COL3, GUI::ROW2, 10, 2, getLabel);
@@ -1725,16 +1554,11 @@ void Beast::editComplete() {
       break;
 
     case SEL_PAGE0:
-      memoryPage[0] = editValue;
-      break;
     case SEL_PAGE1:
-      memoryPage[1] = editValue;
-      break;
     case SEL_PAGE2:
-      memoryPage[2] = editValue;
-      break;
     case SEL_PAGE3:
-      memoryPage[3] = editValue;
+      memoryPage[selection - SEL_PAGE0] = editValue;
+      updateBanks();
       break;
 
     case SEL_VIEWADDR0:
@@ -1896,6 +1720,22 @@ void Beast::checkWatchedFiles() {
     return;
   }
 
+  checkWatchedListings();
+
+  for (auto &file : binaryFiles) {
+    if (file.isUpdated()) {
+      file.load(rom, ram, pagingEnabled, memoryPage, videoRam);
+      reportReload(file);
+      memoryReloaded();
+    }
+  }
+}
+
+void Beast::checkWatchedListings() {
+  if (gui.isPrompt()) {
+    return;
+  }
+
   for (auto &source : listing.getFiles()) {
     if (listing.isUpdated(source)) {
       gui.startPrompt(0, "Reloading %s", source.filename.c_str());
@@ -1906,17 +1746,13 @@ void Beast::checkWatchedFiles() {
       gui.endPrompt(true);
     }
   }
+}
 
-  for (auto &file : binaryFiles) {
-    if (file.isUpdated()) {
-      file.load(rom, ram, pagingEnabled, memoryPage, videoRam);
-
-      gui.startPrompt(0, "Reloaded file %s", file.getFilename().c_str());
-      gui.drawPrompt(true);
-      SDL_Delay(500);
-      gui.endPrompt(true);
-    }
-  }
+void Beast::reportReload(BinaryFile &file) {
+  gui.startPrompt(0, "Reloaded file %s", file.getFilename().c_str());
+  gui.drawPrompt(true);
+  SDL_Delay(500);
+  gui.endPrompt(true);
 }
 
 void Beast::onDebug() {
@@ -2007,7 +1843,7 @@ void Beast::onDebug() {
   id = drawMemoryLayout(2, GUI::ROW15, id, textColor, bright);
 
   std::bitset<8> ioSelectA(pio.port[0].io_select);
-  std::bitset<8> portDataA(Z80PIO_GET_PA(pins));
+  std::bitset<8> portDataA(Z80PIO_GET_PA(portPins));
 
   gui.print(GUI::COL1, GUI::ROW19, textColor, "Port A");
   gui.print(120, GUI::ROW19, textColor,
@@ -2015,7 +1851,7 @@ void Beast::onDebug() {
   gui.print(120, GUI::ROW20, textColor, (char *)portDataA.to_string().c_str());
 
   std::bitset<8> ioSelectB(pio.port[1].io_select);
-  std::bitset<8> portDataB(Z80PIO_GET_PB(pins));
+  std::bitset<8> portDataB(Z80PIO_GET_PB(portPins));
 
   gui.print(220, GUI::ROW19, textColor, "Port B");
   gui.print(290, GUI::ROW19, textColor,
@@ -2029,6 +1865,14 @@ void Beast::onDebug() {
     gui.print(430, GUI::ROW19, textColor, "Audio Disabled");
   }
 
+  if (speedMultiplier == SPEED_MAX) {
+    gui.print(430, GUI::ROW20, menuColor, "Spee[K] Max");
+  } else {
+    gui.print(430, GUI::ROW20, menuColor, "Spee[K] x%d", speedMultiplier);
+  }
+  gui.print(530, GUI::ROW20, menuColor,
+            engine == ENGINE_FAST ? "[X] Fast" : "[X] Exact");
+
   gui.print(620, GUI::ROW19, textColor, "TTY :%d", uart_port(&uart));
   if (uart_connected(&uart)) {
     gui.print(620, GUI::ROW20, menuColor, "Connected [D]rop");
@@ -2687,6 +2531,7 @@ void Beast::displayVideoMem(int x, int y, SDL_Color textColor, VideoView view,
     address += 16;
   }
 }
+
 void Beast::displayMem(int x, int y, SDL_Color textColor, uint16_t markAddress,
                        int page) {
   uint16_t address = (markAddress & 0xFFF0) - 16;
@@ -2734,43 +2579,6 @@ void Beast::displayMem(int x, int y, SDL_Color textColor, uint16_t markAddress,
   }
 }
 
-void Beast::writeMem(int page, uint16_t address, uint8_t data) {
-  if (page < 0) {
-    page = memoryPage[(address >> 14) & 0x03];
-  }
-
-  uint32_t mappedAddr = (address & 0x3FFF) | ((page & 0x1F) << 14);
-
-  if ((page & 0xE0) == 0x20) {
-    ram[mappedAddr] = data;
-  } else if ((page & 0xE0) == 0x40) {
-    if (videoBeast) {
-      videoBeast->write(address, data, clock_time_ps);
-    }
-  } else {
-    rom[mappedAddr] = data;
-  }
-}
-
-uint8_t Beast::readMem(uint16_t address) {
-  int page = pagingEnabled ? memoryPage[(address >> 14) & 0x03] : 0;
-  return readPage(page, address);
-}
-
-uint8_t Beast::readPage(int page, uint16_t address) {
-  bool isRam = (page & 0xE0) == 0x20;
-  if (!isRam && ((page & 0xE0) == 0x40)) {
-    // Videobeast
-    if (videoBeast) {
-      return videoBeast->read(address, clock_time_ps);
-    } else {
-      return 0;
-    }
-  }
-  uint32_t mappedAddr = (address & 0x3FFF) | (page & 0x1F) << 14;
-  return isRam ? ram[mappedAddr] : rom[mappedAddr];
-}
-
 uint32_t Beast::getVideoAddress(int index, VideoView view) {
   switch (view) {
   case VV_RAM:
@@ -2809,10 +2617,9 @@ void Beast::setVideoAddress(int index, VideoView view, uint32_t value) {
 }
 
 void Beast::onDraw() {
-  // Do something..
-  for (int i = 0; i < DISPLAY_CHARS; i++) {
-    changed |= display[i].changed;
-  }
+  FrameSnapshot frame;
+  captureFrame(frame);
+  changed |= showFrame(frame);
 
   if (changed) {
     drawBeast();
@@ -2821,9 +2628,50 @@ void Beast::onDraw() {
   }
 }
 
+void Beast::captureFrame(FrameSnapshot &frame) {
+  for (int i = 0; i < DISPLAY_CHARS; i++) {
+    frame.segments[i] = display[i].getSegments();
+    for (int segment = 0; segment < Digit::SEGMENTS; segment++) {
+      frame.brightness[i][segment] = display[i].getBrightness(segment);
+    }
+  }
+  frame.keys = 0;
+  for (int key : keySet) {
+    frame.keys |= UINT64_C(1) << key;
+  }
+  frame.cpu = cpu;
+  frame.tickCount = tickCount;
+  frame.stats = stats.latest();
+}
+
+// Copy a frame into the digits and keys the UI draws, returns true if anything changed
+bool Beast::showFrame(const FrameSnapshot &frame) {
+  bool updated = frame.keys != shownKeys;
+  shownKeys = frame.keys;
+
+  if (frame.stats.seconds != shownStats.seconds) {
+    shownStats = frame.stats;
+    updated |= showStats;
+  }
+
+  for (int i = 0; i < DISPLAY_CHARS; i++) {
+    if (shownDisplay[i].getSegments() != frame.segments[i]) {
+      shownDisplay[i].setSegments(frame.segments[i]);
+      updated = true;
+    }
+    for (int segment = 0; segment < Digit::SEGMENTS; segment++) {
+      if (shownDisplay[i].getBrightness(segment) != frame.brightness[i][segment]) {
+        shownDisplay[i].setBrightness(segment, frame.brightness[i][segment]);
+        updated = true;
+      }
+    }
+  }
+  return updated;
+}
+
 void Beast::drawBeast() {
   int keyboardTop = (screenHeight - KEYBOARD_HEIGHT);
-  int displayTop = (keyboardTop - 8 - Digit::DIGIT_HEIGHT);
+  int displayTop = (keyboardTop - 8 - DigitView::DIGIT_HEIGHT);
 
   SDL_Point size;
   SDL_QueryTexture(pcbTexture, NULL, NULL, &size.x, &size.y);
@@ -2842,24 +2690,59 @@ void Beast::drawBeast() {
   SDL_RenderCopy(sdlRenderer, pcbTexture, NULL, &pcbRect);
 
   for (int i = 0; i < DISPLAY_CHARS; i++) {
-    display[i].onDraw(sdlRenderer, 4 + i * (Digit::DIGIT_WIDTH + 1),
-                      displayTop);
+    shownDisplay[i].onDraw(sdlRenderer, 4 + i * (DigitView::DIGIT_WIDTH + 1),
+                           displayTop);
   }
 
-  if (keySet.size() > 0) {
-    for (std::set<int>::iterator it = keySet.begin(); it != keySet.end();
-         ++it) {
-      int key = *it;
+  for (int key = 0; key < MAX_KEYS; key++) {
+    if (shownKeys & (UINT64_C(1) << key)) {
       int row = key / 12;
       int col = key % 12;
       drawKey(col, row, 0, keyboardTop, true);
     }
   }
+
+  if (showStats) {
+    drawStats();
+  }
+}
+
+void Beast::drawStats() {
+  SDL_Color textColor = {0xD0, 0xFF, 0xD0, 255};
+  int row = 16;
+  int rows = 6 + Stats::DEVICE_COUNT;
+
+  boxRGBA(sdlRenderer, 8 * zoom, 8 * zoom, 260 * zoom,
+          (16 + rows * GUI::ROW_HEIGHT) * zoom, 0, 0, 0, 0xC0);
+
+  if (!shownStats.valid) {
+    gui.print(16, row, textColor, "Collecting statistics...");
+    return;
+  }
+  gui.print(16, row, textColor, "Emulated      %6.2f MHz", shownStats.mhz);
+  row += GUI::ROW_HEIGHT;
+  gui.print(16, row, textColor, "Host busy     %6.1f ms/s",
+            shownStats.hostMsPerSecond);
+  row += GUI::ROW_HEIGHT;
+  gui.print(16, row, textColor, "VideoBeast    %6.1f fps", shownStats.videoFps);
+  row += GUI::ROW_HEIGHT;
+  gui.print(16, row, textColor, "Audio dropped %6d", (int)shownStats.audioDropped);
+  row += GUI::ROW_HEIGHT;
+  gui.print(16, row, textColor, "UART          %6.0f bytes/s",
+            shownStats.uartBytesPerSecond);
+  row += GUI::ROW_HEIGHT;
+  gui.print(16, row, textColor, "Device time (us/s)");
+  row += GUI::ROW_HEIGHT;
+  for (int i = 0; i < Stats::DEVICE_COUNT; i++) {
+    gui.print(24, row, textColor, "%-12s %8.0f", Stats::DEVICE_NAMES[i],
+              shownStats.deviceUsPerSecond[i]);
+    row += GUI::ROW_HEIGHT;
+  }
 }
 
 void Beast::redrawScreen() {
   for (int i = 0; i < DISPLAY_CHARS; i++) {
-    display[i].changed = true;
+    shownDisplay[i].changed = true;
   }
   drawKeys();
   drawBeast();
@@ -1,40 +1,27 @@
 #pragma once
+#include <atomic>
+#include <deque>
+#include <memory>
 #include <set>
 #include <vector>
 #include "SDL.h"
 #include "SDL_ttf.h"
 #include "SDL2_gfxPrimitives.h"
 
-#include "z80.h"
-#include "z80pio.h"
-#include "digit.hpp"
-#include "i2c.hpp"
-#include "display.hpp"
+#include "machine.hpp"
+#include "digitView.hpp"
 #include "gui.hpp"
 #include "helpGui.hpp"
-#include "rtc.hpp"
-#include "uart16c550.h"
-#include "listing.hpp"
-#include "binaryFile.hpp"
-#include "instructions.hpp"
-#include "videobeast.hpp"
-#include "debugmanager.hpp"
+#include "videoWindow.hpp"
 #include "breakpointGui.hpp"
 #include "pagemap.hpp"
+#include "emuthread.hpp"
 
-#define BEAST_IO_MASK (Z80_M1|Z80_IORQ|Z80_A7|Z80_A6|Z80_A5|Z80_A4)
-
-#define BEAST_IO_SEL_PINS (Z80_IORQ)
-
-#define PIO_SEL_MASK  (BEAST_IO_MASK)
-#define PIO_SEL_PINS  (BEAST_IO_SEL_PINS|Z80_A4)
-
-class Beast {
+/* The MicroBeast in a window, with its keyboard, display and debugger */
+class Beast : public Machine {
 
     enum Modifier {NONE, CTRL, SHIFT, CTRL_SHIFT, SHIFT_SWAP};
 
-    enum StopReason {STOP_NONE, STOP_STEP, STOP_BREAKPOINT, STOP_WATCHPOINT, STOP_ESCAPE};
-
     enum Selection {SEL_PC, SEL_A, SEL_HL, SEL_BC, SEL_DE, SEL_FLAGS, SEL_SP, SEL_IX, SEL_IY,
         SEL_PAGING, SEL_PAGE0, SEL_PAGE1, SEL_PAGE2, SEL_PAGE3,
         SEL_A2, SEL_HL2, SEL_BC2, SEL_DE2,
@@ -64,9 +51,6 @@ class Beast {
     static const int PROMPT_WRITE_LENGTH   = 10;
     static const int PROMPT_LABEL          = 11;
 
-    static const int ROM_SIZE = 1<<19;
-    static const int RAM_SIZE = 1<<19;
-
     struct BeastKey {
         SDL_KeyCode key;
         int row;
@@ -80,31 +64,16 @@ class Beast {
         ~Beast();
 
         void init(uint64_t targetSpeedHz, uint64_t breakpoint, int audioDevice, int volume, int sampleRate, VideoBeast *videoBeast);
-        void reset();
         void mainLoop();
-        void run(bool run);
-
-        uint8_t *getRom();
-        uint8_t *getRam();
 
         void keyDown(SDL_Keycode keyCode);
         void keyUp(SDL_Keycode keyCode);
         void onDraw();
 
-        uint8_t readKeyboard(uint16_t port);
-
-        Digit* getDigit(int index);
-        
-        void loadSamples(Sint16 *stream, int length);
-
-        static const int AUDIO_FREQ = 16000;
-        static const int AUDIO_BUFFER_SIZE = 16384;
-        static const int BYTES_PER_SAMPLE = 2;
-
-        static const uint64_t ONE_SECOND_PS = UINT64_C(1000000000000);
-        static const uint64_t UART_CLOCK_HZ = UINT64_C(1843200);
-
-        static const uint64_t NOT_SET = UINT64_MAX;
+    protected:
+        bool onFrame() override;
+        void onBreak() override;
+        void onRestore() override;
 
     private:
         SDL_Window    *window;
@@ -112,21 +81,16 @@ class Beast {
         SDL_Texture   *keyboardTexture;
         SDL_Texture   *pcbTexture;
         uint32_t      windowId;
+        bool          headless = false;
+        VideoWindow   *videoWindow = nullptr;   // videoBeast, when it has a window
 
-        uint8_t       rom[ROM_SIZE]; // 512K rom
-        uint8_t       ram[RAM_SIZE]; // 512K ram
-        uint8_t*      videoRam = {0};
-
-        uint8_t                 memoryPage[4];
-        Listing                 &listing;
         Listing::Location       currentLoc;
-        std::vector<BinaryFile> binaryFiles;
         GUI                     gui;
 
         const char* PCB_IMAGE="layout_2d.png";
         const char* DEFAULT_VIDEO_FILE="videobeast.dat";
 
-        TTF_Font *font, *smallFont, *midFont, *indicatorFont;
+        TTF_Font *font = nullptr, *smallFont = nullptr, *midFont = nullptr, *indicatorFont = nullptr;
         int screenWidth, screenHeight;
         float zoom = 1.0f;
 
@@ -134,55 +98,11 @@ class Beast {
         int     selection = 0;
         int     fileActionIndex = -1;
 
-        z80_t    cpu;
-        z80pio_t pio;
-        uart_t     uart;
-        Instructions *instr;
-        uint64_t  tickCount = 0;
-
-        I2c      *i2c;
-        I2cDisplay *display1;
-        I2cDisplay *display2;
-        I2cRTC     *rtc;
-
-        VideoBeast *videoBeast;
-        uint64_t   nextVideoBeastTickPs;
+        bool       showStats = false;   // Overlay on the main window, toggled with F3 while running
+        Stats::Sample shownStats;
 
-        DebugManager    *debugManager;
         BreakpointGui   *breakpointGui;
 
-        static const int HISTORY_SIZE = 1000;
-        uint16_t        history[HISTORY_SIZE];
-        size_t          historyIndex = 0;
-        size_t          historyCount = 0;
-
-        // Stop reason tracking for debug display
-        StopReason stopReason = STOP_NONE;
-        uint16_t   watchpointTriggerAddress = 0;  // Address of instruction that caused WP trigger
-        size_t     watchpointTriggerIndex;   // Which WP (0-7) was triggered
-        uint16_t   currentInstructionPC = 0;      // PC at start of current instruction (for accurate WP trigger address)
-
-        uint64_t pins;
-        uint8_t portB;
-        uint64_t clock_cycle_ps;
-        uint64_t clock_time_ps  = 0;
-        uint64_t targetSpeedHz;
-
-        bool     romOperation = false;
-        uint8_t  romSequence = 0;
-        uint8_t  romOperationMask = 0x80;
-        uint64_t romCompletePs = 0;
-
-        const uint64_t ROM_BYTE_WRITE_PS = 20 * 1000000ULL; 
-        const uint64_t ROM_CHIP_ERASE_PS = 100000 * 1000000ULL;
-        const uint64_t ROM_SECTOR_ERASE_PS = 25000 * 1000000ULL;
-
-
-        bool       pagingEnabled = false;
-        uint8_t    readMem(uint16_t address);
-        uint8_t    readPage(int page, uint16_t address);
-        void       writeMem(int page, uint16_t address, uint8_t data);
-
         MemView    memView[3] = {MV_PC, MV_SP, MV_HL};
         uint16_t   memAddress[3] = {0};
         uint16_t   memPageAddress[3] = {0};
@@ -201,25 +121,13 @@ class Beast {
 
         std::vector<uint16_t> decodedAddresses;         // Addresses decoded on screen
 
-        static const int FRAME_RATE = 50;
-
-        int16_t     audioBuffer[AUDIO_BUFFER_SIZE] = {0};
-        int16_t     audioLastSample = 0;
-        int         audioRead = 0;
-        int         audioWrite= 0;
-        int         audioAvailable = 0;
-        uint64_t    audioSampleRatePs;
-        int         volume;
-        const char* audioFilename = "audio.raw";
-        FILE*       audioFile = nullptr;
-
         std::string *listingPath = nullptr;
 
         int         writeDataLength = 0;
         int         writeDataAddress = 0;
 
         SDL_Renderer* createRenderer(SDL_Window *window);
-        void          initVideoBeast();
+        void          placeVideoWindow();
         float         checkZoomFactor(int screenWidth, int screenHeight, float zoom);
         SDL_Texture*  loadTexture(SDL_Renderer *renderer, const char* filename);
         void          setupAudio(int audioDevice, int sampleRate, int volume);
@@ -272,12 +180,51 @@ class Beast {
 
         void writeDataPrompt();
 
+        void runOnThread();
+        void stepComplete();
+        void handleRunEvent(SDL_Event windowEvent);
+        void checkWatchedListings();
+        void reportReload(BinaryFile &file);
+
         void drawListing(int page, uint16_t address, SDL_Color textColor, SDL_Color highColor, SDL_Color disassColor);
         
-        const static int DISPLAY_CHARS = 24;
-        const static int DISPLAY_WIDTH = DISPLAY_CHARS * Digit::DIGIT_WIDTH;
+        const static int DISPLAY_WIDTH = DISPLAY_CHARS * DigitView::DIGIT_WIDTH;
+
+        std::vector<DigitView> shownDisplay;    // What the UI thread last drew
+        uint64_t           shownKeys = 0;
+
+        // Machine state handed from the emulation thread to the UI thread once per frame
+        struct FrameSnapshot {
+            uint16_t segments[DISPLAY_CHARS];
+            uint8_t  brightness[DISPLAY_CHARS][Digit::SEGMENTS];
+            uint64_t keys;          // Bit (row*12 + col) set for each key held down
+            z80_t    cpu;
+            uint64_t tickCount;
+            Stats::Sample stats;
+        };
 
-        std::vector<Digit> display;
+        struct EmuCommand {
+            enum Type {KEY_DOWN, KEY_UP} type;
+            SDL_Keycode key;
+        };
+
+        // Stop and quit are flags so they can't be lost to a full queue, and keys that
+        // don't fit wait their turn, so a key is never left held down
+        SpscQueue<EmuCommand, 64>     commands;       // UI -> emulation
+        std::deque<EmuCommand>        unsentKeys;     // UI side, waiting for room in commands
+        std::atomic<bool>             stopRequested {false};
+        std::atomic<bool>             quitRequested {false};
+        SpscQueue<size_t, 16>         reloadedFiles;  // emulation -> UI, index into binaryFiles
+        SnapshotBuffer<FrameSnapshot> frames;         // emulation -> UI
+        std::atomic<bool>             emulationDone {false};
+        bool                          onEmulationThread = false;
+
+        void sendKey(EmuCommand::Type type, SDL_Keycode key);
+        void sendUnsentKeys();
+        void applyKey(const EmuCommand &command);
+        void captureFrame(FrameSnapshot &frame);
+        bool showFrame(const FrameSnapshot &frame);
+        void drawStats();
 
         const int KEY_WIDTH = 64;
         const int KEY_HEIGHT = 64;
@@ -393,8 +340,6 @@ class Beast {
             BeastKey{SDLK_MINUS, 1, 10, CTRL}
         };
 
-        std::set<int> keySet = {}; 
-
         const int KEY_SHIFT = 24;
         const int KEY_CTRL = 37;
 
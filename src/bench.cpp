@@ -0,0 +1,422 @@
+#include "bench.hpp"
+#include "assets.hpp"
+#include "listing.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <memory>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+static const uint64_t CPU_HZ = 8000000;
+static const uint64_t MILLISECOND = CPU_HZ / 1000;
+static const uint64_t SECOND = CPU_HZ;
+
+// In the stock firmware: waiting for a key at boot, and the monitor showing the time
+static const uint16_t WAIT_KEY = 0x0343;
+static const uint16_t RTC_DISPLAY_TIME = 0xE600;
+
+// The keyboard matrix as Beast lays it out, so a key's index here is its bit in
+// Machine::setKeys(). Keys that type nothing are ~
+static const char KEYBOARD[] = "~1234567890~"
+                               "~QWERTYUIOP:"
+                               "~ASDFGHJKL.\r"
+                               "~~ZXCVBNM ~~";
+static const int KEY_DOWN = 12;
+static const uint64_t KEY_HOLD = 40 * MILLISECOND;
+static const uint64_t KEY_SETTLE = 100 * MILLISECOND;
+
+static const std::vector<std::string> WORKLOADS = {"boot", "cpm", "videobeast", "uart"};
+
+const std::vector<std::string> &Bench::workloads() {
+    return WORKLOADS;
+}
+
+/* Sends one file as a Y-Modem batch, answering what the receiver sends */
+class YModemSender {
+    public:
+        YModemSender(const std::string &filename, const std::vector<uint8_t> &data);
+
+        /* The next packet to go, if any, for this byte from the receiver */
+        void received(uint8_t byte, std::deque<uint8_t> &reply);
+
+        bool isFinished() const {
+            return finished;
+        }
+
+    private:
+        static const uint8_t SOH = 0x01, STX = 0x02, EOT = 0x04, ACK = 0x06, NAK = 0x15, CRC = 'C';
+
+        std::vector<std::vector<uint8_t>> packets;
+        size_t next = 0;
+        bool   finished = false;
+
+        void addPacket(uint8_t number, const uint8_t *data, size_t length);
+};
+
+YModemSender::YModemSender(const std::string &filename, const std::vector<uint8_t> &data) {
+    std::vector<uint8_t> header(128, 0);
+    std::string info = filename + '\0' + std::to_string(data.size());
+    std::copy(info.begin(), info.end(), header.begin());
+    addPacket(0, header.data(), header.size());
+
+    for( size_t offset = 0; offset < data.size(); offset += 1024 ) {
+        std::vector<uint8_t> block(1024, 0x1A);
+        std::copy(data.begin() + offset, data.begin() + std::min(offset + 1024, data.size()), block.begin());
+        addPacket((uint8_t)(offset / 1024 + 1), block.data(), block.size());
+    }
+    packets.push_back({EOT});
+
+    // An empty file name ends the batch
+    std::fill(header.begin(), header.end(), 0);
+    addPacket(0, header.data(), header.size());
+}
+
+// CRC-16/XMODEM, high byte first
+void YModemSender::addPacket(uint8_t number, const uint8_t *data, size_t length) {
+    std::vector<uint8_t> packet = {length == 128 ? SOH : STX, number, (uint8_t)~number};
+    uint16_t crc = 0;
+    for( size_t i = 0; i < length; i++ ) {
+        crc ^= data[i] << 8;
+        for( int bit = 0; bit < 8; bit++ ) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+        packet.push_back(data[i]);
+    }
+    packet.push_back(crc >> 8);
+    packet.push_back(crc & 0xFF);
+    packets.push_back(packet);
+}
+
+// The receiver asks for the first packet with C, acknowledges each one with ACK and
+// follows that with a C that isn't needed, or asks for it again with NAK
+void YModemSender::received(uint8_t byte, std::deque<uint8_t> &reply) {
+    const std::vector<uint8_t> *packet = nullptr;
+    if( (byte == CRC && next == 0) || (byte == ACK && next > 0 && next < packets.size()) ) {
+        packet = &packets[next++];
+    }
+    else if( byte == ACK && next == packets.size() ) {
+        finished = true;
+    }
+    else if( byte == NAK && next > 0 && !finished ) {
+        packet = &packets[next - 1];
+    }
+    if( packet ) {
+        reply.insert(reply.end(), packet->begin(), packet->end());
+    }
+}
+
+/* The far end of the UART, in place of a network connection. It keeps what the machine
+ * sends and has bytes waiting for it to receive. The UART can only find it by port, so
+ * there is one at a time
+ */
+struct Terminal {
+    std::string         output;
+    std::deque<uint8_t> input;
+    YModemSender        *sender = nullptr;
+
+    static Terminal *listening;
+};
+
+Terminal *Terminal::listening = nullptr;
+
+static void *terminalListen(int) {
+    return Terminal::listening;
+}
+
+static void *terminalAccept(void *server) {
+    return server;
+}
+
+static int terminalReceive(void *client, uint8_t *buffer, int length) {
+    std::deque<uint8_t> &input = ((Terminal *)client)->input;
+    int count = std::min((size_t)length, input.size());
+    std::copy(input.begin(), input.begin() + count, buffer);
+    input.erase(input.begin(), input.begin() + count);
+    return count;
+}
+
+static void terminalSend(void *client, uint8_t byte) {
+    Terminal *terminal = (Terminal *)client;
+    terminal->output.push_back((char)byte);
+    if( terminal->sender ) {
+        terminal->sender->received(byte, terminal->input);
+    }
+}
+
+static void terminalClose(void *) {
+}
+
+static const uart_network_t UART_TERMINAL = {
+    terminalListen, terminalAccept, terminalReceive, terminalSend, terminalClose
+};
+
+/* VideoBeast drawing each line as the window would, into a hash of the frame, and
+ * counting the frames that came out different from the one before
+ */
+class DemoVideo : public VideoBeast {
+    public:
+        int changedFrames = 0;
+
+    protected:
+        void drawLine(int) override {
+            int width = VIDEO_MODE[mode].pixelWidth >> (isDoubled ? 1 : 0);
+            for( int x = 0; x < width; x++ ) {
+                frameHash = (frameHash ^ line_buffer[x]) * 16777619;
+            }
+        }
+
+        void frameDone() override {
+            changedFrames += frameHash != lastFrameHash;
+            lastFrameHash = frameHash;
+            frameHash = 2166136261;
+        }
+
+    private:
+        uint32_t frameHash = 2166136261;
+        uint32_t lastFrameHash = 0;
+};
+
+/* Drives the machine as someone at its keyboard would. Each step gives up after its
+ * cycle limit, and after that so does every other, so a broken run ends quickly
+ */
+class Session {
+    public:
+        Session(Machine &machine, Terminal &terminal) : machine(machine), terminal(terminal) {}
+
+        bool runTo(uint16_t address, uint64_t limit) {
+            // The CPU has fetched the next opcode by the time an instruction ends
+            machine.runUntil(Machine::StopCondition{Machine::StopCondition::ADDRESS, (uint16_t)(address + 1), limit});
+            ok = ok && machine.getCpu().pc == (uint16_t)(address + 1);
+            return ok;
+        }
+
+        void runFor(uint64_t cycles) {
+            machine.runUntil(Machine::StopCondition{Machine::StopCondition::CYCLES, 0, cycles});
+        }
+
+        void press(int key) {
+            machine.setKeys(1ULL << key);
+            runFor(KEY_HOLD);
+            machine.setKeys(0);
+            runFor(KEY_HOLD);
+        }
+
+        // After a pause, as a key pressed the moment a prompt appears can go unread
+        void type(const char *text) {
+            runFor(KEY_SETTLE);
+            for( ; *text; text++ ) {
+                const char *key = strchr(KEYBOARD, toupper(*text));
+                if( key && *key != '~' ) {
+                    press(key - KEYBOARD);
+                }
+            }
+        }
+
+        // Until the UART has sent this since the last thing waited for
+        bool waitFor(const char *text, uint64_t limit) {
+            uint64_t end = machine.getTickCount() + limit;
+            size_t found;
+            while( ok && (found = terminal.output.find(text, seen)) == std::string::npos ) {
+                if( machine.getTickCount() >= end ) {
+                    ok = false;
+                    break;
+                }
+                runFor(std::min(end - machine.getTickCount(), SECOND / 50));
+            }
+            if( ok ) {
+                seen = found + strlen(text);
+            }
+            return ok;
+        }
+
+        // From power on to the time shown in the monitor, as for the boot workload
+        bool boot() {
+            if( runTo(WAIT_KEY, 5 * SECOND) ) {
+                press(strchr(KEYBOARD, ' ') - KEYBOARD);
+            }
+            return runTo(RTC_DISPLAY_TIME, 60 * SECOND);
+        }
+
+    private:
+        Machine  &machine;
+        Terminal &terminal;
+        size_t   seen = 0;
+        bool     ok = true;
+};
+
+static bool runBoot(Session &session) {
+    return session.boot();
+}
+
+// Any key brings up the monitor's menu, where Launch CP/M is one down
+static bool runCpm(Session &session) {
+    session.boot();
+    session.type("\r");
+    session.press(KEY_DOWN);
+    session.type("\r");
+    session.waitFor("A>", 30 * SECOND);
+    session.type("SIEVE\r");
+    session.waitFor(": ", 30 * SECOND);
+    session.type("60000\r");
+    session.waitFor("(Y/N) ", 10 * SECOND);
+    session.type("N\r");
+    return session.waitFor("A>", 60 * SECOND);
+}
+
+// The layers are set up as a program would through the registers, one of each type under
+// the text layer that video_registers.mem puts in layer 5. Each is scrolled every frame,
+// and the demo has only run if nearly every frame drawn looks different from the last
+static bool runVideoBeast(Session &session, DemoVideo &videoBeast) {
+    // Type, top, bottom, left and right, then the type's own registers, see videobeast.hpp
+    static const uint8_t LAYERS[][11] = {
+        {4, 0, 29, 0, 40, 0, 0, 0, 0x20, 0,    0},      // 8bpp bitmap at 512K
+        {5, 4, 25, 4, 36, 0, 0, 0, 0x10, 0,    1},      // 4bpp bitmap at 256K, palette 1
+        {3, 0, 29, 0, 39, 0, 0, 0, 0x04, 0x04, 0},      // Tile map at 64K, tiles at 128K
+        {2, 0, 29, 0, 40, 0, 0, 0, 0x18, 0x04, 14},     // 16 sprites listed at 48K, with the tiles
+    };
+    static const int SPRITES = 16;
+    static const uint32_t SPRITE_LIST = 0x18 << 11;
+    static const int DEMO_FRAMES = 300;
+
+    for( int layer = 0; layer < 4; layer++ ) {
+        for( int offset = 0; offset < 11; offset++ ) {
+            videoBeast.writeRegister(0x80 + 16*layer + offset, LAYERS[layer][offset]);
+        }
+    }
+
+    bool booted = session.boot();
+    videoBeast.changedFrames = 0;
+    for( int frame = 0; booted && frame < DEMO_FRAMES; frame++ ) {
+        for( int layer = 0; layer < 3; layer++ ) {
+            int x = frame * (layer + 1), y = frame / (layer + 1);
+            videoBeast.writeRegister(0x80 + 16*layer + 5, x & 0xFF);
+            videoBeast.writeRegister(0x80 + 16*layer + 6, ((y >> 4) & 0xF0) | ((x >> 8) & 0x0F));
+            videoBeast.writeRegister(0x80 + 16*layer + 7, y & 0xFF);
+        }
+        videoBeast.writeRegister(0xD7, frame & 0xFF);
+
+        // 16x16 sprites drifting across, each from its own tiles and palette
+        for( int sprite = 0; sprite < SPRITES; sprite++ ) {
+            uint32_t entry = SPRITE_LIST + 8*sprite;
+            int x = 32 + sprite * 16 + (frame * 3) % 128;
+            int y = 16 + sprite * 12 + (frame * 2) % 64;
+            uint16_t xData = 0x1000 | (x & 0x7FF);
+            uint16_t yData = 0x9000 | (y & 0x3FF);
+            videoBeast.writeRam(entry, sprite * 4);
+            videoBeast.writeRam(entry + 1, (sprite << 4) & 0xF0);
+            videoBeast.writeRam(entry + 2, xData & 0xFF);
+            videoBeast.writeRam(entry + 3, xData >> 8);
+            videoBeast.writeRam(entry + 4, yData & 0xFF);
+            videoBeast.writeRam(entry + 5, yData >> 8);
+        }
+        session.runFor(SECOND / 60);
+    }
+    return booted && videoBeast.changedFrames >= DEMO_FRAMES * 9 / 10;
+}
+
+// Y-Modem Transfer is three down the monitor's menu, then Address from file one down. The
+// file name asks for it to go to page 28, clear of the pages the monitor uses, and on over
+// the next one, where it is checked after
+static bool runUart(Session &session, Machine &machine, Terminal &terminal) {
+    static const int LENGTH = 32 * 1024;
+    static const int PAGE = 0x28;
+
+    std::vector<uint8_t> data(LENGTH);
+    uint32_t seed = 1;
+    for( uint8_t &byte : data ) {
+        seed = seed * 1103515245 + 12345;
+        byte = seed >> 16;
+    }
+    YModemSender sender("bench_p28.bin", data);
+
+    session.boot();
+    session.type("\r");
+    for( int i = 0; i < 3; i++ ) {
+        session.press(KEY_DOWN);
+    }
+    session.type("\r");
+    session.press(KEY_DOWN);
+    session.type("\r");
+    session.waitFor("Start transfer", 10 * SECOND);
+
+    terminal.sender = &sender;
+    bool ok = session.waitFor("BYTES @", 120 * SECOND) && sender.isFinished();
+    terminal.sender = nullptr;
+
+    uint8_t *ram = machine.getRam() + ((PAGE & 0x1F) << 14);
+    return ok && std::equal(data.begin(), data.end(), ram);
+}
+
+bool Bench::run(const std::string &name, BenchResult &result) {
+    if( std::find(WORKLOADS.begin(), WORKLOADS.end(), name) == WORKLOADS.end() ) {
+        return false;
+    }
+    result.name = name;
+
+    std::vector<BinaryFile> files = {BinaryFile(assetPath("flash_v1.7.bin"), 0, false)};
+    std::unique_ptr<DemoVideo> videoBeast;
+    if( name == "videobeast" ) {
+        files.push_back(BinaryFile(assetPath("videobeast.dat"), 0, false, BinaryFile::VIDEO_RAM));
+        videoBeast.reset(new DemoVideo());
+    }
+
+    Terminal terminal;
+    Terminal::listening = &terminal;
+    Listing listing;
+    Machine machine(listing, files);
+    machine.setUartNetwork(&UART_TERMINAL);
+    machine.init(CPU_HZ, Machine::NOT_SET, videoBeast.get());
+    machine.setEngine(engine);
+    machine.setSpeedMultiplier(Machine::SPEED_MAX);
+    machine.setRewindBudget(rewindMegabytes);
+
+    Session session(machine, terminal);
+    auto start = std::chrono::steady_clock::now();
+    if( name == "boot" ) {
+        result.completed = runBoot(session);
+    }
+    else if( name == "cpm" ) {
+        result.completed = runCpm(session);
+    }
+    else if( name == "videobeast" ) {
+        result.completed = runVideoBeast(session, *videoBeast);
+    }
+    else {
+        result.completed = runUart(session, machine, terminal);
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.cycles = machine.getTickCount();
+    result.peakRssKb = peakRssKb();
+
+    Terminal::listening = nullptr;
+    return true;
+}
+
+long Bench::peakRssKb() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if( !GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ) {
+        return 0;
+    }
+    return (long)(counters.PeakWorkingSetSize / 1024);
+#else
+    struct rusage usage;
+    if( getrusage(RUSAGE_SELF, &usage) != 0 ) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;  // Bytes on macOS, kilobytes elsewhere
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "machine.hpp"
+
+/**
+ * bench.hpp - Fixed workloads for timing the emulator, a yardstick for performance changes
+ *
+ * Each workload starts from power on and drives the stock firmware as a user would,
+ * with key presses and UART traffic at set cycle counts. Every run emulates exactly
+ * the same cycles, so only the host time taken can differ between builds.
+ *
+ *   boot         From reset to the monitor's clock display
+ *   cpm          Launch CP/M from the monitor and run SIEVE from the ROM disk
+ *   videobeast   Every VideoBeast layer type over videobeast.dat, scrolling, while the monitor runs
+ *   uart         Upload a file to the monitor with Y-Modem
+ *
+ * Peak RSS is for the whole process, so beastem_bench runs each workload in a process of
+ * its own.
+ */
+struct BenchResult {
+    std::string name;
+    bool        completed = false;  // Got to the end of its script within the cycle limits
+    uint64_t    cycles = 0;         // Emulated, from power on
+    double      seconds = 0;        // Host time taken to emulate them
+    long        peakRssKb = 0;
+};
+
+class Bench {
+    public:
+        static const std::vector<std::string> &workloads();
+
+        Bench(Machine::Engine engine, size_t rewindMegabytes) : engine(engine), rewindMegabytes(rewindMegabytes) {}
+
+        /* Run one of the workloads above in a machine of its own. False if there is no such workload */
+        bool run(const std::string &name, BenchResult &result);
+
+        /* The most memory this process has had resident so far */
+        static long peakRssKb();
+
+    private:
+        Machine::Engine engine;
+        size_t          rewindMegabytes;
+};
@@ -0,0 +1,184 @@
+#pragma once
+#include <stdint.h>
+#include <cstring>
+#include <unordered_map>
+
+/**
+ * blockcache.hpp - Decoded runs of guest code for the fast engine
+ *
+ * A block is the straight-line code from a physical address (page << 14 | offset,
+ * as used by DebugManager and Listing) up to the next jump, call, return or HALT,
+ * already split into instructions. The fast engine takes the prefixes and operands
+ * of each instruction from the block instead of reading them over the bus again.
+ *
+ * Every 16K page has a write generation, bumped whenever a byte in the page is
+ * changed or the flash is programmed. A block decoded under an older generation
+ * is decoded again the next time it is reached.
+ */
+class BlockCache {
+    public:
+        static const int PAGES = 64;                // 512K of ROM then 512K of RAM
+        static const int PAGE_SIZE = 1 << 14;
+        static const int MAX_INSTRUCTIONS = 32;
+        static const int MAX_LENGTH = 4;
+
+        struct Instruction {
+            uint8_t length;
+            uint8_t code[MAX_LENGTH];               // Opcode, prefixes and operands
+        };
+
+        struct Block {
+            uint32_t    generation = 0;
+            int         count = -1;                 // -1 until decoded
+            Instruction instructions[MAX_INSTRUCTIONS];
+        };
+
+        /* A byte in the page holding this physical address was changed */
+        void written(uint32_t address) {
+            generations[(address >> 14) & (PAGES-1)]++;
+        }
+
+        /* Memory may have changed anywhere, e.g. loaded from a file or erased */
+        void invalidate() {
+            for( int i=0; i<PAGES; i++ ) {
+                generations[i]++;
+            }
+        }
+
+        /* Instruction at the physical address, or nullptr if it can't be cached. page is the host copy of its 16K page */
+        const Instruction* find(uint32_t address, const uint8_t *page) {
+            uint32_t generation = generations[(address >> 14) & (PAGES-1)];
+
+            // Usually the instruction after the last one found
+            if( current && address == next && index < current->count && current->generation == generation ) {
+                return advance();
+            }
+
+            Block &block = blocks[address];
+            if( block.count < 0 || block.generation != generation ) {
+                decode(block, page, address & (PAGE_SIZE-1));
+                block.generation = generation;
+            }
+            if( block.count == 0 ) {
+                current = nullptr;
+                return nullptr;
+            }
+            current = &block;
+            index = 0;
+            next = address;
+            return advance();
+        }
+
+    private:
+        std::unordered_map<uint32_t, Block> blocks;
+        uint32_t generations[PAGES] = {0};
+
+        Block    *current = nullptr;
+        int      index = 0;
+        uint32_t next = 0;
+
+        const Instruction* advance() {
+            const Instruction *instruction = &current->instructions[index++];
+            next += instruction->length;
+            return instruction;
+        }
+
+        static void decode(Block &block, const uint8_t *page, uint32_t offset) {
+            block.count = 0;
+            while( block.count < MAX_INSTRUCTIONS && offset + MAX_LENGTH <= PAGE_SIZE ) {
+                const uint8_t *code = page + offset;
+                int length = instructionLength(code);
+                if( length == 0 ) {
+                    break;
+                }
+                Instruction &instruction = block.instructions[block.count++];
+                instruction.length = length;
+                memcpy(instruction.code, code, MAX_LENGTH);
+                if( endsBlock(code) ) {
+                    break;
+                }
+                offset += length;
+            }
+        }
+
+        // Bytes in the instruction, or 0 for chains of prefixes, which are left to the bus
+        static int instructionLength(const uint8_t *code) {
+            uint8_t op = code[0];
+            if( op == 0xCB ) {
+                return 2;
+            }
+            if( op == 0xED ) {
+                // LD (nn),rr and LD rr,(nn)
+                return (code[1] & 0xC7) == 0x43 ? 4 : 2;
+            }
+            if( op == 0xDD || op == 0xFD ) {
+                op = code[1];
+                if( op == 0xDD || op == 0xFD || op == 0xED ) {
+                    return 0;
+                }
+                if( op == 0xCB ) {
+                    return 4;
+                }
+                return 2 + operandBytes(op) + (displaced(op) ? 1 : 0);
+            }
+            return 1 + operandBytes(op);
+        }
+
+        // Immediate bytes after an unprefixed opcode
+        static int operandBytes(uint8_t op) {
+            if( op < 0x40 ) {
+                switch( op & 0x07 ) {
+                    case 0: return op >= 0x10 ? 1 : 0;                // DJNZ, JR
+                    case 1: return (op & 0x08) ? 0 : 2;               // LD rr,nn
+                    case 2: return op >= 0x20 ? 2 : 0;                // LD (nn),HL/A and LD HL/A,(nn)
+                    case 6: return 1;                                 // LD r,n
+                    default: return 0;
+                }
+            }
+            if( op >= 0xC0 ) {
+                switch( op & 0x07 ) {
+                    case 2: case 4: return 2;                         // JP cc, CALL cc
+                    case 3: return op == 0xC3 ? 2 : (op == 0xD3 || op == 0xDB) ? 1 : 0;
+                    case 5: return op == 0xCD ? 2 : 0;
+                    case 6: return 1;                                 // ALU A,n
+                    default: return 0;
+                }
+            }
+            return 0;
+        }
+
+        // Opcodes that take a displacement when they address (IX+d) or (IY+d)
+        static bool displaced(uint8_t op) {
+            if( op == 0x34 || op == 0x35 || op == 0x36 ) {
+                return true;
+            }
+            if( op >= 0x40 && op < 0x80 ) {
+                return op != 0x76 && ((op & 0x07) == 6 || (op & 0x38) == 0x30);
+            }
+            return (op & 0xC7) == 0x86;
+        }
+
+        static bool endsBlock(const uint8_t *code) {
+            uint8_t op = code[0];
+            if( op == 0xED ) {
+                // RETN, RETI and the repeating block instructions
+                return (code[1] & 0xC7) == 0x45 || (code[1] & 0xF4) == 0xB0;
+            }
+            if( op == 0xDD || op == 0xFD ) {
+                return code[1] == 0xE9;
+            }
+            if( op < 0x40 ) {
+                return (op & 0xC7) == 0x00 && op >= 0x10;             // DJNZ, JR
+            }
+            if( op < 0xC0 ) {
+                return op == 0x76;
+            }
+            switch( op & 0x07 ) {
+                case 0: case 2: case 4: case 7: return true;          // RET cc, JP cc, CALL cc, RST
+                case 1: return op == 0xC9 || op == 0xE9;              // RET, JP (HL)
+                case 3: return op == 0xC3;
+                case 5: return op == 0xCD;
+                default: return false;
+            }
+        }
+};
@@ -0,0 +1,41 @@
+#pragma once
+#include <stdint.h>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+/**
+ * bootcache.hpp - Names the saved state of a machine that has already booted
+ *
+ * Booting the firmware takes a few seconds of emulated time, the same every launch
+ * given the same images in memory. Everything the boot depends on is hashed into a
+ * key: the images as loaded, the emulator version and the settings that change how
+ * it runs. The state saved when the boot reaches its ready point is kept under that
+ * key, and later launches with the same key restore it instead of booting.
+ */
+class BootCache {
+    public:
+        /* Fold more of what the boot depends on into the key */
+        void add(const void *data, size_t length) {
+            const uint8_t *bytes = (const uint8_t *)data;
+            for( size_t i=0; i<length; i++ ) {
+                hash = (hash ^ bytes[i]) * FNV_PRIME;
+            }
+        }
+
+        template <typename T> void add(const T &value) {
+            add(&value, sizeof(T));
+        }
+
+        /* Where the state for this key is kept in the directory */
+        std::string path(const std::string &directory) const {
+            char name[32];
+            snprintf(name, sizeof(name), "boot-%016llx.sav", (unsigned long long)hash);
+            return directory + "/" + name;
+        }
+
+    private:
+        // 64 bit FNV-1a
+        static const uint64_t FNV_PRIME = 0x100000001b3ULL;
+        uint64_t hash = 0xcbf29ce484222325ULL;
+};
@@ -0,0 +1,158 @@
+#pragma once
+#include <stdint.h>
+#include <cstring>
+#include "z80.h"
+
+/**
+ * busywait.hpp - Spots the guest spinning in a loop that cannot make progress
+ *
+ * Firmware waits for input by polling the keyboard rows or the UART line status
+ * in a tight loop. A backward jump marks a possible loop head; if the CPU comes
+ * round to it again with the same registers, after reading the same input values
+ * and writing nothing new to memory, every further pass will be the same until a
+ * device changes. The run loop can then skip ahead to the next device event.
+ */
+class BusyWait {
+    public:
+        static const int      MAX_INSTRUCTIONS = 32;
+        static const int      MAX_INPUTS = 8;
+        static const uint64_t MAX_CYCLES = 1024;
+
+        // Passes that must repeat unchanged before skipping
+        static const int      REPEATS = 2;
+
+        /* Forget any loop being tracked, e.g. after memory was changed from outside */
+        void reset() {
+            active = false;
+            lastPC = 0;
+        }
+
+        /* The current pass did something that can't be repeated safely */
+        void taint() {
+            tainted = true;
+        }
+
+        /* Value read from an input port during the current pass */
+        void input(uint8_t value) {
+            if( inputCount < MAX_INPUTS ) {
+                inputs[inputCount++] = value;
+            }
+            else {
+                tainted = true;
+            }
+        }
+
+        /* Call at each instruction boundary. Returns true at the head of a loop that has repeated unchanged */
+        bool boundary(uint16_t pc, const z80_t &cpu, uint64_t tickCount) {
+            if( active ) {
+                if( pc == head ) {
+                    return loopedBack(cpu, tickCount);
+                }
+                if( tickCount - headTick <= MAX_CYCLES ) {
+                    if( length < MAX_INSTRUCTIONS ) {
+                        trace[length++] = pc;
+                    }
+                    else {
+                        tainted = true;
+                    }
+                    lastPC = pc;
+                    return false;
+                }
+                active = false;
+            }
+            if( pc < lastPC ) {
+                start(pc, cpu, tickCount);
+            }
+            lastPC = pc;
+            return false;
+        }
+
+        /* Passes were skipped from the loop head, so time the next one from here */
+        void skipped(const z80_t &cpu, uint64_t tickCount) {
+            mark(cpu, tickCount);
+        }
+
+        /* The pass just completed, valid until the next call to boundary() */
+        uint64_t passCycles() const {
+            return cycles;
+        }
+
+        /* Increments to the refresh register in one pass */
+        uint8_t passRefresh() const {
+            return refresh;
+        }
+
+        /* Instruction addresses in one pass, in the order they would appear in the history */
+        const uint16_t* passTrace() const {
+            return trace;
+        }
+
+        int passLength() const {
+            return traceLength;
+        }
+
+    private:
+        void start(uint16_t pc, const z80_t &cpu, uint64_t tickCount) {
+            active = true;
+            head = pc;
+            repeats = 0;
+            lastInputCount = -1;
+            mark(cpu, tickCount);
+        }
+
+        bool loopedBack(const z80_t &cpu, uint64_t tickCount) {
+            bool repeated = !tainted && sameRegisters(cpu) && inputCount == lastInputCount &&
+                            memcmp(inputs, lastInputs, inputCount) == 0;
+            repeats = repeated ? repeats+1 : 0;
+
+            trace[length++] = head;
+            traceLength = length;
+            cycles = tickCount - headTick;
+            refresh = (cpu.r - headState.r) & 0x7F;
+
+            memcpy(lastInputs, inputs, inputCount);
+            lastInputCount = inputCount;
+            mark(cpu, tickCount);
+
+            return repeats >= REPEATS;
+        }
+
+        // Start a new pass from the loop head
+        void mark(const z80_t &cpu, uint64_t tickCount) {
+            headState = cpu;
+            headTick = tickCount;
+            tainted = false;
+            inputCount = 0;
+            length = 0;
+        }
+
+        // Everything but the refresh register, which counts up on every pass
+        bool sameRegisters(const z80_t &cpu) const {
+            return cpu.pc == headState.pc && cpu.af == headState.af && cpu.bc == headState.bc &&
+                   cpu.de == headState.de && cpu.hl == headState.hl && cpu.ix == headState.ix &&
+                   cpu.iy == headState.iy && cpu.wz == headState.wz && cpu.sp == headState.sp &&
+                   cpu.i == headState.i && cpu.af2 == headState.af2 && cpu.bc2 == headState.bc2 &&
+                   cpu.de2 == headState.de2 && cpu.hl2 == headState.hl2 && cpu.im == headState.im &&
+                   cpu.iff1 == headState.iff1 && cpu.iff2 == headState.iff2 &&
+                   cpu.int_bits == headState.int_bits;
+        }
+
+        bool     active = false;
+        uint16_t head = 0;
+        uint16_t lastPC = 0;
+        z80_t    headState;
+        uint64_t headTick = 0;
+        int      repeats = 0;
+        bool     tainted = false;
+
+        uint8_t  inputs[MAX_INPUTS];
+        int      inputCount = 0;
+        uint8_t  lastInputs[MAX_INPUTS];
+        int      lastInputCount = -1;
+
+        uint16_t trace[MAX_INSTRUCTIONS+1];
+        int      length = 0;
+        int      traceLength = 0;
+        uint64_t cycles = 0;
+        uint8_t  refresh = 0;
+};
@@ -0,0 +1,5 @@
+// The chips emulated in header files, built once here for everything that uses them
+#define CHIPS_IMPL
+#include "z80.h"
+#include "z80pio.h"
+#include "uart16c550.h"
@@ -1,41 +1,22 @@
 #pragma once
-#include <set>
-#include <vector>
-#include "SDL.h"
-#include "SDL_ttf.h"
-#include "SDL2_gfxPrimitives.h"
+#include <cstdint>
 
+/* One of the 24 alphanumeric LEDs, as the I2C display drivers light it. DigitView draws one */
 class Digit {
-    private:
-        SDL_Texture   *digitTexture;
-        float zoom;
-        
+    public:
         const static int SEGMENTS = 15;
 
+    private:
         short segmentFlags;
         short brightness[SEGMENTS];
 
-        
-
-        std::vector<short> DISPLAY_SEGMENTS_X[SEGMENTS];
-        std::vector<short> DISPLAY_SEGMENTS_Y[SEGMENTS];
-
-        void createSegments();
-        void addTo(std::vector<short>&v, int offset, std::initializer_list<int> list);
-        
-        void refresh(SDL_Renderer *renderer);
-
-        
     public: 
-        const static int DIGIT_WIDTH = 32;
-        const static int DIGIT_HEIGHT = 64;
-
-        Digit(SDL_Renderer *sdlRenderer, float zoom);
-
-        void onDraw(SDL_Renderer *renderer, int x, int y);
+        Digit();
 
         void setSegments( uint16_t segmentMask );
+        uint16_t getSegments();
         void setBrightness( int segment, uint8_t brightness);
+        uint8_t getBrightness( int segment );
 
         bool changed = true;
-};
\ No newline at end of file
+};
@@ -0,0 +1,30 @@
+#pragma once
+#include <vector>
+#include "SDL.h"
+#include "SDL_ttf.h"
+#include "SDL2_gfxPrimitives.h"
+
+#include "digit.hpp"
+
+/* A digit as the UI last drew it, redrawn into its own texture when it changes */
+class DigitView: public Digit {
+    private:
+        SDL_Texture   *digitTexture;
+        float zoom;
+
+        std::vector<short> DISPLAY_SEGMENTS_X[SEGMENTS];
+        std::vector<short> DISPLAY_SEGMENTS_Y[SEGMENTS];
+
+        void createSegments();
+        void addTo(std::vector<short>&v, int offset, std::initializer_list<int> list);
+        
+        void refresh(SDL_Renderer *renderer);
+
+    public: 
+        const static int DIGIT_WIDTH = 32;
+        const static int DIGIT_HEIGHT = 64;
+
+        DigitView(SDL_Renderer *sdlRenderer, float zoom);
+
+        void onDraw(SDL_Renderer *renderer, int x, int y);
+};
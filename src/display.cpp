@@ -1,4 +1,5 @@
 #include "display.hpp"
+#include "savestate.hpp"
 #include <iostream>
 
 
@@ -118,4 +119,28 @@ uint8_t I2cDisplay::readNext() {
     uint8_t result = 0;
     currentAddress++;
     return result;
-}
\ No newline at end of file
+}
+
+void I2cDisplay::save(StateWriter &out) const {
+    out.value(byteCount);
+    out.value(currentAddress);
+    out.value(commandUnlocked);
+    out.value(currentPage);
+    out.value(interruptMask);
+    out.bytes(page_0, sizeof(page_0));
+    out.bytes(page_1, sizeof(page_1));
+    out.bytes(page_2, sizeof(page_2));
+    out.bytes(page_3, sizeof(page_3));
+}
+
+void I2cDisplay::load(StateReader &in) {
+    in.value(byteCount);
+    in.value(currentAddress);
+    in.value(commandUnlocked);
+    in.value(currentPage);
+    in.value(interruptMask);
+    in.bytes(page_0, sizeof(page_0));
+    in.bytes(page_1, sizeof(page_1));
+    in.bytes(page_2, sizeof(page_2));
+    in.bytes(page_3, sizeof(page_3));
+}
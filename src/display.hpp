@@ -1,6 +1,6 @@
 #pragma once
 
-#include <SDL.h>
+#include <vector>
 #include "i2c.hpp"
 #include "digit.hpp"
 
@@ -16,6 +16,10 @@ class I2cDisplay: public I2cDevice {
         virtual uint8_t readNext();
         virtual void    write(uint8_t value);
         virtual void    stop();
+
+        // Registers only, the digits are saved with the rest of the machine
+        void save(StateWriter &out) const;
+        void load(StateReader &in);
     private:
         uint8_t address;
         uint16_t byteCount = 0;
@@ -0,0 +1,81 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+/**
+ * emuthread.hpp - Lock-free channels between the UI thread and the emulation thread
+ *
+ * SpscQueue carries commands (key presses) one way, from a single
+ * producer to a single consumer. SnapshotBuffer hands the latest machine state
+ * the other way: the emulation thread fills the back buffer and publishes it,
+ * the UI thread picks up whichever frame is newest, and neither ever waits
+ * on the other.
+ */
+template <typename T, size_t N>
+class SpscQueue {
+    static_assert((N & (N-1)) == 0, "Queue size must be a power of 2");
+
+    public:
+        /* Returns false if the queue is full */
+        bool push(const T& item) {
+            size_t tail = tailIndex.load(std::memory_order_relaxed);
+            if( tail - headIndex.load(std::memory_order_acquire) == N ) {
+                return false;
+            }
+            items[tail & (N-1)] = item;
+            tailIndex.store(tail+1, std::memory_order_release);
+            return true;
+        }
+
+        /* Returns false if the queue is empty */
+        bool pop(T& item) {
+            size_t head = headIndex.load(std::memory_order_relaxed);
+            if( head == tailIndex.load(std::memory_order_acquire) ) {
+                return false;
+            }
+            item = items[head & (N-1)];
+            headIndex.store(head+1, std::memory_order_release);
+            return true;
+        }
+
+    private:
+        T items[N];
+        std::atomic<size_t> headIndex {0};
+        std::atomic<size_t> tailIndex {0};
+};
+
+template <typename T>
+class SnapshotBuffer {
+    public:
+        /* Buffer owned by the writer, to be filled before publish() */
+        T& back() {
+            return buffers[writeIndex];
+        }
+
+        /* Make the back buffer the newest snapshot */
+        void publish() {
+            writeIndex = spareIndex.exchange(writeIndex | FRESH, std::memory_order_acq_rel) & ~FRESH;
+        }
+
+        /* Take the newest snapshot, if one was published since the last call */
+        bool update() {
+            if( (spareIndex.load(std::memory_order_relaxed) & FRESH) == 0 ) {
+                return false;
+            }
+            readIndex = spareIndex.exchange(readIndex, std::memory_order_acq_rel) & ~FRESH;
+            return true;
+        }
+
+        /* Buffer owned by the reader */
+        const T& front() const {
+            return buffers[readIndex];
+        }
+
+    private:
+        static const int FRESH = 4;
+
+        T buffers[3];
+        int writeIndex = 0;
+        int readIndex = 1;
+        std::atomic<int> spareIndex {2};
+};
@@ -0,0 +1,167 @@
+#include "fanout.hpp"
+#include "machine.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+bool FanOut::load(const char *filename) {
+    std::ifstream in(filename);
+    if( !in ) {
+        std::cout << "Could not open scenarios " << filename << std::endl;
+        return false;
+    }
+
+    std::string line;
+    for( int lineNumber = 1; std::getline(in, line); lineNumber++ ) {
+        if( !line.empty() && line.back() == '\r' ) {
+            line.pop_back();
+        }
+        size_t first = line.find_first_not_of(" \t");
+        if( first == std::string::npos || line[first] == '#' ) {
+            continue;
+        }
+        Scenario scenario;
+        size_t uartAt = line.find("uart=");
+        if( uartAt != std::string::npos ) {
+            if( !unescape(line.substr(uartAt + 5), scenario.uart) ) {
+                std::cout << filename << ":" << lineNumber << ": bad escape in uart text" << std::endl;
+                return false;
+            }
+            line.erase(uartAt);
+        }
+
+        std::istringstream fields(line);
+        std::string cycles;
+        fields >> scenario.name;
+        char *end = nullptr;
+        if( !(fields >> cycles) || (scenario.cycles = strtoull(cycles.c_str(), &end, 10)) == 0 || *end ) {
+            std::cout << filename << ":" << lineNumber << ": expected a number of cycles after the name" << std::endl;
+            return false;
+        }
+
+        std::string option;
+        while( fields >> option ) {
+            if( option.rfind("break=", 0) == 0 ) {
+                scenario.breakpoint = strtoul(option.c_str() + 6, &end, 16);
+                if( option.size() == 6 || *end || scenario.breakpoint > 0xFFFF ) {
+                    std::cout << filename << ":" << lineNumber << ": bad breakpoint " << option << std::endl;
+                    return false;
+                }
+            }
+            else if( option.rfind("journal=", 0) == 0 && option.size() > 8 ) {
+                scenario.journalFile = option.substr(8);
+            }
+            else {
+                std::cout << filename << ":" << lineNumber << ": unknown option " << option << std::endl;
+                return false;
+            }
+        }
+        scenarios.push_back(scenario);
+    }
+
+    if( scenarios.empty() ) {
+        std::cout << "No scenarios in " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Machines are made one at a time, since setting one up isn't safe alongside
+// another, but each then runs on its own
+void FanOut::run(Machine &from, int threads) {
+    if( threads <= 0 ) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = std::min((size_t)threads, scenarios.size());
+    results.assign(scenarios.size(), ScenarioResult());
+
+    std::atomic<size_t> next{0};
+    std::mutex          spawning;
+    auto worker = [&]() {
+        for( size_t index; (index = next++) < scenarios.size(); ) {
+            std::unique_ptr<Machine> machine;
+            {
+                std::lock_guard<std::mutex> lock(spawning);
+                machine.reset(from.spawn());
+            }
+            machine->runScenario(scenarios[index], results[index]);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for( int i=0; i<threads; i++ ) {
+        workers.emplace_back(worker);
+    }
+    for( std::thread &thread : workers ) {
+        thread.join();
+    }
+}
+
+void FanOut::report(std::ostream &out) const {
+    for( size_t i=0; i<results.size(); i++ ) {
+        const ScenarioResult &result = results[i];
+        out << scenarios[i].name << ": stopped (" << result.stop << ") after " << result.cycles << " cycles at PC "
+            << std::hex << std::uppercase << std::setfill('0') << std::setw(4) << result.pc
+            << std::dec << std::setfill(' ') << std::endl;
+        out << "  uart \"" << escape(result.uart) << "\"" << std::endl;
+    }
+}
+
+bool FanOut::unescape(const std::string &text, std::string &bytes) {
+    for( size_t i=0; i<text.size(); i++ ) {
+        if( text[i] != '\\' ) {
+            bytes += text[i];
+            continue;
+        }
+        if( ++i == text.size() ) {
+            return false;
+        }
+        switch( text[i] ) {
+            case 'r':  bytes += '\r'; break;
+            case 'n':  bytes += '\n'; break;
+            case 't':  bytes += '\t'; break;
+            case '\\': bytes += '\\'; break;
+            case 'x': {
+                if( i + 2 >= text.size() || !isxdigit(text[i+1]) || !isxdigit(text[i+2]) ) {
+                    return false;
+                }
+                bytes += (char)strtoul(text.substr(i+1, 2).c_str(), nullptr, 16);
+                i += 2;
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+std::string FanOut::escape(const std::string &bytes) {
+    std::ostringstream out;
+    for( char c : bytes ) {
+        switch( c ) {
+            case '\r': out << "\\r"; break;
+            case '\n': out << "\\n"; break;
+            case '\t': out << "\\t"; break;
+            case '\\': out << "\\\\"; break;
+            case '"':  out << "\\\""; break;
+            default:
+                if( (uint8_t)c < 0x20 || (uint8_t)c >= 0x7F ) {
+                    out << "\\x" << std::hex << std::uppercase << std::setfill('0') << std::setw(2) << (int)(uint8_t)c;
+                }
+                else {
+                    out << c;
+                }
+        }
+    }
+    return out.str();
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <stdint.h>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class Machine;
+
+/**
+ * fanout.hpp - Many runs from the same machine state at once, each with its own inputs
+ *
+ * Each run, or scenario, gets a machine of its own on a worker thread. They all start
+ * as copies of one machine, usually restored from a saved state, and share its ROM
+ * until they program the flash. What each sends out of its UART is captured, and
+ * reported with where it stopped.
+ *
+ * A scenario file has a line for each run: a name, the most cycles to run for, then
+ *
+ *   break=<address>    Stop here, in hex
+ *   journal=<file>     Inputs recorded with --record from the same state
+ *   uart=<text>        Bytes received by the UART at the start. This takes the rest of
+ *                      the line, with \r \n \t \\ and \xHH escapes
+ *
+ * Blank lines and lines starting with # are skipped.
+ */
+struct Scenario {
+    static const uint32_t NO_BREAKPOINT = UINT32_MAX;
+
+    std::string name;
+    uint64_t    cycles = 0;
+    uint32_t    breakpoint = NO_BREAKPOINT;
+    std::string journalFile;
+    std::string uart;
+};
+
+struct ScenarioResult {
+    std::string stop;           // "breakpoint", "watchpoint", "cycles", or why it couldn't start
+    uint64_t    cycles = 0;     // How many it ran for
+    uint16_t    pc = 0;
+    std::string uart;           // Everything sent out of the UART
+};
+
+class FanOut {
+    public:
+        /* Read scenarios from a file, as above */
+        bool load(const char *filename);
+
+        /* Run every scenario from this machine, at most this many at once, 0 for one per core */
+        void run(Machine &from, int threads);
+
+        /* Each scenario's result, in the order they were in the file */
+        void report(std::ostream &out) const;
+
+        size_t size() const {
+            return scenarios.size();
+        }
+
+    private:
+        std::vector<Scenario>       scenarios;
+        std::vector<ScenarioResult> results;
+
+        static bool        unescape(const std::string &text, std::string &bytes);
+        static std::string escape(const std::string &bytes);
+};
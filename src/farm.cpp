@@ -0,0 +1,185 @@
+#include "farm.hpp"
+#include "machine.hpp"
+#include "listing.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+bool Farm::load(const char *filename) {
+    std::ifstream in(filename);
+    if( !in ) {
+        std::cout << "Could not open manifest " << filename << std::endl;
+        return false;
+    }
+    std::filesystem::path directory = std::filesystem::path(filename).parent_path();
+
+    // Most tests in a suite share their listings, which only need parsing once
+    std::map<std::string, std::unique_ptr<Listing>> listings;
+
+    std::string line;
+    for( int lineNumber = 1; std::getline(in, line); lineNumber++ ) {
+        if( !line.empty() && line.back() == '\r' ) {
+            line.pop_back();
+        }
+        size_t first = line.find_first_not_of(" \t");
+        if( first == std::string::npos || line[first] == '#' ) {
+            continue;
+        }
+
+        std::istringstream fields(line);
+        std::string name, cycles;
+        fields >> name;
+        char *end = nullptr;
+        uint64_t budget = 0;
+        if( !(fields >> cycles) || (budget = strtoull(cycles.c_str(), &end, 10)) == 0 || *end ) {
+            std::cout << filename << ":" << lineNumber << ": expected a number of cycles after the name" << std::endl;
+            return false;
+        }
+
+        FarmTask task;
+        task.test.setName(name);
+        task.test.setCycleBudget(budget);
+
+        std::vector<std::pair<std::string, bool>> conditions;
+        std::vector<std::pair<std::string, int>>  listingFiles;
+        std::string option;
+        while( fields >> option ) {
+            size_t equals = option.find('=');
+            std::string key = option.substr(0, equals);
+            std::string value = equals == std::string::npos ? "" : option.substr(equals + 1);
+            if( (key == "pass" || key == "fail") && !value.empty() ) {
+                conditions.push_back({value, key == "pass"});
+            }
+            else if( key == "binary" || key == "listing" ) {
+                unsigned long prefix = 0;
+                std::string file;
+                splitPrefix(value, prefix, file);
+                if( file.empty() ) {
+                    std::cout << filename << ":" << lineNumber << ": bad " << option << std::endl;
+                    return false;
+                }
+                std::string path = (directory / file).string();
+                if( !std::ifstream(path).good() ) {
+                    std::cout << filename << ":" << lineNumber << ": no file " << path << std::endl;
+                    return false;
+                }
+                if( key == "binary" ) {
+                    task.binaries.push_back(BinaryFile(path, prefix, false));
+                }
+                else {
+                    listingFiles.push_back({path, (int)prefix});
+                }
+            }
+            else {
+                std::cout << filename << ":" << lineNumber << ": unknown option " << option << std::endl;
+                return false;
+            }
+        }
+
+        std::string key;
+        for( auto &file : listingFiles ) {
+            key += std::to_string(file.second) + ":" + file.first + "\n";
+        }
+        std::unique_ptr<Listing> &listing = listings[key];
+        if( !listing ) {
+            listing.reset(new Listing());
+            for( auto &file : listingFiles ) {
+                if( listing->addFile(file.first, file.second, false) < 0 ) {
+                    std::cout << filename << ":" << lineNumber << ": not a listing " << file.first << std::endl;
+                    return false;
+                }
+            }
+            for( auto &source : listing->getFiles() ) {
+                listing->loadFile(source);
+            }
+        }
+        for( auto &condition : conditions ) {
+            if( !task.test.addCondition(condition.first, condition.second, *listing) ) {
+                std::cout << filename << ":" << lineNumber << ": in test " << name << std::endl;
+                return false;
+            }
+        }
+        tasks.push_back(task);
+    }
+
+    if( tasks.empty() ) {
+        std::cout << "No tests in " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// An optional hex prefix before a colon, as on -f and -l
+void Farm::splitPrefix(const std::string &text, unsigned long &prefix, std::string &rest) {
+    size_t colon = text.find(':');
+    if( colon == std::string::npos || colon == 0 ||
+        !std::all_of(text.begin(), text.begin() + colon, [](char c) { return isxdigit(c); }) ) {
+        prefix = 0;
+        rest = text;
+        return;
+    }
+    prefix = strtoul(text.substr(0, colon).c_str(), nullptr, 16);
+    rest = text.substr(colon + 1);
+}
+
+// As for FanOut, machines are made one at a time, then each test runs on its own.
+// Workers take the next test as they finish one, so a long test doesn't hold up the rest
+void Farm::run(Machine &from, int threads) {
+    if( threads <= 0 ) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = std::min((size_t)threads, tasks.size());
+
+    std::atomic<size_t> next{0};
+    std::mutex          spawning;
+    auto worker = [&]() {
+        for( size_t index; (index = next++) < tasks.size(); ) {
+            FarmTask &task = tasks[index];
+            std::unique_ptr<Machine> machine;
+            {
+                std::lock_guard<std::mutex> lock(spawning);
+                machine.reset(from.spawn());
+            }
+            for( BinaryFile &binary : task.binaries ) {
+                machine->loadBinary(binary);
+            }
+            task.test.run(*machine);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for( int i=0; i<threads; i++ ) {
+        workers.emplace_back(worker);
+    }
+    for( std::thread &thread : workers ) {
+        thread.join();
+    }
+}
+
+void Farm::report(std::ostream &out) const {
+    for( const FarmTask &task : tasks ) {
+        task.test.report(out);
+    }
+}
+
+bool Farm::writeReport(const char *filename) const {
+    std::vector<const TestRunner *> tests;
+    for( const FarmTask &task : tasks ) {
+        tests.push_back(&task.test);
+    }
+    return TestRunner::writeReport(filename, tests);
+}
+
+size_t Farm::passed() const {
+    return std::count_if(tasks.begin(), tasks.end(), [](const FarmTask &task) { return task.test.isPassed(); });
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <stdint.h>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "binaryFile.hpp"
+#include "testrunner.hpp"
+
+class Machine;
+
+/**
+ * farm.hpp - A suite of test programs, run across every core at once
+ *
+ * Each test gets a machine of its own on a worker thread, spawned from one that has
+ * only its ROM loaded. They share that ROM unless a test loads something into it.
+ * The tests are those of --pass and --fail, see testrunner.hpp.
+ *
+ * A manifest has a line for each test: a name, the most cycles to run for, then
+ *
+ *   binary=[<address>:]<file>    Load this file at this physical address in hex, default 0
+ *   listing=[<page>:]<file>      Labels for the conditions, in this page in hex, default 0
+ *   pass=<condition>             The test passes when this is met
+ *   fail=<condition>             The test fails when this is met
+ *
+ * Each can be given more than once. Files are relative to the manifest. Blank lines
+ * and lines starting with # are skipped.
+ */
+struct FarmTask {
+    std::vector<BinaryFile> binaries;
+    TestRunner              test;
+};
+
+class Farm {
+    public:
+        /* Read the tests from a manifest, as above, and look up their labels */
+        bool load(const char *filename);
+
+        /* Run every test from this machine, at most this many at once, 0 for one per core */
+        void run(Machine &from, int threads);
+
+        /* Each test's result, in the order they were in the manifest */
+        void report(std::ostream &out) const;
+
+        /* All the results, as for --report */
+        bool writeReport(const char *filename) const;
+
+        size_t size() const {
+            return tasks.size();
+        }
+
+        size_t passed() const;
+
+    private:
+        std::vector<FarmTask> tasks;
+
+        static void splitPrefix(const std::string &text, unsigned long &prefix, std::string &rest);
+};
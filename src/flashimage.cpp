@@ -0,0 +1,181 @@
+#include "flashimage.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+FlashImage::~FlashImage() {
+    close();
+}
+
+void FlashImage::allWritten() {
+    if( memory ) {
+        std::fill(dirty.begin(), dirty.end(), true);
+        anyDirty = true;
+    }
+}
+
+#ifdef _WIN32
+
+bool FlashImage::open(const char *filename, size_t length) {
+    close();
+    HANDLE handle = CreateFileA(filename, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS,
+                                FILE_ATTRIBUTE_NORMAL, NULL);
+    if( handle == INVALID_HANDLE_VALUE ) {
+        std::cout << "Could not open flash image " << filename << std::endl;
+        return false;
+    }
+    LARGE_INTEGER size;
+    if( !GetFileSizeEx(handle, &size) ) {
+        std::cout << "Could not open flash image " << filename << std::endl;
+        CloseHandle(handle);
+        return false;
+    }
+    // Mapping a new, empty file makes it the full length
+    created = size.QuadPart == 0;
+    if( !created && (size_t)size.QuadPart != length ) {
+        std::cout << filename << " is not a " << (length >> 10) << "K flash image" << std::endl;
+        CloseHandle(handle);
+        return false;
+    }
+
+    HANDLE view = CreateFileMappingA(handle, NULL, PAGE_READWRITE, 0, (DWORD)length, NULL);
+    void *mapped = view ? MapViewOfFile(view, FILE_MAP_ALL_ACCESS, 0, 0, length) : nullptr;
+    if( !mapped ) {
+        std::cout << "Could not map flash image " << filename << std::endl;
+        if( view ) {
+            CloseHandle(view);
+        }
+        CloseHandle(handle);
+        return false;
+    }
+
+    file = handle;
+    mapping = view;
+    memory = (uint8_t *)mapped;
+    this->length = length;
+    dirty.assign((length + SECTOR_SIZE - 1) / SECTOR_SIZE, false);
+    if( created ) {
+        memset(memory, 0xFF, length);
+        allWritten();
+    }
+    return true;
+}
+
+void FlashImage::sync() {
+    if( !anyDirty ) {
+        return;
+    }
+    for( size_t sector = 0; sector < dirty.size(); sector++ ) {
+        if( dirty[sector] ) {
+            FlushViewOfFile(memory + sector * SECTOR_SIZE, SECTOR_SIZE);
+            dirty[sector] = false;
+        }
+    }
+    anyDirty = false;
+}
+
+void FlashImage::close() {
+    if( !memory ) {
+        return;
+    }
+    sync();
+    UnmapViewOfFile(memory);
+    CloseHandle((HANDLE)mapping);
+    FlushFileBuffers((HANDLE)file);
+    CloseHandle((HANDLE)file);
+    memory = nullptr;
+}
+
+#else
+
+bool FlashImage::open(const char *filename, size_t length) {
+    close();
+    int fd = ::open(filename, O_RDWR | O_CREAT, 0644);
+    if( fd < 0 ) {
+        std::cout << "Could not open flash image " << filename << std::endl;
+        return false;
+    }
+
+    struct stat status;
+    if( fstat(fd, &status) != 0 ) {
+        std::cout << "Could not open flash image " << filename << std::endl;
+        ::close(fd);
+        return false;
+    }
+    created = status.st_size == 0;
+    if( created && ftruncate(fd, length) != 0 ) {
+        std::cout << "Could not create flash image " << filename << std::endl;
+        ::close(fd);
+        return false;
+    }
+    if( !created && (size_t)status.st_size != length ) {
+        std::cout << filename << " is not a " << (length >> 10) << "K flash image" << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    void *mapped = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if( mapped == MAP_FAILED ) {
+        std::cout << "Could not map flash image " << filename << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    file = fd;
+    memory = (uint8_t *)mapped;
+    this->length = length;
+    dirty.assign((length + SECTOR_SIZE - 1) / SECTOR_SIZE, false);
+    if( created ) {
+        memset(memory, 0xFF, length);
+        allWritten();
+    }
+    return true;
+}
+
+// Runs of dirty sectors go back in one call each. msync wants whole host pages,
+// which can be bigger than a sector.
+void FlashImage::sync() {
+    if( !anyDirty ) {
+        return;
+    }
+    size_t page = sysconf(_SC_PAGESIZE);
+    for( size_t sector = 0; sector < dirty.size(); ) {
+        if( !dirty[sector] ) {
+            sector++;
+            continue;
+        }
+        size_t first = sector;
+        while( sector < dirty.size() && dirty[sector] ) {
+            dirty[sector++] = false;
+        }
+        size_t start = (first * SECTOR_SIZE) / page * page;
+        size_t end = std::min(sector * SECTOR_SIZE, length);
+        msync(memory + start, end - start, MS_ASYNC);
+    }
+    anyDirty = false;
+}
+
+void FlashImage::close() {
+    if( !memory ) {
+        return;
+    }
+    sync();
+    msync(memory, length, MS_SYNC);
+    munmap(memory, length);
+    ::close(file);
+    file = -1;
+    memory = nullptr;
+}
+
+#endif
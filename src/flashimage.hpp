@@ -0,0 +1,67 @@
+#pragma once
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+/**
+ * flashimage.hpp - The flash ROM kept in a file, so programming it survives a restart
+ *
+ * The file is mapped into memory and used as the ROM itself, so byte programs and
+ * erases land in the file as the CPU makes them. Each write path marks the 4K sector
+ * it changed, and sync() asks the OS to write back just those sectors, rather than
+ * the whole image on every change.
+ *
+ * A new file starts out erased, all 0xFF, as a new chip would.
+ */
+class FlashImage {
+    public:
+        static const uint32_t SECTOR_SIZE = 0x1000;
+
+        /* Map the file, creating it if there isn't one. It must be exactly this long if it exists */
+        bool open(const char *filename, size_t length);
+
+        bool isOpen() const {
+            return memory != nullptr;
+        }
+
+        /* True if open() had to create the file, so there is nothing in it yet */
+        bool isNew() const {
+            return created;
+        }
+
+        uint8_t *data() {
+            return memory;
+        }
+
+        /* Note a change to the sector holding this address */
+        void written(uint32_t address) {
+            uint32_t sector = address / SECTOR_SIZE;
+            if( memory && sector < dirty.size() ) {
+                dirty[sector] = true;
+                anyDirty = true;
+            }
+        }
+
+        /* Everything may have changed, e.g. a chip erase or a file loaded over it */
+        void allWritten();
+
+        /* Start writing dirty sectors back to the file */
+        void sync();
+
+        ~FlashImage();
+
+    private:
+        uint8_t           *memory = nullptr;
+        size_t            length = 0;
+        bool              created = false;
+        bool              anyDirty = false;
+        std::vector<bool> dirty;
+#ifdef _WIN32
+        void              *file = nullptr;
+        void              *mapping = nullptr;
+#else
+        int               file = -1;
+#endif
+
+        void close();
+};
@@ -9,28 +9,7 @@
 #include "SDL_ttf.h"
 #include "SDL2_gfxPrimitives.h"
 
-class Lookup {
-    /* The lookup class is used by the GUI to look up matching labels for the user to select a value by name */
-    public:
-        /* Perform a lookup on the given match string, and remember the results */
-        virtual void lookup(std::string match) = 0;
-
-        /* Return the number of matches in the most recent lookup */
-        virtual size_t matches() = 0;
-
-        /* Get the label for the n-th match in the most recent lookup */
-        virtual std::string getLabel(size_t index) = 0;
-
-        /* Get the numerical value for the n-th match in the most recent lookup */
-        virtual int getValue(size_t index) = 0;
-
-        /* Get a description for the n-th match in the most recent lookup */
-        virtual std::string getDescription1(size_t index) = 0;
-
-        /* Get a description for the n-th match in the most recent lookup */
-        virtual std::string getDescription2(size_t index) = 0;
-};
-
+#include "lookup.hpp"
 
 class GUI {
 
@@ -1,4 +1,5 @@
 #include "i2c.hpp"
+#include "savestate.hpp"
 #include <iostream>
 
 I2c::I2c(uint64_t clockMask, uint64_t dataMask) {
@@ -223,3 +224,32 @@ void I2c::debugSignal() {
     debugLength = 0;
 }
 
+void I2c::save(StateWriter &out) const {
+    int32_t device = -1;
+    for( size_t i=0; i<devices.size(); i++ ) {
+        if( devices[i] == currentDevice ) {
+            device = i;
+        }
+    }
+    out.value(state);
+    out.value(busState);
+    out.value(outputState);
+    out.value(counter);
+    out.value(address);
+    out.value(ioByte);
+    out.value(sendAck);
+    out.value(device);
+}
+
+void I2c::load(StateReader &in) {
+    int32_t device;
+    in.value(state);
+    in.value(busState);
+    in.value(outputState);
+    in.value(counter);
+    in.value(address);
+    in.value(ioByte);
+    in.value(sendAck);
+    in.value(device);
+    currentDevice = device >= 0 && device < (int32_t)devices.size() ? devices[device] : NULL;
+}
@@ -3,8 +3,12 @@
 #include <vector>
 #include "debug.hpp"
 
+class StateWriter;
+class StateReader;
+
 class I2cDevice {
     public:
+        virtual ~I2cDevice() {}
         virtual bool    atAddress(uint8_t adddress) = 0;
         virtual void    start() = 0;
         virtual uint8_t readNext() = 0;
@@ -54,5 +58,9 @@ class I2c {
         I2cDevice * deviceForAddress(uint8_t address);
 
         void setDebug(bool debug);
+
+        // Bus state for save states, the devices save their own
+        void save(StateWriter &out) const;
+        void load(StateReader &in);
 };
 
@@ -0,0 +1,233 @@
+#include "journal.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+static const char JOURNAL_MAGIC[8] = {'B', 'E', 'A', 'S', 'T', 'J', 'N', 'L'};
+
+Journal::~Journal() {
+    if( file ) {
+        fclose(file);
+    }
+}
+
+bool Journal::record(const char *filename, uint64_t tickCount) {
+    if( file ) {
+        fclose(file);
+    }
+    file = fopen(filename, "wb");
+    if( !file ) {
+        std::cout << "Could not create journal " << filename << std::endl;
+        return false;
+    }
+    uint32_t version = VERSION;
+    fwrite(JOURNAL_MAGIC, 1, sizeof(JOURNAL_MAGIC), file);
+    fwrite(&version, sizeof(version), 1, file);
+    fwrite(&tickCount, sizeof(tickCount), 1, file);
+    // Anything loaded from another journal still to come goes in first
+    for( const Event &event : events ) {
+        if( event.tickCount >= tickCount ) {
+            writeEvent(event);
+        }
+    }
+    fflush(file);
+    std::cout << "Recording inputs to " << filename << std::endl;
+    return true;
+}
+
+bool Journal::load(const char *filename, uint64_t tickCount) {
+    FILE *in = fopen(filename, "rb");
+    if( !in ) {
+        std::cout << "Could not open journal " << filename << std::endl;
+        return false;
+    }
+
+    char magic[sizeof(JOURNAL_MAGIC)];
+    uint32_t version;
+    uint64_t start;
+    if( fread(magic, 1, sizeof(magic), in) != sizeof(magic) || memcmp(magic, JOURNAL_MAGIC, sizeof(magic)) != 0 ||
+        fread(&version, sizeof(version), 1, in) != 1 || fread(&start, sizeof(start), 1, in) != 1 ) {
+        std::cout << filename << " is not a journal" << std::endl;
+        fclose(in);
+        return false;
+    }
+    if( version != VERSION ) {
+        std::cout << filename << " was recorded by a different version of BeastEm" << std::endl;
+        fclose(in);
+        return false;
+    }
+    if( start != tickCount ) {
+        std::cout << filename << " was recorded from cycle " << start << ", but the machine is at cycle " << tickCount << std::endl;
+        fclose(in);
+        return false;
+    }
+
+    std::deque<Event> loaded;
+    int type;
+    while( (type = fgetc(in)) != EOF ) {
+        Event event;
+        uint64_t length;
+        if( type >= TYPES ) {
+            std::cout << filename << " has an unknown input type " << type << std::endl;
+            fclose(in);
+            return false;
+        }
+        event.type = (Type)type;
+        if( !readNumber(in, event.tickCount) || !readNumber(in, length) || length > (1 << 16) ) {
+            break;
+        }
+        event.data.resize(length);
+        if( fread(event.data.data(), 1, length, in) != length ) {
+            break;
+        }
+        loaded.push_back(std::move(event));
+    }
+    if( !feof(in) ) {
+        // The recording process may have stopped part way through a record
+        std::cout << filename << " ends part way through an input, replaying the " << loaded.size() << " before it" << std::endl;
+    }
+    fclose(in);
+
+    events = std::move(loaded);
+    seek(tickCount);
+    std::cout << "Replaying " << events.size() << " inputs from " << filename << std::endl;
+    return true;
+}
+
+void Journal::clear() {
+    if( file ) {
+        fclose(file);
+        file = nullptr;
+    }
+    events.clear();
+    seek(0);
+}
+
+bool Journal::isRecording() const {
+    return file != nullptr;
+}
+
+void Journal::write(Type type, uint64_t tickCount, const void *data, size_t length) {
+    const uint8_t *start = (const uint8_t *)data;
+    events.push_back(Event{type, tickCount, std::vector<uint8_t>(start, start + length)});
+    for( int i=0; i<TYPES; i++ ) {
+        next[i] = events.size();
+    }
+    taken = events.size();
+
+    if( file ) {
+        writeEvent(events.back());
+        // A crash shouldn't lose what led up to it
+        fflush(file);
+    }
+}
+
+// Goes in after anything else arriving by the same cycle
+void Journal::add(Type type, uint64_t tickCount, const void *data, size_t length) {
+    const uint8_t *start = (const uint8_t *)data;
+    auto at = std::upper_bound(events.begin() + taken, events.end(), tickCount,
+                               [](uint64_t tick, const Event &event) { return tick < event.tickCount; });
+    size_t index = at - events.begin();
+    events.insert(at, Event{type, tickCount, std::vector<uint8_t>(start, start + length)});
+    for( int i=0; i<TYPES; i++ ) {
+        if( next[i] >= index ) {
+            next[i]++;
+        }
+    }
+    next[type] = std::min(next[type], index);
+    updateTaken();
+}
+
+int Journal::take(Type type, uint64_t tickCount, void *data, size_t length) {
+    size_t &index = next[type];
+    if( index >= events.size() || events[index].tickCount > tickCount ) {
+        return -1;
+    }
+    const Event &event = events[index];
+    size_t copied = std::min(length, event.data.size());
+    memcpy(data, event.data.data(), copied);
+
+    do {
+        index++;
+    } while( index < events.size() && events[index].type != type );
+    updateTaken();
+    return copied;
+}
+
+bool Journal::has(Type type) const {
+    for( const Event &event : events ) {
+        if( event.type == type ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t Journal::nextTick() const {
+    uint64_t tickCount = UINT64_MAX;
+    for( int i=0; i<TYPES; i++ ) {
+        if( next[i] < events.size() ) {
+            tickCount = std::min(tickCount, events[next[i]].tickCount);
+        }
+    }
+    return tickCount;
+}
+
+void Journal::seek(uint64_t tickCount) {
+    for( int i=0; i<TYPES; i++ ) {
+        next[i] = 0;
+        while( next[i] < events.size() && (events[next[i]].type != i || events[next[i]].tickCount < tickCount) ) {
+            next[i]++;
+        }
+    }
+    updateTaken();
+}
+
+void Journal::forget(uint64_t tickCount) {
+    while( taken > 0 && events.front().tickCount < tickCount ) {
+        events.pop_front();
+        for( int i=0; i<TYPES; i++ ) {
+            next[i]--;
+        }
+        taken--;
+    }
+}
+
+void Journal::updateTaken() {
+    taken = events.size();
+    for( int i=0; i<TYPES; i++ ) {
+        taken = std::min(taken, next[i]);
+    }
+}
+
+void Journal::writeEvent(const Event &event) {
+    fputc(event.type, file);
+    writeNumber(event.tickCount);
+    writeNumber(event.data.size());
+    fwrite(event.data.data(), 1, event.data.size(), file);
+}
+
+// Seven bits at a time, lowest first, top bit set while there are more to come
+void Journal::writeNumber(uint64_t value) {
+    while( value >= 0x80 ) {
+        fputc((int)(value & 0x7F) | 0x80, file);
+        value >>= 7;
+    }
+    fputc((int)value, file);
+}
+
+bool Journal::readNumber(FILE *in, uint64_t &value) {
+    value = 0;
+    for( int shift=0; shift<64; shift+=7 ) {
+        int byte = fgetc(in);
+        if( byte == EOF ) {
+            return false;
+        }
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if( (byte & 0x80) == 0 ) {
+            return true;
+        }
+    }
+    return false;
+}
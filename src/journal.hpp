@@ -0,0 +1,85 @@
+#pragma once
+#include <stdint.h>
+#include <cstdio>
+#include <deque>
+#include <vector>
+
+/**
+ * journal.hpp - Everything that reaches the machine from outside, stamped with the cycle count
+ *
+ * The emulation itself is deterministic, so a run can be repeated exactly from the
+ * same starting point given the same inputs at the same cycles: the keys held down,
+ * bytes received by the UART and the power-on contents of the RTC's SRAM.
+ *
+ * Inputs are always kept in memory, so the rewind history can run them again, and can
+ * also be written to a file as they happen. A file written like that can be loaded to
+ * run the same inputs again, e.g. to reproduce a long soak run that went wrong. The
+ * machine has to start from the same place: the same files loaded, or the same state.
+ *
+ * While there are inputs in the journal still to come, they are taken from there and
+ * live input is ignored. Once they run out, live input is recorded again.
+ *
+ * A journal file is a header and then records of a type byte, the cycle count and
+ * the length as variable length numbers, then the data.
+ */
+class Journal {
+    public:
+        static const uint32_t VERSION = 1;
+
+        enum Type : uint8_t {KEYS, UART, RTC_SRAM, TYPES};
+
+        /* Also write inputs to this file from now on, starting at this cycle. Any loaded inputs still to come are written first */
+        bool record(const char *filename, uint64_t tickCount);
+
+        /* Take inputs from this file. The machine must be where the recording started */
+        bool load(const char *filename, uint64_t tickCount);
+
+        /* Stop writing to the file and forget all inputs, e.g. when the cycle count starts again */
+        void clear();
+
+        bool isRecording() const;
+
+        /* True while there are inputs to come that were recorded earlier */
+        bool pending() const {
+            return taken < events.size();
+        }
+
+        /* Note a live input */
+        void write(Type type, uint64_t tickCount, const void *data, size_t length);
+
+        /* An input still to come, as if it had been loaded from a file, e.g. from a test script */
+        void add(Type type, uint64_t tickCount, const void *data, size_t length);
+
+        /* The next input of this type, if it arrived by this cycle. Returns its length or -1 */
+        int take(Type type, uint64_t tickCount, void *data, size_t length);
+
+        bool has(Type type) const;
+
+        /* Cycle of the next input still to be taken, or UINT64_MAX */
+        uint64_t nextTick() const;
+
+        /* Go back to the first input at or after this cycle, for rewind */
+        void seek(uint64_t tickCount);
+
+        /* Drop inputs from before this cycle, which can no longer be replayed */
+        void forget(uint64_t tickCount);
+
+        ~Journal();
+
+    private:
+        struct Event {
+            Type                 type;
+            uint64_t             tickCount;
+            std::vector<uint8_t> data;
+        };
+
+        FILE               *file = nullptr;
+        std::deque<Event>  events;
+        size_t             next[TYPES] = {0};    // Next event of each type to take
+        size_t             taken = 0;            // Events before this have all been taken
+
+        void     writeEvent(const Event &event);
+        void     writeNumber(uint64_t value);
+        bool     readNumber(FILE *in, uint64_t &value);
+        void     updateTaken();
+};
@@ -20,7 +20,9 @@
 
 #include "listing.hpp"
 #include <cctype>
+#include <cstdio>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <regex>
 #include <sstream>
@@ -235,6 +237,8 @@ void Listing::loadFile(Source &source) {
   }
 
   bool isLabelMap = false;
+  bool isSjasm = false;
+  symbolColumn = DEFAULT_SYMBOL_COLUMN;
 
   while (std::getline(myfile, text)) {
     Line line = {};
@@ -291,6 +295,9 @@ void Listing::loadFile(Source &source) {
           }
         }
 
+        if (isSjasm) {
+          symbolColumn = match.position(2) + SJASM_SYMBOL_OFFSET;
+        }
         addSymbol(text, line, source);
 
         line.byteCount = byteCount;
@@ -313,6 +320,7 @@ void Listing::loadFile(Source &source) {
         }
         else if( text.rfind("# ", 0) == 0) {
           // SJAsmPlus telling us things.
+          isSjasm = true;
         }
         else if( text.rfind("Value", 0) == 0) {
           // SJAsmPlus symbol map follows
@@ -544,12 +552,26 @@ std::string Listing::getDescription1(size_t index) {
     if (index>symbolLookup.size()) return "";
 
     Symbol& symbol = symbolLookup[index];
-    return GUI::string_format("0x%04X  Physical: 0x%05X", symbol.value, (symbol.value & 0x3FFF) | (symbol.page << 14));
+    char description[32];
+    snprintf(description, sizeof(description), "0x%04X  Physical: 0x%05X", symbol.value, (symbol.value & 0x3FFF) | (symbol.page << 14));
+    return description;
 }
 
 std::string Listing::getDescription2(size_t index) {
     if (index>symbolLookup.size()) return "";
 
     Symbol& symbol = symbolLookup[index];
-    return GUI::string_format("File %d: %-14s", symbol.fileNum+1, sources[symbol.fileNum].filename.c_str());
+    std::ostringstream description;
+    description << "File " << symbol.fileNum+1 << ": " << std::left << std::setw(14) << sources[symbol.fileNum].filename;
+    return description.str();
+}
+
+bool Listing::findSymbol(const std::string &label, Symbol &symbol) const {
+  // Ordered by label, then file
+  auto found = symbolMap.lower_bound(Symbol{label, 0, 0, 0});
+  if (found == symbolMap.end() || found->label != label) {
+    return false;
+  }
+  symbol = *found;
+  return true;
 }
\ No newline at end of file
@@ -24,7 +24,7 @@
  */
 
 #pragma once
-#include "gui.hpp"
+#include "lookup.hpp"
 #include <cstdint>
 #include <iostream>
 #include <filesystem>
@@ -192,8 +192,16 @@ class Listing: public Lookup {
         /* Get a description for the n-th match in the most recent lookup */
         virtual std::string getDescription2(size_t index);
 
+        /**
+         * Find a label by its exact name, in the first file that has it.
+         *
+         * @return  false if no loaded listing defines it
+         */
+        bool    findSymbol(const std::string &label, Symbol &symbol) const;
+
     private:
         static const int DEFAULT_SYMBOL_COLUMN = 24; 
+        static const int SJASM_SYMBOL_OFFSET = 18;     // SJAsmPlus labels follow the address, which moves with the line number
         static const int MAX_LOOKUP = 10;
 
         const std::string NON_LABEL_CHARS = " \t;#._@";
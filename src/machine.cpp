@@ -0,0 +1,1828 @@
+#include "machine.hpp"
+#include "listing.hpp"
+#include "z80.h"
+#include "z80pio.h"
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdio.h>
+
+static volatile std::sig_atomic_t headlessStopRequested = 0;
+
+Machine::Machine(Listing &listing, std::vector<BinaryFile> files)
+    : romMemory(ROM_SIZE), rom(romMemory.data()), ram{}, memoryPage{0}, listing(listing), binaryFiles(files) {
+
+  instr = new Instructions();
+  debugManager = new DebugManager();
+
+  i2c = new I2c(Z80PIO_PB6, Z80PIO_PB7);
+  display1 = new I2cDisplay(0x50);
+  display2 = new I2cDisplay(0x53);
+  rtc = new I2cRTC(0x6f, Z80PIO_PB5);
+
+  i2c->addDevice(display1);
+  i2c->addDevice(display2);
+  i2c->addDevice(rtc);
+
+  for (int i = 0; i < DISPLAY_CHARS; i++) {
+    display.push_back(Digit());
+  }
+}
+
+Machine::~Machine() {
+  profiler.report(std::cout);
+  if (audioFile) {
+    fclose(audioFile);
+    audioFile = nullptr;
+  }
+  delete debugManager;
+  delete rtc;
+  delete display2;
+  delete display1;
+  delete i2c;
+  delete instr;
+}
+
+void Machine::init(uint64_t targetSpeedHz, uint64_t breakpoint, VideoBeast *videoBeast) {
+  this->videoBeast = videoBeast;
+
+  pins = z80_init(&cpu);
+
+  z80pio_init(&pio);
+
+  this->targetSpeedHz = targetSpeedHz;
+  clock_cycle_ps = ONE_SECOND_PS / targetSpeedHz;
+  pacer.setCyclesPerFrame(targetSpeedHz / FRAME_RATE);
+
+  float speed = targetSpeedHz / 1000000.0f;
+
+  std::cout << "Clock cycle time ps = " << clock_cycle_ps
+            << ", speed = " << std::setprecision(2) << std::fixed << speed
+            << "MHz" << std::endl;
+  clock_time_ps = 0;
+
+  // Set command-line breakpoint as system breakpoint 0
+  if (breakpoint != NOT_SET) {
+    debugManager->setSystemBreakpoint(0, (uint32_t)breakpoint, false);
+  }
+
+  portB = 0xFF;
+  updateBanks();
+
+  for (int i = 0; i < 12; i++) {
+    display1->addDigit(getDigit(i));
+    display2->addDigit(getDigit(i + 12));
+  }
+
+  uart_init(&uart, UART_CLOCK_HZ, clock_time_ps, uartPort, uartNetwork);
+  uart.receive = receiveUart;
+  uart.receive_context = this;
+  scheduler.schedule(Scheduler::UART, uart_next_tick(&uart));
+
+  if (videoBeast) {
+    initVideoBeast();
+  } else {
+    setRewindMemory();
+  }
+
+  for (auto &bf : binaryFiles) {
+    bf.load(rom, ram, pagingEnabled, memoryPage, videoRam);
+  }
+  flash.allWritten();
+
+  for (auto &source : listing.getFiles()) {
+    listing.loadFile(source);
+  }
+}
+
+// Multiply emulated speed relative to real time, SPEED_MAX to run unthrottled
+void Machine::setSpeedMultiplier(int multiplier) {
+  speedMultiplier = multiplier;
+  pacer.setMultiplier(multiplier);
+  audioDecimation = 0;
+}
+
+// Both engines stop at the same instruction boundaries, so this can change at any time
+void Machine::setEngine(Engine engine) {
+  this->engine = engine;
+}
+
+// Write a JSON line of performance counters to the file every second
+bool Machine::openStatsFile(const char *filename) {
+  return stats.openFile(filename);
+}
+
+bool Machine::openFlashImage(const char *filename) {
+  if (!flash.open(filename, ROM_SIZE)) {
+    return false;
+  }
+  rom = flash.data();
+  romMemory.clear();
+  romMemory.shrink_to_fit();
+  std::cout << (flash.isNew() ? "Created flash image " : "Using flash image ")
+            << filename << std::endl;
+  return true;
+}
+
+void Machine::setUartPort(int port) { uartPort = port; }
+
+void Machine::setUartNetwork(const uart_network_t *network) {
+  uartNetwork = network;
+}
+
+Machine *Machine::spawn() {
+  // Spawned machines have no source to show, so they all share an empty listing
+  static Listing noListing;
+  Machine *copy = new Machine(noListing, {});
+  copy->setUartPort(0);
+  if (videoBeast) {
+    copy->ownedVideoBeast.reset(new VideoBeast());
+  }
+  copy->init(targetSpeedHz, NOT_SET, copy->ownedVideoBeast.get());
+  copy->setEngine(engine);
+  copy->setSpeedMultiplier(SPEED_MAX);
+  copy->setRewindBudget(0);
+
+  copy->romMemory.clear();
+  copy->romMemory.shrink_to_fit();
+  copy->rom = rom;
+  copy->romShared = true;
+  memcpy(copy->ram, ram, RAM_SIZE);
+  if (videoBeast) {
+    memcpy(copy->videoRam, videoRam, VideoBeast::VIDEO_RAM_LENGTH);
+  }
+
+  std::vector<uint8_t> machine;
+  StateWriter out(machine);
+  saveMachine(out, false);
+  StateReader in;
+  in.open(machine);
+  copy->loadMachine(in, false);
+  copy->pacer.setCyclesToFrame(pacer.cyclesToFrame());
+  copy->setRewindMemory();
+  copy->memoryReloaded();
+  return copy;
+}
+
+// A spawned machine takes its own copy of the ROM the first time it writes to it
+void Machine::ownRom() {
+  if (!romShared) {
+    return;
+  }
+  romMemory.assign(rom, rom + ROM_SIZE);
+  rom = romMemory.data();
+  romShared = false;
+  updateBanks();
+  setRewindMemory();
+  blockCache.invalidate();
+}
+
+void Machine::loadBinary(BinaryFile &file) {
+  if (file.getDestination() != BinaryFile::VIDEO_RAM &&
+      !(file.getDestination() == BinaryFile::PHYSICAL && file.getAddress() >= ROM_SIZE)) {
+    ownRom();
+  }
+  file.load(rom, ram, pagingEnabled, memoryPage, videoRam);
+  memoryReloaded();
+}
+
+void Machine::runScenario(const Scenario &scenario, ScenarioResult &result) {
+  uart.transmit = captureUart;
+  uart.transmit_context = &result.uart;
+  if (scenario.breakpoint != Scenario::NO_BREAKPOINT) {
+    debugManager->setSystemBreakpoint(0, scenario.breakpoint, false);
+  }
+  if (!scenario.journalFile.empty() &&
+      !replayJournal(scenario.journalFile.c_str())) {
+    result.stop = "no journal";
+    return;
+  }
+  // In pieces the UART can take in one go
+  for (size_t i = 0; i < scenario.uart.size(); i += RX_BUFFER_SIZE) {
+    size_t length = std::min(scenario.uart.size() - i, (size_t)RX_BUFFER_SIZE);
+    journal.add(Journal::UART, tickCount, scenario.uart.data() + i, length);
+  }
+
+  uint64_t start = tickCount;
+  stopReason = STOP_NONE;
+  while (tickCount - start < scenario.cycles && stopReason != STOP_BREAKPOINT &&
+         stopReason != STOP_WATCHPOINT) {
+    runUntil(StopCondition{StopCondition::CYCLES, 0,
+                           scenario.cycles - (tickCount - start)});
+  }
+  result.stop = stopReason == STOP_BREAKPOINT   ? "breakpoint"
+                : stopReason == STOP_WATCHPOINT ? "watchpoint"
+                                                : "cycles";
+  result.cycles = tickCount - start;
+  result.pc = cpu.pc - 1;
+  uart.transmit = nullptr;
+}
+
+// Breakpoints stop the run on the instruction, memory conditions on the write through a
+// watchpoint, and UART conditions on the first boundary after a byte is sent, so the
+// cycles and PC are those of the moment the condition was met
+void Machine::runTest(const std::vector<TestCondition> &conditions, uint64_t budget,
+                    TestResult &result) {
+  uart.transmit = captureUart;
+  uart.transmit_context = &result.uart;
+  bool watchUart = false;
+  for (const TestCondition &condition : conditions) {
+    if (condition.kind == TestCondition::BREAK) {
+      debugManager->addBreakpoint(condition.address, condition.isPhysical);
+    } else if (condition.kind == TestCondition::MEMORY) {
+      // Past the last watchpoint it is still checked between slices
+      debugManager->addWatchpoint(condition.address, 1, condition.isPhysical, false, true);
+    } else {
+      watchUart = true;
+    }
+  }
+
+  uint64_t start = tickCount;
+  uint64_t slice = targetSpeedHz / FRAME_RATE;
+  size_t checkedUart = 0;
+  uint16_t metPc = cpu.pc - 1;
+  while (true) {
+    // A byte may already hold its value before the first write
+    for (const TestCondition &condition : conditions) {
+      if (result.met) {
+        break;
+      }
+      if (condition.kind == TestCondition::MEMORY) {
+        uint8_t value = condition.isPhysical
+                            ? readPage(condition.address >> 14, condition.address)
+                            : readMem(condition.address);
+        if (value == condition.value) {
+          result.met = &condition;
+        }
+      } else if (condition.kind == TestCondition::UART && result.uart.size() != checkedUart &&
+                 std::regex_search(result.uart, condition.pattern)) {
+        result.met = &condition;
+      }
+    }
+    checkedUart = result.uart.size();
+    if (result.met || (budget != 0 && tickCount - start >= budget)) {
+      break;
+    }
+
+    uint64_t cycles = budget == 0 ? slice : std::min(slice, budget - (tickCount - start));
+    stopReason = STOP_NONE;
+    runUntil(StopCondition{watchUart ? StopCondition::UART : StopCondition::CYCLES, 0, cycles});
+    metPc = stopReason == STOP_WATCHPOINT ? watchpointTriggerAddress : cpu.pc - 1;
+
+    if (stopReason == STOP_BREAKPOINT) {
+      // Any other breakpoint, such as one from -b, is passed over
+      const Breakpoint *bp = debugManager->checkBreakpoint(cpu.pc - 1, memoryPage);
+      for (const TestCondition &condition : conditions) {
+        if (bp && condition.kind == TestCondition::BREAK &&
+            condition.address == bp->address && condition.isPhysical == bp->isPhysical) {
+          result.met = &condition;
+          break;
+        }
+      }
+    }
+  }
+  result.cycles = tickCount - start;
+  result.pc = metPc;
+  uart.transmit = nullptr;
+}
+
+void Machine::setRewindBudget(size_t megabytes) {
+  rewind.setBudget(megabytes << 20);
+}
+
+bool Machine::saveState(const char *filename) {
+  auto start = std::chrono::steady_clock::now();
+  FILE *file = fopen(filename, "wb");
+  if (!file) {
+    std::cout << "Could not create state file " << filename << std::endl;
+    return false;
+  }
+  StateWriter out(file);
+  saveMachine(out);
+  bool ok = out.ok();
+  if (fclose(file) != 0 || !ok) {
+    std::cout << "Could not write state file " << filename << std::endl;
+    return false;
+  }
+  stateFile = filename;
+  std::cout << "Saved state to " << filename << " in "
+            << std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now() - start).count() / 1000.0
+            << "ms" << std::endl;
+  return true;
+}
+
+bool Machine::loadState(const char *filename) {
+  auto start = std::chrono::steady_clock::now();
+  StateReader in;
+  if (!in.open(filename)) {
+    return false;
+  }
+  // Check the layout first, so a bad file leaves the machine as it was
+  StateWriter layout;
+  saveMachine(layout);
+  if (!in.matches(layout)) {
+    std::cout << filename << " does not match this build or machine (VideoBeast "
+              << (videoBeast ? "on" : "off") << ")" << std::endl;
+    return false;
+  }
+  loadMachine(in);
+  if (!in.ok()) {
+    std::cout << "Could not read state file " << filename << ", resetting" << std::endl;
+    reset();
+    return false;
+  }
+  rewind.clear();
+  stopJournal();
+  stateFile = filename;
+  std::cout << "Restored state from " << filename << " in "
+            << std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now() - start).count() / 1000.0
+            << "ms" << std::endl;
+  return true;
+}
+
+bool Machine::bootFromCache(const char *directory, uint16_t readyPc) {
+  BootCache key;
+  key.add(BEASTEM_VERSION, sizeof(BEASTEM_VERSION));
+  uint32_t stateVersion = StateWriter::VERSION;
+  key.add(stateVersion);
+  key.add(targetSpeedHz);
+  key.add(readyPc);
+  key.add(videoBeast != nullptr);
+  key.add(rom, ROM_SIZE);
+  key.add(ram, RAM_SIZE);
+  if (videoBeast) {
+    key.add(videoRam, VideoBeast::VIDEO_RAM_LENGTH);
+  }
+  std::string cached = key.path(directory);
+  // F5 and F9 save somewhere else, never over the cache
+  std::string keepStateFile = stateFile;
+
+  if (std::ifstream(cached).good()) {
+    bool restored = loadState(cached.c_str());
+    stateFile = keepStateFile;
+    if (restored) {
+      return true;
+    }
+  }
+
+  uint64_t start = tickCount;
+  runUntil(StopCondition{StopCondition::ADDRESS, (uint16_t)(readyPc + 1),
+                         targetSpeedHz * BOOT_LIMIT_SECONDS});
+  if (cpu.pc != (uint16_t)(readyPc + 1)) {
+    std::cout << "Boot stopped before reaching " << std::hex << std::uppercase
+              << readyPc << std::dec << ", nothing cached" << std::endl;
+    return false;
+  }
+  std::cout << "Booted in " << tickCount - start << " cycles" << std::endl;
+
+  // Written in full before it appears, as another launch may be looking for it
+  std::error_code error;
+  std::filesystem::create_directories(directory, error);
+  std::string partial =
+      cached + "." +
+      std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+  bool saved = saveState(partial.c_str()) &&
+               std::rename(partial.c_str(), cached.c_str()) == 0;
+  stateFile = keepStateFile;
+  if (!saved) {
+    std::remove(partial.c_str());
+  }
+  // Carry on from the same frame position as a restored state would
+  pacer.resetFrame();
+  return saved;
+}
+
+bool Machine::recordJournal(const char *filename) {
+  if (!journal.record(filename, tickCount)) {
+    return false;
+  }
+  // A journal being replayed already has the SRAM as it was
+  if (!journal.has(Journal::RTC_SRAM)) {
+    uint8_t sram[I2cRTC::SRAM_LENGTH];
+    rtc->readSram(sram);
+    journal.write(Journal::RTC_SRAM, tickCount, sram, sizeof(sram));
+  }
+  journaledKeys = keyMask();
+  return true;
+}
+
+bool Machine::replayJournal(const char *filename) {
+  if (!journal.load(filename, tickCount)) {
+    return false;
+  }
+  uint8_t sram[I2cRTC::SRAM_LENGTH];
+  if (journal.take(Journal::RTC_SRAM, tickCount, sram, sizeof(sram)) == sizeof(sram)) {
+    rtc->writeSram(sram);
+  }
+  journaledKeys = keyMask();
+  return true;
+}
+
+// The cycle count no longer follows on from the journal
+void Machine::stopJournal() {
+  if (journal.isRecording()) {
+    std::cout << "Stopped recording inputs" << std::endl;
+  }
+  journal.clear();
+  journaledKeys = keyMask();
+}
+
+// While replaying history, or a journal still has inputs to come, live input is ignored
+bool Machine::inputFromJournal() const {
+  return replaying || journal.pending();
+}
+
+// Key changes are journaled as they happen. Replayed ones are applied when the
+// CPU next reads the keyboard, which is the only place they can be seen.
+void Machine::journalKeys() {
+  uint64_t keys;
+  if (inputFromJournal()) {
+    while (journal.take(Journal::KEYS, tickCount, &keys, sizeof(keys)) == sizeof(keys)) {
+      setKeyMask(keys);
+    }
+  } else if ((keys = keyMask()) != journaledKeys) {
+    journal.write(Journal::KEYS, tickCount, &keys, sizeof(keys));
+  }
+  // A polling loop may have read the keys before they changed, so its next pass differs
+  if (keyMask() != journaledKeys) {
+    journaledKeys = keyMask();
+    busyWait.taint();
+  }
+}
+
+// Bit (row*12 + col) set for each key held down
+uint64_t Machine::keyMask() const {
+  uint64_t keys = 0;
+  for (int key : keySet) {
+    keys |= 1ULL << key;
+  }
+  return keys;
+}
+
+void Machine::setKeyMask(uint64_t keys) {
+  keySet.clear();
+  for (int key = 0; key < 64; key++) {
+    if (keys & (1ULL << key)) {
+      keySet.insert(key);
+    }
+  }
+}
+
+void Machine::setKeys(uint64_t keys) {
+  if (inputFromJournal()) {
+    return;
+  }
+  setKeyMask(keys);
+  journalKeys();
+}
+
+int Machine::receiveUart(void *machine, uint8_t *buffer, int length) {
+  return ((Machine *)machine)->uartReceive(buffer, length);
+}
+
+void Machine::captureUart(void *output, uint8_t byte) {
+  ((std::string *)output)->push_back((char)byte);
+}
+
+// Called each time the UART looks for input, which it only does while idle
+int Machine::uartReceive(uint8_t *buffer, int length) {
+  if (inputFromJournal()) {
+    int received = journal.take(Journal::UART, tickCount, buffer, length);
+    return received > 0 ? received : 0;
+  }
+  int received = uart_receive(&uart, buffer, length);
+  if (received > 0) {
+    journal.write(Journal::UART, tickCount, buffer, received);
+  }
+  return received;
+}
+
+// The chips are saved field by field, leaving out the host pointers: the CPU's bank
+// pointers are rebuilt by updateBanks(), and the UART keeps its live connection and
+// callbacks. The same function lists the fields for saving and loading.
+template <typename Field> static void cpuFields(z80_t &cpu, Field field) {
+  field(cpu.step);
+  field(cpu.addr);
+  field(cpu.dlatch);
+  field(cpu.opcode);
+  field(cpu.hlx_idx);
+  field(cpu.prefix_active);
+  field(cpu.pins);
+  field(cpu.int_bits);
+  field(cpu.pc);
+  field(cpu.af);
+  field(cpu.bc);
+  field(cpu.de);
+  field(cpu.hl);
+  field(cpu.ix);
+  field(cpu.iy);
+  field(cpu.wz);
+  field(cpu.sp);
+  field(cpu.ir);
+  field(cpu.af2);
+  field(cpu.bc2);
+  field(cpu.de2);
+  field(cpu.hl2);
+  field(cpu.im);
+  field(cpu.iff1);
+  field(cpu.iff2);
+  field(cpu.bank_written);
+}
+
+template <typename Field> static void pioFields(z80pio_t &pio, Field field) {
+  for (auto &port : pio.port) {
+    field(port.input);
+    field(port.output);
+    field(port.mode);
+    field(port.io_select);
+    field(port.int_vector);
+    field(port.int_control);
+    field(port.int_mask);
+    field(port.int_state);
+    field(port.int_enabled);
+    field(port.expect_io_select);
+    field(port.expect_int_mask);
+    field(port.bctrl_match);
+  }
+  field(pio.reset_active);
+  field(pio.pins);
+}
+
+template <typename Field> static void uartFields(uart_t &uart, Field field) {
+  field(uart.clock_hz);
+  field(uart.cycle_ps);
+  field(uart.last_tick_ps);
+  field(uart.divisor);
+  field(uart.pins);
+  field(uart.rx_fifo);
+  field(uart.rx_pos);
+  field(uart.rx_bytes);
+  field(uart.rx_cycles);
+  field(uart.rx_bit);
+  field(uart.is_receiving);
+  field(uart.tx_fifo);
+  field(uart.tx_pos);
+  field(uart.tx_bytes);
+  field(uart.tx_cycles);
+  field(uart.tx_shift);
+  field(uart.tx_bit);
+  field(uart.interrupt_enable_register);
+  field(uart.interrupt_id_register);
+  field(uart.fifo_control_register);
+  field(uart.line_control_register);
+  field(uart.modem_control_register);
+  field(uart.line_status_register);
+  field(uart.modem_status_register);
+  field(uart.scratch_register);
+  field(uart.rx_buffer);
+  field(uart.rx_available);
+  field(uart.rx_offset);
+}
+
+// The order here is the order in the file, loadMachine() must follow it.
+// Rewind checkpoints leave out memory, which they keep page by page.
+void Machine::saveMachine(StateWriter &out, bool withMemory) {
+  journalKeys();
+  uint64_t keys = keyMask();
+
+  auto save = [&out](const auto &field) { out.value(field); };
+  out.begin("CPU ");
+  cpuFields(cpu, save);
+  out.end();
+  out.begin("PIO ");
+  pioFields(pio, save);
+  out.end();
+  out.begin("UART");
+  uartFields(uart, save);
+  out.end();
+
+  out.begin("MACH");
+  out.value(clock_time_ps);
+  out.value(tickCount);
+  out.value(pins);
+  out.value(portPins);
+  out.value(portB);
+  out.value(devicesSettling);
+  out.value(currentInstructionPC);
+  out.value(memoryPage);
+  out.value(pagingEnabled);
+  out.value(romOperation);
+  out.value(romSequence);
+  out.value(romOperationMask);
+  out.value(romCompletePs);
+  out.value(scheduler);
+  out.value(keys);
+  out.end();
+
+  out.begin("I2C ");
+  i2c->save(out);
+  out.end();
+  out.begin("RTC ");
+  rtc->save(out);
+  out.end();
+  out.begin("DSP1");
+  display1->save(out);
+  out.end();
+  out.begin("DSP2");
+  display2->save(out);
+  out.end();
+  out.begin("DIGI");
+  for (Digit &digit : display) {
+    out.value(digit.getSegments());
+    for (int segment = 0; segment < Digit::SEGMENTS; segment++) {
+      out.value(digit.getBrightness(segment));
+    }
+  }
+  out.end();
+
+  if (withMemory) {
+    out.block("ROM ", rom, ROM_SIZE);
+    out.block("RAM ", ram, RAM_SIZE);
+  }
+
+  if (videoBeast) {
+    out.begin("VBST");
+    videoBeast->save(out);
+    out.end();
+    if (withMemory) {
+      out.block("VRAM", videoRam, VideoBeast::VIDEO_RAM_LENGTH);
+    }
+  }
+}
+
+void Machine::loadMachine(StateReader &in, bool withMemory) {
+  uint64_t keys;
+
+  auto load = [&in](auto &field) { in.value(field); };
+  in.begin("CPU ");
+  cpuFields(cpu, load);
+  in.end();
+  in.begin("PIO ");
+  pioFields(pio, load);
+  in.end();
+  in.begin("UART");
+  uartFields(uart, load);
+  in.end();
+
+  in.begin("MACH");
+  in.value(clock_time_ps);
+  in.value(tickCount);
+  in.value(pins);
+  in.value(portPins);
+  in.value(portB);
+  in.value(devicesSettling);
+  in.value(currentInstructionPC);
+  in.value(memoryPage);
+  in.value(pagingEnabled);
+  in.value(romOperation);
+  in.value(romSequence);
+  in.value(romOperationMask);
+  in.value(romCompletePs);
+  in.value(scheduler);
+  in.value(keys);
+  in.end();
+
+  in.begin("I2C ");
+  i2c->load(in);
+  in.end();
+  in.begin("RTC ");
+  rtc->load(in);
+  in.end();
+  in.begin("DSP1");
+  display1->load(in);
+  in.end();
+  in.begin("DSP2");
+  display2->load(in);
+  in.end();
+  in.begin("DIGI");
+  for (Digit &digit : display) {
+    uint16_t segments;
+    in.value(segments);
+    digit.setSegments(segments);
+    for (int segment = 0; segment < Digit::SEGMENTS; segment++) {
+      uint8_t brightness;
+      in.value(brightness);
+      digit.setBrightness(segment, brightness);
+    }
+  }
+  in.end();
+
+  if (withMemory) {
+    ownRom();
+    in.block("ROM ", rom, ROM_SIZE);
+    in.block("RAM ", ram, RAM_SIZE);
+    flash.allWritten();
+  }
+
+  if (videoBeast) {
+    in.begin("VBST");
+    videoBeast->load(in);
+    in.end();
+    if (withMemory) {
+      in.block("VRAM", videoRam, VideoBeast::VIDEO_RAM_LENGTH);
+    }
+  }
+
+  setKeyMask(keys);
+
+  // The bank pointers handed to the core are not saved, so rebuild them
+  updateBanks();
+  watchpointHit = false;
+  historyCount = 0;
+  pacer.resetFrame();
+  busyWait.reset();
+  blockCache.invalidate();
+  onRestore();
+}
+
+// Memory changed behind the CPU's back, e.g. a file was loaded into it
+void Machine::memoryReloaded() {
+  busyWait.reset();
+  blockCache.invalidate();
+  rewind.allWritten();
+  flash.allWritten();
+}
+
+void Machine::takeCheckpoint() {
+  checkpointDue = false;
+  if (videoBeast) {
+    uint64_t pages = videoBeast->takeDirtyPages();
+    for (uint32_t page = 0; pages; page++, pages >>= 1) {
+      if (pages & 1) {
+        rewind.written(ROM_SIZE + RAM_SIZE + (page << 14));
+      }
+    }
+  }
+  std::vector<uint8_t> machine;
+  StateWriter out(machine);
+  saveMachine(out, false);
+  rewind.checkpoint(tickCount, pacer.cyclesToFrame(), std::move(machine));
+}
+
+// Back to a checkpoint, forgetting any taken after it
+void Machine::restoreCheckpoint(int index) {
+  rewind.restore(index);
+  StateReader in;
+  in.open(rewind.at(index).machine);
+  loadMachine(in, false);
+  pacer.setCyclesToFrame(rewind.at(index).cyclesToFrame);
+  flash.allWritten();
+  if (videoBeast) {
+    videoBeast->takeDirtyPages();
+  }
+  // Input since the checkpoint comes from the journal until it catches up
+  journal.seek(tickCount);
+  journaledKeys = keyMask();
+}
+
+// What has already been sent out over the UART isn't sent again
+void Machine::setReplaying(bool replaying) {
+  this->replaying = replaying;
+  uart.offline = replaying;
+}
+
+// Run on from a restored checkpoint to the first boundary at or after target.
+// Returns the cycle count of the last breakpoint passed before target, or NOT_SET.
+// Nothing that arrived from outside since the checkpoint is run again.
+uint64_t Machine::replayTo(uint64_t target) {
+  uint64_t lastHit = NOT_SET;
+  setReplaying(true);
+  while (tickCount < target) {
+    stopReason = STOP_NONE;
+    runUntil(StopCondition{StopCondition::CYCLES, 0, target - tickCount});
+    if (stopReason == STOP_BREAKPOINT && tickCount < target) {
+      lastHit = tickCount;
+    }
+  }
+  setReplaying(false);
+  return lastHit;
+}
+
+// Back to the instruction boundary before this one
+void Machine::stepBack() {
+  uint64_t now = tickCount;
+  int index = rewind.before(now);
+  if (index < 0) {
+    std::cout << "No history to step back into" << std::endl;
+    return;
+  }
+
+  // Step through once to find the boundary, then go there again in one run
+  restoreCheckpoint(index);
+  uint64_t previous = tickCount;
+  setReplaying(true);
+  while (true) {
+    runUntil(StopCondition{StopCondition::INSTRUCTION});
+    if (tickCount >= now) {
+      break;
+    }
+    previous = tickCount;
+  }
+  setReplaying(false);
+
+  restoreCheckpoint(index);
+  replayTo(previous);
+  stopReason = STOP_STEP;
+}
+
+// Back to the last breakpoint passed, or the oldest checkpoint if there was none
+void Machine::reverseContinue() {
+  uint64_t end = tickCount;
+  double seconds = rewind.seconds(end, targetSpeedHz);
+  int index = rewind.before(end);
+  if (index < 0) {
+    std::cout << "No history to search back through" << std::endl;
+    return;
+  }
+  for (; index >= 0; index--) {
+    restoreCheckpoint(index);
+    // The checkpoint's own boundary was checked before it was taken
+    uint64_t hit = NOT_SET;
+    const Breakpoint *bp = debugManager->checkBreakpoint(cpu.pc - 1, memoryPage);
+    if (bp && !bp->isTrace) {
+      hit = tickCount;
+    }
+    uint64_t start = tickCount;
+    uint64_t later = replayTo(end);
+    if (later != NOT_SET) {
+      hit = later;
+    }
+    if (hit != NOT_SET) {
+      restoreCheckpoint(index);
+      replayTo(hit);
+      stopReason = STOP_BREAKPOINT;
+      return;
+    }
+    end = start;
+  }
+  restoreCheckpoint(0);
+  std::cout << "No breakpoint in the last " << seconds << "s" << std::endl;
+  stopReason = STOP_STEP;
+}
+
+void Machine::restartStats() {
+  stats.restart(tickCount, clock_time_ps, pacer.sleptNs(),
+                videoBeast ? videoBeast->getFrameCount() : 0,
+                uart.bytes_transferred);
+}
+
+void Machine::updateStats() {
+  stats.onFrame(tickCount, clock_time_ps, pacer.sleptNs(),
+                videoBeast ? videoBeast->getFrameCount() : 0,
+                uart.bytes_transferred);
+}
+
+// Where rewind checkpoints find memory, which moves if the ROM does
+void Machine::setRewindMemory() {
+  rewind.setMemory(rom, ROM_SIZE, ram, RAM_SIZE, videoRam,
+                   videoBeast ? VideoBeast::VIDEO_RAM_LENGTH : 0);
+}
+
+void Machine::initVideoBeast() {
+  videoRam = videoBeast->memoryPtr();
+  videoBeast->init(clock_time_ps);
+  scheduler.schedule(Scheduler::VIDEOBEAST, 0);
+  setRewindMemory();
+}
+
+void Machine::reset() {
+  z80_reset(&cpu);
+  uart_reset(&uart, UART_CLOCK_HZ);
+  scheduler.schedule(Scheduler::UART, uart_next_tick(&uart));
+  devicesSettling = true;
+  keySet.clear();
+  pagingEnabled = false;
+  for (int i = 0; i < 4; i++) {
+    memoryPage[i] = 0;
+  }
+  updateBanks();
+  historyCount = 0;
+
+  debugManager->clearAllLogs();
+  tickCount = 0;
+  pacer.resetFrame();
+  busyWait.reset();
+  // Checkpoints and inputs are found by cycle count, which starts again from zero
+  rewind.clear();
+  stopJournal();
+  onRestore();
+}
+
+// A sampleRate of 0 leaves the speaker unsampled, as when nothing is playing it
+void Machine::setAudio(int sampleRate, int volume) {
+  audioSampleRatePs = sampleRate > 0 ? ONE_SECOND_PS / sampleRate : 0;
+  this->volume = volume;
+}
+
+void Machine::loadSamples(int16_t *stream, int length) {
+  std::fill(stream, stream + length, audioLastSample);
+
+  if (audioAvailable < length)
+    return;
+
+  int block1Length = length;
+  int block2Length = 0;
+  if (audioRead + length > AUDIO_BUFFER_SIZE) {
+    block1Length = AUDIO_BUFFER_SIZE - audioRead;
+    block2Length = length - block1Length;
+  }
+
+  memcpy(stream, audioBuffer + audioRead, block1Length * 2);
+  memcpy(stream + block1Length, audioBuffer, block2Length * 2);
+
+  audioLastSample = audioBuffer[((audioRead + length - 1) % AUDIO_BUFFER_SIZE)];
+
+  audioRead = (audioRead + length) % AUDIO_BUFFER_SIZE;
+  audioAvailable -= length;
+  if (audioFile) {
+    fwrite(stream, 2, length, audioFile);
+  }
+}
+
+uint8_t *Machine::getRom() { return rom; }
+
+uint8_t *Machine::getRam() { return ram; }
+
+Digit *Machine::getDigit(int index) { return &display[index]; }
+
+static void onHeadlessSignal(int) { headlessStopRequested = 1; }
+
+void Machine::headlessLoop() {
+  std::signal(SIGINT, onHeadlessSignal);
+  std::signal(SIGTERM, onHeadlessSignal);
+
+  std::cout << "Running headless, interrupt to stop" << std::endl;
+
+  auto start = std::chrono::steady_clock::now();
+  stopReason = STOP_NONE;
+  while (stopReason == STOP_NONE && !headlessStopRequested) {
+    run(true);
+  }
+  double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  while (!z80_opdone(&cpu)) {
+    run(false);
+  }
+  printMachineState(duration);
+}
+
+void Machine::printMachineState(double duration) {
+  const char *reason = "interrupted";
+  if (stopReason == STOP_BREAKPOINT) {
+    reason = "breakpoint";
+  } else if (stopReason == STOP_WATCHPOINT) {
+    reason = "watchpoint";
+  }
+
+  std::cout << std::endl << "Stopped (" << reason << ") after " << tickCount
+            << " cycles in " << std::setprecision(2) << std::fixed << duration
+            << "s" << std::endl;
+  pacer.report(targetSpeedHz);
+  std::cout << std::hex << std::uppercase << std::setfill('0');
+  std::cout << "PC " << std::setw(4) << (uint16_t)(cpu.pc - 1) << " SP "
+            << std::setw(4) << cpu.sp << " AF " << std::setw(4) << cpu.af
+            << " BC " << std::setw(4) << cpu.bc << " DE " << std::setw(4)
+            << cpu.de << " HL " << std::setw(4) << cpu.hl << " IX "
+            << std::setw(4) << cpu.ix << " IY " << std::setw(4) << cpu.iy
+            << std::endl;
+  std::cout << "Paging " << (pagingEnabled ? "on" : "off") << " pages";
+  for (int i = 0; i < 4; i++) {
+    std::cout << " " << std::setw(2) << (int)memoryPage[i];
+  }
+  std::cout << std::endl << "Display";
+  for (int i = 0; i < DISPLAY_CHARS; i++) {
+    std::cout << " " << std::setw(4) << display[i].getSegments();
+  }
+  std::cout << std::dec << std::setfill(' ') << std::endl;
+}
+
+void Machine::updateBanks() {
+  for (int i = 0; i < 4; i++) {
+    MemoryBank &bank = banks[i];
+    int page = memoryPage[i];
+    // Watchpoints always compare against the selected page, even with paging off
+    bank.physicalBase = page << 14;
+
+    if (!pagingEnabled) {
+      // Flat 64K ROM address space
+      bank.kind = MemoryBank::ROM;
+      bank.mappedBase = i << 14;
+    } else {
+      // Array index uses bank-relative address (page & 0x1F)
+      bank.mappedBase = (page & 0x1F) << 14;
+      if ((page & 0xE0) == 0x20) {
+        bank.kind = MemoryBank::RAM;
+      } else if (videoBeast && (page & 0xE0) == 0x40) {
+        bank.kind = MemoryBank::VIDEO;
+      } else {
+        bank.kind = MemoryBank::ROM;
+      }
+    }
+
+    if (bank.kind == MemoryBank::RAM) {
+      bank.host = ram + bank.mappedBase;
+    } else if (bank.kind == MemoryBank::ROM) {
+      bank.host = rom + bank.mappedBase;
+    } else {
+      bank.host = nullptr;
+    }
+  }
+  updateCpuBanks();
+}
+
+// Hand plain RAM and ROM to the Z80 core, so it reads and writes them without
+// returning the access on the pins. Flash status reads and VideoBeast stay
+// with memoryRead() and memoryWrite().
+void Machine::updateCpuBanks() {
+  uint8_t *read[4];
+  uint8_t *write[4];
+  for (int i = 0; i < 4; i++) {
+    const MemoryBank &bank = banks[i];
+    bool plain = bank.kind == MemoryBank::RAM ||
+                 (bank.kind == MemoryBank::ROM && !romOperation);
+    read[i] = inlineMemory && plain ? bank.host : nullptr;
+    write[i] = inlineMemory && bank.kind == MemoryBank::RAM ? bank.host : nullptr;
+  }
+  z80_set_banks(&cpu, read, write);
+}
+
+// Hand RAM written inside z80_tick() on to the busy wait and rewind tracking
+void Machine::flushBankWrites() {
+  for (int i = 0; i < 4; i++) {
+    if (cpu.bank_written & (1 << i)) {
+      rewind.written(ROM_SIZE + banks[i].mappedBase);
+    }
+  }
+  cpu.bank_written = 0;
+  busyWait.taint();
+}
+
+void Machine::tickDevices() {
+  uint8_t lastPortB = portB;
+  uint64_t lastInt = pins & Z80_INT;
+
+  pins |= Z80_IEIO;
+
+  if ((pins & PIO_SEL_MASK) == PIO_SEL_PINS) {
+    pins |= Z80PIO_CE;
+  }
+  if (pins & Z80_A0) {
+    pins |= Z80PIO_BASEL;
+  }
+  if (pins & Z80_A1) {
+    pins |= Z80PIO_CDSEL;
+  }
+
+  Z80PIO_SET_PAB(pins, 0xFF, portB); /// Set uart_int, i2c_clk, i2c_data
+
+  {
+    PROFILE(PIO);
+    uint64_t timer = stats.startTimer();
+    pins = z80pio_tick(&pio, pins);
+    stats.stopTimer(Stats::DEVICE_PIO, timer);
+  }
+  {
+    PROFILE(I2C);
+    uint64_t timer = stats.startTimer();
+    i2c->tick(&pins, clock_time_ps);
+    stats.stopTimer(Stats::DEVICE_I2C, timer);
+  }
+  {
+    PROFILE(RTC);
+    uint64_t timer = stats.startTimer();
+    scheduler.schedule(Scheduler::RTC, rtc->tick(&pins, clock_time_ps));
+    stats.stopTimer(Stats::DEVICE_RTC, timer);
+  }
+
+  pins = (pins & ~Z80_INT) | ((pins & Z80PIO_INT) ? Z80_INT : 0);
+
+  portB = Z80PIO_GET_PB(pins);
+  portB &= ~0x10; // Clear the UART int pin...
+
+  portPins = pins;
+
+  // A change on port B or INT must be seen by the devices on the next cycle
+  devicesSettling = (portB != lastPortB) || ((pins & Z80_INT) != lastInt);
+}
+
+// Stops the run at the end of the current cycle or instruction
+void Machine::checkWatchpoint(const MemoryBank &bank, uint16_t address,
+                            bool isRead) {
+  PROFILE(DEBUG);
+  // Always use physical address based on current page mappings
+  uint32_t physicalAddr = bank.physicalBase | (address & 0x3FFF);
+  if (debugManager->checkWatchpoint(address, physicalAddr, isRead,
+                                    watchpointTriggerIndex)) {
+    stopReason = STOP_WATCHPOINT;
+    // Use tracked instruction start PC for accurate trigger address
+    watchpointTriggerAddress = currentInstructionPC;
+    watchpointHit = true;
+    onBreak();
+  }
+}
+
+template <bool Watch>
+uint8_t Machine::memoryRead(uint16_t address) {
+  PROFILE(MEMORY);
+  const MemoryBank &bank = banks[address >> 14];
+  const uint16_t offset = address & 0x3FFF;
+  const uint32_t mappedAddr = bank.mappedBase | offset;
+
+  if (Watch) {
+    checkWatchpoint(bank, address, true);
+  }
+
+  if (bank.kind == MemoryBank::RAM ||
+      (bank.kind == MemoryBank::ROM && !romOperation)) {
+    return bank.host[offset];
+  } else if (bank.kind == MemoryBank::VIDEO) {
+    busyWait.taint();
+    return videoBeast->read(mappedAddr, clock_time_ps);
+  }
+
+  // Flash reads return toggling status bits until the operation completes
+  busyWait.taint();
+  if (clock_time_ps >= romCompletePs) {
+    romSequence = 0;
+    romOperation = false;
+    updateCpuBanks();
+    return rom[mappedAddr];
+  }
+  uint8_t data = rom[mappedAddr] ^ romOperationMask;
+  romOperationMask ^= 0x40;
+  return data;
+}
+
+template <bool Watch>
+void Machine::memoryWrite(uint16_t address, uint8_t data) {
+  PROFILE(MEMORY);
+  const MemoryBank &bank = banks[address >> 14];
+  const uint16_t offset = address & 0x3FFF;
+  const uint32_t mappedAddr = bank.mappedBase | offset;
+
+  if (Watch) {
+    checkWatchpoint(bank, address, false);
+  }
+
+  if (bank.kind == MemoryBank::RAM) {
+    // Pushing the same return address each pass changes nothing
+    if (bank.host[offset] != data) {
+      busyWait.taint();
+      blockCache.written(ROM_SIZE + bank.mappedBase);
+      rewind.written(ROM_SIZE + bank.mappedBase);
+    }
+    bank.host[offset] = data;
+    return;
+  } else if (bank.kind == MemoryBank::VIDEO) {
+    videoBeast->write(mappedAddr, data, clock_time_ps);
+    busyWait.taint();
+    return;
+  }
+
+  busyWait.taint();
+  if (romSequence == 3 && clock_time_ps >= romCompletePs) {
+    romSequence = 0;
+    romOperation = false;
+  }
+
+  switch (romSequence) {
+  case 0:
+    if (mappedAddr == 0x5555 && data == 0xaa) {
+      romSequence = 1;
+    } else {
+      romSequence = 0;
+    }
+    break;
+  case 1:
+    if (mappedAddr == 0x2AAA && data == 0x55) {
+      romSequence = 2;
+    } else {
+      romSequence = 0;
+    }
+    break;
+  case 2:
+    if (mappedAddr == 0x5555 && ((data & 0xF0) != 0)) {
+      romSequence = data;
+    } else {
+      romSequence = 0;
+    }
+    break;
+  case 3:
+    break;
+  case 0xA0:
+    ownRom();
+    rom[mappedAddr] = data;
+    blockCache.written(mappedAddr);
+    rewind.written(mappedAddr);
+    flash.written(mappedAddr);
+    romOperation = true;
+    romCompletePs = clock_time_ps + ROM_BYTE_WRITE_PS;
+    romSequence = 3;
+    break;
+  case 0x80:
+    if (mappedAddr == 0x5555 && data == 0xaa) {
+      romSequence = 0x81;
+    } else {
+      romSequence = 0;
+    }
+    break;
+  case 0x81:
+    if (mappedAddr == 0x2AAA && data == 0x55) {
+      romSequence = 0x82;
+    } else {
+      romSequence = 0;
+    }
+    break;
+  case 0x82:
+    if (mappedAddr == 0x5555 && data == 0x10) { // Chip erase
+      std::cout << "Erasing chip " << std::endl;
+      ownRom();
+      for (int i = 1 << 19; i > 0;) {
+        rom[--i] = 0xFF;
+      }
+      blockCache.invalidate();
+      rewind.allWritten();
+      flash.allWritten();
+      romOperation = true;
+      romCompletePs = clock_time_ps + ROM_CHIP_ERASE_PS;
+      romSequence = 3;
+    } else if (data == 0x30) { // Sector erase
+      uint32_t sectorAddress = mappedAddr & ~0x0FFFULL;
+      std::cout << "Erasing sector " << (sectorAddress >> 12) << std::endl;
+      ownRom();
+      for (int i = 0; i < 0x1000; i++) {
+        rom[sectorAddress + i] = 0xFF;
+      }
+      blockCache.written(sectorAddress);
+      rewind.written(sectorAddress);
+      flash.written(sectorAddress);
+      romOperation = true;
+      romCompletePs = clock_time_ps + ROM_SECTOR_ERASE_PS;
+      romSequence = 3;
+    } else {
+      romSequence = 0;
+    }
+    break;
+  default:
+    romSequence = 0;
+  }
+  updateCpuBanks();
+}
+
+// IO input, once the PIO has had the chance to drive busData
+uint8_t Machine::portRead(uint16_t port, uint8_t busData) {
+  if ((port & 0xF0) == 0x00) {
+    uint8_t data = readKeyboard(port);
+    busyWait.input(data);
+    return data;
+  } else if ((port & 0xF0) == 0x20) {
+    uint8_t data = uart_read(&uart, port & 0x07);
+    busyWait.input(data);
+    scheduler.schedule(Scheduler::UART, uart_next_tick(&uart));
+    return data;
+  }
+  busyWait.taint();
+  return busData;
+}
+
+void Machine::portWrite(uint16_t port, uint8_t data) {
+  busyWait.taint();
+  if ((port & 0x0F0) == 0x70) {
+    // Memory system.
+    if ((port & 0x04) == 0) {
+      memoryPage[port & 0x03] = data;
+    } else {
+      pagingEnabled = (data & 0x01) != 0;
+    }
+    updateBanks();
+  } else if ((port & 0xF0) == 0x20) {
+    uart_write(&uart, port & 0x07, data, clock_time_ps);
+    scheduler.schedule(Scheduler::UART, uart_next_tick(&uart));
+  }
+}
+
+// The fast engine makes each IO cycle in one go, so the devices see it here
+uint8_t Machine::ioRead(uint16_t port) {
+  PROFILE(IO);
+  pins = (pins & Z80_PIN_MASK & ~(Z80_CTRL_PIN_MASK | 0xFFFFULL)) | Z80_IORQ |
+         Z80_RD | port;
+  tickDevices();
+  return portRead(port, Z80_GET_DATA(pins));
+}
+
+void Machine::ioWrite(uint16_t port, uint8_t data) {
+  PROFILE(IO);
+  pins = (pins & Z80_PIN_MASK & ~(Z80_CTRL_PIN_MASK | 0xFFFFFFULL)) |
+         Z80_IORQ | Z80_WR | port | ((uint64_t)data << 16);
+  tickDevices();
+  portWrite(port, data);
+}
+
+uint8_t Machine::interruptAcknowledge() {
+  pins = (pins & Z80_PIN_MASK & ~Z80_CTRL_PIN_MASK) | Z80_M1 | Z80_IORQ;
+  tickDevices();
+  busyWait.taint();
+  return Z80_GET_DATA(pins);
+}
+
+void Machine::interruptReturn() {
+  pins |= Z80_RETI;
+  tickDevices();
+  pins &= ~Z80_RETI;
+}
+
+// Headless, the only events are a new connection to the UART and being interrupted
+bool Machine::onFrame() {
+  if (headlessStopRequested) {
+    return false;
+  }
+  if (!uart_connected(&uart)) {
+    uart_connect(&uart, true);
+  }
+  return true;
+}
+
+void Machine::run(bool run) {
+  runUntil(StopCondition{run ? StopCondition::FOREVER : StopCondition::TICK});
+}
+
+// Checked at each instruction boundary. OUT and TAKEN look at the instruction
+// about to execute, and stop once it has completed.
+bool Machine::stopReached(const StopCondition &stop, bool &pending) {
+  switch (stop.kind) {
+  case StopCondition::INSTRUCTION:
+    return true;
+  case StopCondition::ADDRESS:
+    return cpu.pc == stop.address;
+  case StopCondition::OUT:
+    if (pending) {
+      return true;
+    }
+    pending = instr->isOut(readMem(cpu.pc - 1), readMem(cpu.pc));
+    return false;
+  case StopCondition::TAKEN:
+    if (pending) {
+      return true;
+    }
+    if ((uint16_t)(cpu.pc - 1) == stop.address) {
+      pending = instr->isTaken(readMem(cpu.pc - 1), readMem(cpu.pc), cpu.f);
+    }
+    return false;
+  case StopCondition::UART:
+    return uart.bytes_transferred != uartMark;
+  default:
+    return false;
+  }
+}
+
+void Machine::runUntil(StopCondition stop) {
+  // Only a free run is held to real time, stepping runs as fast as it can
+  bool paced = stop.kind == StopCondition::FOREVER;
+  bool pending = false;
+  uint64_t cycleLimit =
+      stop.cycleLimit ? tickCount + stop.cycleLimit : UINT64_MAX;
+  uartMark = uart.bytes_transferred;
+
+  if (paced) {
+    pacer.start(clock_time_ps);
+    restartStats();
+  }
+  profiler.restart();
+  // Memory may have been edited while stopped
+  busyWait.reset();
+  blockCache.invalidate();
+  if (z80_opdone(&cpu) &&
+      (stop.kind == StopCondition::OUT || stop.kind == StopCondition::TAKEN)) {
+    stopReached(stop, pending);
+  }
+
+  lastAudioSamplePs = clock_time_ps;
+  if (audioSampleRatePs != 0) {
+    scheduler.schedule(Scheduler::AUDIO, lastAudioSamplePs + audioSampleRatePs + 1);
+  }
+
+  // Pick the loop built for what is switched on, and pick again if that changes
+  while ((this->*RUN_LOOPS[runConfig()])(stop, paced, pending, cycleLimit)) {
+  }
+}
+
+int Machine::runConfig() {
+  return (engine == ENGINE_FAST ? RUN_FAST : 0) |
+         (debugManager->hasActiveBreakpoints() ? RUN_BREAKPOINTS : 0) |
+         (debugManager->hasActiveWatchpoints() ? RUN_WATCHPOINTS : 0);
+}
+
+const Machine::RunLoop Machine::RUN_LOOPS[RUN_CONFIGS] = {
+    &Machine::runLoop<0>, &Machine::runLoop<1>, &Machine::runLoop<2>,
+    &Machine::runLoop<3>, &Machine::runLoop<4>, &Machine::runLoop<5>,
+    &Machine::runLoop<6>, &Machine::runLoop<7>};
+
+// Returns true if it stopped only because runConfig() changed
+template <int Config>
+bool Machine::runLoop(const StopCondition &stop, bool paced, bool &pending,
+                    uint64_t cycleLimit) {
+  const bool watch = (Config & RUN_WATCHPOINTS) != 0;
+  // The core can only take over memory accesses nothing else needs to see
+  const bool inlined = !(Config & (RUN_FAST | RUN_WATCHPOINTS));
+  FastBus<Config> bus{*this};
+  Z80Fast<FastBus<Config>> fast(cpu, pins, bus);
+  bool run = true;
+  bool reconfigure = false;
+
+  inlineMemory = inlined;
+  updateCpuBanks();
+
+  do {
+    int cycles = 1;
+    if ((Config & RUN_FAST) && stop.kind != StopCondition::TICK &&
+        z80_opdone(&cpu)) {
+      cycles = stepInstruction(fast);
+    } else {
+      clock_time_ps += clock_cycle_ps;
+
+      {
+        PROFILE(Z80);
+        pins = z80_tick(&cpu, pins) & Z80_PIN_MASK;
+      }
+
+      // The PIO and I2C devices only change state on IO cycles, RETI, RTC
+      // events, or while port B is still settling after a previous change
+      bool due = clock_time_ps >= scheduler.nextDeadline();
+      if ((pins & (Z80_IORQ | Z80_RETI)) || devicesSettling ||
+          (due && scheduler.isDue(Scheduler::RTC, clock_time_ps))) {
+        tickDevices();
+      }
+
+      if (due && scheduler.isDue(Scheduler::UART, clock_time_ps)) {
+        PROFILE(UART);
+        uint64_t timer = stats.startTimer();
+        scheduler.schedule(Scheduler::UART, uart_tick(&uart, clock_time_ps));
+        stats.stopTimer(Stats::DEVICE_UART, timer);
+      }
+
+      if (pins & Z80_MREQ) {
+        const uint16_t addr = Z80_GET_ADDR(pins);
+        if (pins & Z80_RD) {
+          Z80_SET_DATA(pins, memoryRead<watch>(addr));
+        } else if (pins & Z80_WR) {
+          memoryWrite<watch>(addr, Z80_GET_DATA(pins));
+        }
+      } else if (pins & Z80_IORQ) {
+        PROFILE(IO);
+        // The devices have already seen this cycle
+        const uint16_t port = Z80_GET_ADDR(pins);
+        if (pins & Z80_RD) {
+          Z80_SET_DATA(pins, portRead(port, Z80_GET_DATA(pins)));
+        } else if (pins & Z80_WR) {
+          portWrite(port, Z80_GET_DATA(pins));
+        } else {
+          // Interrupt acknowledge
+          busyWait.taint();
+        }
+      }
+
+      if (due && scheduler.isDue(Scheduler::VIDEOBEAST, clock_time_ps)) {
+        PROFILE(VIDEOBEAST);
+        uint64_t timer = stats.startTimer();
+        scheduler.schedule(Scheduler::VIDEOBEAST, videoBeast->tick(clock_time_ps));
+        stats.stopTimer(Stats::DEVICE_VIDEOBEAST, timer);
+      }
+
+      if (due && scheduler.isDue(Scheduler::AUDIO, clock_time_ps)) {
+        sampleAudio();
+      }
+    }
+
+    if (watch && watchpointHit) {
+      watchpointHit = false;
+      run = false;
+    }
+
+    if (pacer.tick(cycles)) {
+      profiler.onFrame();
+      checkpointDue = rewind.isEnabled() && !replaying;
+      if (paced) {
+        {
+          PROFILE(IDLE);
+          pacer.pace(clock_time_ps);
+        }
+        updateStats();
+      }
+      PROFILE(EVENTS);
+      if (!onFrame()) {
+        run = false;
+      }
+      journalKeys();
+      // Inputs from before the oldest checkpoint can no longer be replayed
+      journal.forget(rewind.count() ? rewind.at(0).tickCount : tickCount);
+      flash.sync();
+      reconfigure = runConfig() != Config;
+    }
+    tickCount += cycles;
+    if (z80_opdone(&cpu)) {
+      // Track the PC for the next instruction (used for accurate watchpoint
+      // trigger address)
+      currentInstructionPC = cpu.pc - 1;
+      history[historyIndex] = currentInstructionPC;
+      historyIndex = (historyIndex+1) % HISTORY_SIZE;
+      if (historyCount<HISTORY_SIZE) historyCount++;
+
+      // Check all breakpoints (user + system) via DebugManager
+      const Breakpoint *bp = nullptr;
+      if (Config & RUN_BREAKPOINTS) {
+        PROFILE(DEBUG);
+        bp = debugManager->checkBreakpoint(cpu.pc - 1, memoryPage);
+      }
+      if (bp) {
+        if (bp->isTrace ) {
+          int page = memoryPage[(currentInstructionPC >> 14) & 0x03];
+          uint32_t physicalAddr = (currentInstructionPC & 0x3FFF) | (page << 14);
+
+          if (!replaying) {
+            debugManager->logTrace(bp, cpu, physicalAddr, memoryPage, pagingEnabled, tickCount, [this](uint16_t address){ return this->readMem(address); });
+          }
+        } else {
+          stopReason = STOP_BREAKPOINT;
+          run = false;
+          onBreak();
+        }
+      }
+
+      if (run && (stopReached(stop, pending) || tickCount >= cycleLimit)) {
+        run = false;
+      }
+
+      if (bp || (inlined && cpu.bank_written)) {
+        flushBankWrites();
+      }
+      if (checkpointDue) {
+        takeCheckpoint();
+      }
+      bool looped = busyWait.boundary(currentInstructionPC, cpu, tickCount);
+
+      if (run && !bp && stop.kind != StopCondition::TICK) {
+        if (pins & Z80_HALT) {
+          fastForwardHalt(cycleLimit);
+        } else if (looped) {
+          fastForwardLoop(cycleLimit);
+        }
+        // Skipping can land right on the limit, which is a boundary like any other
+        if (tickCount >= cycleLimit) {
+          run = false;
+        }
+      }
+    }
+  } while (run && !reconfigure && stop.kind != StopCondition::TICK);
+
+  if (inlined) {
+    // RAM written inside the core never bumped the block cache's generations
+    blockCache.invalidate();
+    flushBankWrites();
+  }
+  return run && reconfigure && stop.kind != StopCondition::TICK;
+}
+
+void Machine::sampleAudio() {
+  lastAudioSamplePs += audioSampleRatePs;
+  scheduler.schedule(Scheduler::AUDIO, lastAudioSamplePs + audioSampleRatePs + 1);
+  // Faster than real time only every Nth sample is kept, and none at max speed
+  // or when replaying history, so playback keeps pace without overrunning the buffer
+  bool keepSample = false;
+  if (speedMultiplier != SPEED_MAX && !replaying &&
+      ++audioDecimation >= speedMultiplier) {
+    audioDecimation = 0;
+    keepSample = true;
+  }
+  PROFILE(AUDIO);
+  uint64_t timer = stats.startTimer();
+  int next = (audioWrite + 1) % AUDIO_BUFFER_SIZE;
+  if (keepSample && next != audioRead) {
+    audioBuffer[audioWrite] = (uart.modem_control_register & MCR_OUT2)
+                                  ? 400 * volume
+                                  : -400 * volume;
+    audioWrite = next;
+    audioAvailable++;
+  } else if (keepSample) {
+    stats.audioSampleDropped();
+  }
+  stats.stopTimer(Stats::DEVICE_AUDIO, timer);
+}
+
+// Run the instruction fetched at this boundary in one go. Its memory and IO
+// accesses all happen at the clock time it started, and the clocked devices
+// catch up at the end of it. Returns the T-states taken.
+template <int Config>
+int Machine::stepInstruction(Z80Fast<FastBus<Config>> &fast) {
+  // Operands come from the block cache, unless reads of them could be seen
+  const uint8_t *operands = nullptr;
+  const MemoryBank &bank = banks[((cpu.pc - 1) >> 14) & 0x03];
+  if (!(Config & RUN_WATCHPOINTS) &&
+      (bank.kind == MemoryBank::RAM ||
+       (bank.kind == MemoryBank::ROM && !romOperation))) {
+    // Keyed by where the code really is, physicalBase may alias it
+    uint32_t physical = (bank.kind == MemoryBank::RAM ? ROM_SIZE : 0) |
+                        bank.mappedBase | ((cpu.pc - 1) & 0x3FFF);
+    const BlockCache::Instruction *instruction =
+        blockCache.find(physical, bank.host);
+    if (instruction && instruction->code[0] == Z80_GET_DATA(pins)) {
+      operands = instruction->code + 1;
+    }
+  }
+
+  int cycles;
+  {
+    PROFILE(Z80);
+    cycles = fast.step(operands);
+  }
+  clock_time_ps += cycles * clock_cycle_ps;
+
+  bool due = clock_time_ps >= scheduler.nextDeadline();
+  if (devicesSettling || (due && scheduler.isDue(Scheduler::RTC, clock_time_ps))) {
+    tickDevices();
+  }
+  if (!due) {
+    return cycles;
+  }
+  if (scheduler.isDue(Scheduler::UART, clock_time_ps)) {
+    PROFILE(UART);
+    uint64_t timer = stats.startTimer();
+    scheduler.schedule(Scheduler::UART, uart_tick(&uart, clock_time_ps));
+    stats.stopTimer(Stats::DEVICE_UART, timer);
+  }
+  if (scheduler.isDue(Scheduler::VIDEOBEAST, clock_time_ps)) {
+    PROFILE(VIDEOBEAST);
+    uint64_t timer = stats.startTimer();
+    scheduler.schedule(Scheduler::VIDEOBEAST, videoBeast->tick(clock_time_ps));
+    stats.stopTimer(Stats::DEVICE_VIDEOBEAST, timer);
+  }
+  if (scheduler.isDue(Scheduler::AUDIO, clock_time_ps)) {
+    sampleAudio();
+  }
+  return cycles;
+}
+
+// Called at the start of each pass through HALT. Every pass fetches the same
+// opcode and bumps R, nothing else, so whole passes can be skipped.
+void Machine::fastForwardHalt(uint64_t cycleLimit) {
+  const uint64_t HALT_CYCLES = 4;
+
+  // Flash status reads and VideoBeast reads can change state
+  const MemoryBank &bank = banks[((cpu.pc - 1) >> 14) & 0x03];
+  if (bank.kind != MemoryBank::RAM &&
+      (bank.kind != MemoryBank::ROM || romOperation)) {
+    return;
+  }
+
+  fastForward(HALT_CYCLES, 1, &currentInstructionPC, 1, cycleLimit);
+}
+
+// Called at the head of a polling loop that busyWait has seen repeat unchanged
+void Machine::fastForwardLoop(uint64_t cycleLimit) {
+  if (fastForward(busyWait.passCycles(), busyWait.passRefresh(),
+                  busyWait.passTrace(), busyWait.passLength(), cycleLimit)) {
+    busyWait.skipped(cpu, tickCount);
+  }
+}
+
+// Skip whole passes of a side-effect free loop, up to the next event that
+// could raise an interrupt or change an input: an RTC edge, a VideoBeast line,
+// a busy UART bit clock, the end of the frame or the next journaled input.
+// Live keys only arrive at frame boundaries or between runs, and an idle UART
+// next polls for input after the skip. Returns false if no passes could be skipped.
+bool Machine::fastForward(uint64_t passCycles, uint8_t passRefresh,
+                        const uint16_t *trace, int traceLength,
+                        uint64_t cycleLimit) {
+  if (devicesSettling || (cpu.iff1 && (pins & Z80_INT)) ||
+      debugManager->hasActiveWatchpoints()) {
+    return false;
+  }
+
+  bool uartIdle = uart_idle(&uart);
+  uint64_t until = std::min(scheduler.deadline(Scheduler::RTC),
+                            scheduler.deadline(Scheduler::VIDEOBEAST));
+  if (!uartIdle) {
+    until = std::min(until, scheduler.deadline(Scheduler::UART));
+  }
+  if (inputFromJournal()) {
+    uint64_t next = journal.nextTick();
+    if (next <= tickCount) {
+      return false;
+    }
+    if (next != UINT64_MAX) {
+      until = std::min(until, clock_time_ps + (next - tickCount) * clock_cycle_ps);
+    }
+  }
+  if (until <= clock_time_ps) {
+    return false;
+  }
+
+  uint64_t passes = (until - clock_time_ps - 1) / (clock_cycle_ps * passCycles);
+  passes = std::min(passes, pacer.cyclesToFrame() / passCycles);
+  passes = std::min(passes, (cycleLimit - tickCount) / passCycles);
+  if (passes == 0) {
+    return false;
+  }
+
+  uint64_t cycles = passes * passCycles;
+  clock_time_ps += cycles * clock_cycle_ps;
+  tickCount += cycles;
+  pacer.skip(cycles);
+  cpu.r = (cpu.r & 0x80) | ((cpu.r + passes * passRefresh) & 0x7F);
+
+  // Only the last HISTORY_SIZE instructions are still in the history
+  uint64_t traced = passes * traceLength;
+  uint64_t kept = std::min(traced, (uint64_t)HISTORY_SIZE);
+  historyIndex = (historyIndex + traced - kept) % HISTORY_SIZE;
+  for (uint64_t i = traced - kept; i < traced; i++) {
+    history[historyIndex] = trace[i % traceLength];
+    historyIndex = (historyIndex+1) % HISTORY_SIZE;
+    if (historyCount<HISTORY_SIZE) historyCount++;
+  }
+
+  if (uartIdle) {
+    scheduler.schedule(Scheduler::UART, uart_skip_idle(&uart, clock_time_ps));
+  }
+  while (scheduler.isDue(Scheduler::AUDIO, clock_time_ps)) {
+    sampleAudio();
+  }
+  return true;
+}
+
+// Run on to the end of the current instruction, if stopped part way through
+void Machine::finishInstruction() {
+  if (!z80_opdone(&cpu)) {
+    runUntil(StopCondition{StopCondition::INSTRUCTION});
+  }
+}
+
+uint8_t Machine::readKeyboard(uint16_t port) {
+  uint8_t result = 0x3F;
+
+  if (inputFromJournal()) {
+    journalKeys();
+  }
+
+  for (int key : keySet) {
+    int row = key / 12;
+    int col = key % 12;
+    if (col >= 6) {
+      // Right hand side...
+      if (((port >> (row + 12)) & 0x01) == 0) {
+        result &= ~(0x01 << (col - 6));
+      }
+    } else {
+      if (((port >> (11 - row)) & 0x01) == 0) {
+        result &= ~(0x020 >> (col));
+      }
+    }
+  }
+  return result;
+}
+
+void Machine::writeMem(int page, uint16_t address, uint8_t data) {
+  if (page < 0) {
+    page = memoryPage[(address >> 14) & 0x03];
+  }
+
+  uint32_t mappedAddr = (address & 0x3FFF) | ((page & 0x1F) << 14);
+
+  if ((page & 0xE0) == 0x20) {
+    ram[mappedAddr] = data;
+    rewind.written(ROM_SIZE + mappedAddr);
+  } else if ((page & 0xE0) == 0x40) {
+    if (videoBeast) {
+      videoBeast->write(address, data, clock_time_ps);
+    }
+  } else {
+    ownRom();
+    rom[mappedAddr] = data;
+    rewind.written(mappedAddr);
+    flash.written(mappedAddr);
+  }
+}
+
+uint8_t Machine::readMem(uint16_t address) {
+  int page = pagingEnabled ? memoryPage[(address >> 14) & 0x03] : 0;
+  return readPage(page, address);
+}
+
+uint8_t Machine::readPage(int page, uint16_t address) {
+  bool isRam = (page & 0xE0) == 0x20;
+  if (!isRam && ((page & 0xE0) == 0x40)) {
+    // Videobeast
+    if (videoBeast) {
+      return videoBeast->read(address, clock_time_ps);
+    } else {
+      return 0;
+    }
+  }
+  uint32_t mappedAddr = (address & 0x3FFF) | (page & 0x1F) << 14;
+  return isRam ? ram[mappedAddr] : rom[mappedAddr];
+}
@@ -0,0 +1,362 @@
+#pragma once
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "z80.h"
+#include "z80pio.h"
+#include "digit.hpp"
+#include "i2c.hpp"
+#include "display.hpp"
+#include "rtc.hpp"
+#include "uart16c550.h"
+#include "listing.hpp"
+#include "binaryFile.hpp"
+#include "instructions.hpp"
+#include "videobeast.hpp"
+#include "debugmanager.hpp"
+#include "scheduler.hpp"
+#include "pacer.hpp"
+#include "stats.hpp"
+#include "profiler.hpp"
+#include "busywait.hpp"
+#include "z80fast.hpp"
+#include "blockcache.hpp"
+#include "savestate.hpp"
+#include "rewind.hpp"
+#include "journal.hpp"
+#include "flashimage.hpp"
+#include "fanout.hpp"
+#include "bootcache.hpp"
+#include "testrunner.hpp"
+
+#define BEASTEM_VERSION "1.3rc2"
+
+#define BEAST_IO_MASK (Z80_M1|Z80_IORQ|Z80_A7|Z80_A6|Z80_A5|Z80_A4)
+
+#define BEAST_IO_SEL_PINS (Z80_IORQ)
+
+#define PIO_SEL_MASK  (BEAST_IO_MASK)
+#define PIO_SEL_PINS  (BEAST_IO_SEL_PINS|Z80_A4)
+
+/**
+ * machine.hpp - The MicroBeast itself, with no window, sound or network of its own
+ *
+ * The CPU, PIO and UART wired to memory, the flash ROM, the I2C displays and clock,
+ * and VideoBeast if there is one, along with the debugger's breakpoints and the
+ * history kept for stepping backwards. Beast puts a window on it; on its own it
+ * runs headless for tests, benchmarks and the like:
+ *
+ *   Machine machine(listing, {BinaryFile("flash.bin", 0, false)});
+ *   machine.init(8000000, Machine::NOT_SET, nullptr);
+ *   machine.runUntil(Machine::StopCondition{Machine::StopCondition::ADDRESS, 0x0344});
+ *   uint8_t a = machine.getCpu().a;
+ */
+class Machine {
+
+    public:
+        enum StopReason {STOP_NONE, STOP_STEP, STOP_BREAKPOINT, STOP_WATCHPOINT, STOP_ESCAPE};
+
+        static const int ROM_SIZE = 1<<19;
+        static const int RAM_SIZE = 1<<19;
+
+        Machine(Listing &listing, std::vector<BinaryFile> files);
+        virtual ~Machine();
+
+        // Load the binaries and listings, with VideoBeast if it is given
+        void init(uint64_t targetSpeedHz, uint64_t breakpoint, VideoBeast *videoBeast);
+        void setSpeedMultiplier(int multiplier);
+
+        // CPU emulation: every T-state through z80_tick(), or whole instructions at a time
+        enum Engine {ENGINE_CYCLE, ENGINE_FAST};
+        void setEngine(Engine engine);
+        bool openStatsFile(const char *filename);
+        // Memory kept for stepping backwards, 0 to keep no history
+        void setRewindBudget(size_t megabytes);
+
+        // Snapshot the whole machine to a file, or restore one, while stopped
+        bool saveState(const char *filename);
+        bool loadState(const char *filename);
+        // Write every input to a journal as it arrives, or take inputs from one recorded earlier
+        bool recordJournal(const char *filename);
+        bool replayJournal(const char *filename);
+        // Keep the ROM in this file, so flash programming persists. Call before init()
+        bool openFlashImage(const char *filename);
+        // Listen for UART connections on this port, 0 for none. Call before init()
+        void setUartPort(int port);
+        // How the UART listens on its port, none by default. Call before init()
+        void setUartNetwork(const uart_network_t *network);
+        // A headless machine in the same state as this one, to run on another thread. It shares
+        // this one's ROM until it writes to it, so this one must outlive it and not run meanwhile
+        Machine *spawn();
+        // Load a binary into memory now, as -f does at init(). A spawned machine only copies the
+        // ROM it shares if the binary goes there
+        void loadBinary(BinaryFile &file);
+        // Run one fan-out scenario from where the machine is now
+        void runScenario(const Scenario &scenario, ScenarioResult &result);
+        // Run until one of the test's conditions is met or the budget (0 for none) runs out
+        void runTest(const std::vector<TestCondition> &conditions, uint64_t budget, TestResult &result);
+        // Restore the machine as it was when it booted to readyPc with the same images loaded,
+        // or boot there now and keep it in the directory for next time. Call after init()
+        bool bootFromCache(const char *directory, uint16_t readyPc);
+        virtual void reset();
+        void run(bool run);
+        // Run until interrupted or a breakpoint, then print where it stopped
+        void headlessLoop();
+
+        // Where runUntil() stops, checked at each instruction boundary
+        struct StopCondition {
+            // UART stops once the UART has sent or received a byte
+            enum Kind {TICK, INSTRUCTION, ADDRESS, OUT, TAKEN, CYCLES, UART, FOREVER} kind;
+            uint16_t address = 0;       // PC to stop at (ADDRESS), or the branch to watch (TAKEN)
+            uint64_t cycleLimit = 0;    // Also stop at the first boundary after this many cycles, 0 for no limit
+        };
+        void runUntil(StopCondition stop);
+        // Run on to the end of the current instruction, if stopped part way through
+        void finishInstruction();
+        void tickDevices();
+        void sampleAudio();
+        void fastForwardHalt(uint64_t cycleLimit);
+        void fastForwardLoop(uint64_t cycleLimit);
+        bool fastForward(uint64_t passCycles, uint8_t passRefresh, const uint16_t *trace, int traceLength, uint64_t cycleLimit);
+
+        uint8_t *getRom();
+        uint8_t *getRam();
+        // As the CPU sees memory now, or a 16K page of it, -1 for the page mapped at address
+        uint8_t  readMem(uint16_t address);
+        uint8_t  readPage(int page, uint16_t address);
+        void     writeMem(int page, uint16_t address, uint8_t data);
+
+        const z80_t &getCpu() const {
+            return cpu;
+        }
+
+        uint64_t getTickCount() const {
+            return tickCount;
+        }
+
+        StopReason getStopReason() const {
+            return stopReason;
+        }
+
+        DebugManager *getDebugManager() {
+            return debugManager;
+        }
+
+        // Keys held down, bit (row*12 + col) for each. Ignored while input comes from a journal
+        void     setKeys(uint64_t keys);
+        uint64_t keyMask() const;
+
+        uint8_t readKeyboard(uint16_t port);
+
+        Digit* getDigit(int index);
+
+        // Samples of the speaker at this rate, 0 for none, to be taken by loadSamples()
+        void setAudio(int sampleRate, int volume);
+        void loadSamples(int16_t *stream, int length);
+
+        static const int AUDIO_FREQ = 16000;
+        static const int AUDIO_BUFFER_SIZE = 16384;
+        static const int BYTES_PER_SAMPLE = 2;
+
+        static const uint64_t ONE_SECOND_PS = UINT64_C(1000000000000);
+        static const uint64_t UART_CLOCK_HZ = UINT64_C(1843200);
+        static const int      UART_PORT = 8456;
+
+        static const uint64_t NOT_SET = UINT64_MAX;
+
+        static const int SPEED_MAX = 0;     // Speed multiplier for no throttling at all
+
+        static const uint16_t DEFAULT_READY_PC = 0x0343;    // wait_key in the stock firmware
+        static const uint64_t BOOT_LIMIT_SECONDS = 30;      // Give up on reaching readyPc after this
+
+    protected:
+        // Called once a frame while running, at an instruction boundary. Returns false to stop
+        virtual bool onFrame();
+        // A breakpoint or watchpoint stopped the run
+        virtual void onBreak() {}
+        // The machine was reset or restored, so anything shown of it is out of date
+        virtual void onRestore() {}
+
+        std::vector<uint8_t> romMemory;    // 512K rom, unless it is a flash image or shared
+        uint8_t       *rom;
+        bool          romShared = false;   // rom belongs to the machine this one was spawned from
+        FlashImage    flash;
+        uint8_t       ram[RAM_SIZE]; // 512K ram
+        uint8_t*      videoRam = {0};
+
+        uint8_t                 memoryPage[4];
+        Listing                 &listing;
+        std::vector<BinaryFile> binaryFiles;
+
+        z80_t    cpu;
+        z80pio_t pio;
+        uart_t     uart;
+        Instructions *instr;
+        uint64_t  tickCount = 0;
+
+        I2c      *i2c;
+        I2cDisplay *display1;
+        I2cDisplay *display2;
+        I2cRTC     *rtc;
+
+        VideoBeast *videoBeast = nullptr;
+        std::unique_ptr<VideoBeast> ownedVideoBeast;
+
+        int        uartPort = UART_PORT;
+        const uart_network_t *uartNetwork = nullptr;
+
+        Scheduler  scheduler;
+        Pacer      pacer;
+        BusyWait   busyWait;
+        int        speedMultiplier = 1;
+        int        audioDecimation = 0;
+        Stats      stats;
+        Profiler   profiler;            // Only built with BEASTEM_PROFILE, report printed with F4 and on exit
+        bool       devicesSettling = true;
+
+        DebugManager    *debugManager;
+
+        static const int HISTORY_SIZE = 1000;
+        uint16_t        history[HISTORY_SIZE];
+        size_t          historyIndex = 0;
+        size_t          historyCount = 0;
+
+        // Stop reason tracking for debug display
+        StopReason stopReason = STOP_NONE;
+        uint16_t   watchpointTriggerAddress = 0;  // Address of instruction that caused WP trigger
+        size_t     watchpointTriggerIndex;   // Which WP (0-7) was triggered
+        uint16_t   currentInstructionPC = 0;      // PC at start of current instruction (for accurate WP trigger address)
+        uint64_t   uartMark = 0;                  // UART bytes transferred when runUntil() began (StopCondition::UART)
+
+        uint64_t pins;
+        uint64_t portPins = 0;    // Pins as left by the last peripheral pass (PIO port A/B state)
+        Engine   engine = ENGINE_CYCLE;
+        BlockCache blockCache;
+        bool     watchpointHit = false;
+        uint8_t portB;
+        uint64_t clock_cycle_ps;
+        uint64_t clock_time_ps  = 0;
+        uint64_t targetSpeedHz;
+
+        bool     romOperation = false;
+        uint8_t  romSequence = 0;
+        uint8_t  romOperationMask = 0x80;
+        uint64_t romCompletePs = 0;
+
+        const uint64_t ROM_BYTE_WRITE_PS = 20 * 1000000ULL;
+        const uint64_t ROM_CHIP_ERASE_PS = 100000 * 1000000ULL;
+        const uint64_t ROM_SECTOR_ERASE_PS = 25000 * 1000000ULL;
+
+
+        bool       pagingEnabled = false;
+
+        // What each 16K bank of the Z80 address space maps to, rebuilt by updateBanks()
+        // whenever memoryPage or pagingEnabled change
+        struct MemoryBank {
+            enum Kind {RAM, ROM, VIDEO} kind;
+            uint8_t  *host;         // Start of the bank in rom[] or ram[], ROM writes go to the flash state machine
+            uint32_t mappedBase;    // Bank-relative base within rom[], ram[] or VideoBeast
+            uint32_t physicalBase;  // page << 14, for watchpoints
+        };
+        MemoryBank banks[4];
+        void       updateBanks();
+        void       updateCpuBanks();
+        void       flushBankWrites();
+        bool       inlineMemory = false;    // Plain memory accesses resolved inside z80_tick()
+
+        // The bus as seen by the CPU, shared by the cycle stepped path in runLoop() and Z80Fast
+        template <bool Watch> uint8_t memoryRead(uint16_t address);
+        template <bool Watch> void    memoryWrite(uint16_t address, uint8_t data);
+        void       checkWatchpoint(const MemoryBank &bank, uint16_t address, bool isRead);
+        uint8_t    ioRead(uint16_t port);
+        void       ioWrite(uint16_t port, uint8_t data);
+        uint8_t    portRead(uint16_t port, uint8_t busData);
+        void       portWrite(uint16_t port, uint8_t data);
+        uint8_t    interruptAcknowledge();
+        void       interruptReturn();
+
+        static const int FRAME_RATE = 50;
+
+        int16_t     audioBuffer[AUDIO_BUFFER_SIZE] = {0};
+        int16_t     audioLastSample = 0;
+        int         audioRead = 0;
+        int         audioWrite= 0;
+        int         audioAvailable = 0;
+        uint64_t    audioSampleRatePs = 0;
+        uint64_t    lastAudioSamplePs = 0;
+        int         volume = 0;
+        const char* audioFilename = "audio.raw";
+        FILE*       audioFile = nullptr;
+
+        void          initVideoBeast();
+        void          setRewindMemory();
+        void          ownRom();
+
+        void printMachineState(double duration);
+
+        // runUntil() runs a copy of the loop built for what needs checking, so
+        // nothing that is switched off costs a branch per cycle
+        enum RunConfig {
+            RUN_FAST        = 1,    // Whole instructions through Z80Fast
+            RUN_BREAKPOINTS = 2,    // Breakpoints to check at each instruction
+            RUN_WATCHPOINTS = 4,    // Watchpoints to check on each memory access
+            RUN_CONFIGS     = 8
+        };
+
+        // The bus as the fast engine sees it in one run loop variant
+        template <int Config>
+        struct FastBus {
+            Machine &machine;
+            uint8_t memoryRead(uint16_t address) { return machine.memoryRead<(Config & RUN_WATCHPOINTS) != 0>(address); }
+            void    memoryWrite(uint16_t address, uint8_t data) { machine.memoryWrite<(Config & RUN_WATCHPOINTS) != 0>(address, data); }
+            uint8_t ioRead(uint16_t port) { return machine.ioRead(port); }
+            void    ioWrite(uint16_t port, uint8_t data) { machine.ioWrite(port, data); }
+            uint8_t interruptAcknowledge() { return machine.interruptAcknowledge(); }
+            void    interruptReturn() { machine.interruptReturn(); }
+        };
+
+        typedef bool (Machine::*RunLoop)(const StopCondition &stop, bool paced, bool &pending, uint64_t cycleLimit);
+        static const RunLoop RUN_LOOPS[RUN_CONFIGS];
+
+        int  runConfig();
+        template <int Config> bool runLoop(const StopCondition &stop, bool paced, bool &pending, uint64_t cycleLimit);
+        template <int Config> int  stepInstruction(Z80Fast<FastBus<Config>> &fast);
+
+        bool stopReached(const StopCondition &stop, bool &pending);
+
+        const static int DISPLAY_CHARS = 24;
+
+        std::vector<Digit> display;         // Written by the emulated I2C displays
+
+        std::string stateFile = "beastem.sav";     // Saved and restored with F5 and F9 in the debugger
+        void saveMachine(StateWriter &out, bool withMemory = true);
+        void loadMachine(StateReader &in, bool withMemory = true);
+
+        // A checkpoint is taken at the first instruction boundary of each frame. Going
+        // backwards restores one and runs forward again to the wanted boundary
+        Rewind   rewind;
+        bool     checkpointDue = false;
+        bool     replaying = false;     // No checkpoints or trace logs while running history again
+        void     takeCheckpoint();
+        void     restoreCheckpoint(int index);
+        void     setReplaying(bool replaying);
+        uint64_t replayTo(uint64_t target);
+        void     stepBack();
+        void     reverseContinue();
+        void     memoryReloaded();
+        void     restartStats();
+        void     updateStats();
+
+        Journal  journal;
+        uint64_t journaledKeys = 0;
+        bool     inputFromJournal() const;
+        void     stopJournal();
+        void     journalKeys();
+        void     setKeyMask(uint64_t keys);
+        int      uartReceive(uint8_t *buffer, int length);
+        static int receiveUart(void *machine, uint8_t *buffer, int length);
+        static void captureUart(void *output, uint8_t byte);
+
+        std::set<int> keySet = {};
+};
@@ -0,0 +1,69 @@
+#include "pacer.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+void Pacer::setCyclesPerFrame(uint64_t cycles) {
+    cyclesPerFrame = cycles > 0 ? cycles : 1;
+    remaining = 0;
+}
+
+void Pacer::setMultiplier(int multiplier) {
+    this->multiplier = multiplier;
+}
+
+void Pacer::start(uint64_t clock_time_ps) {
+    runStart = Clock::now();
+    hostStart = runStart;
+    startClockPs = clock_time_ps;
+    lastClockPs = clock_time_ps;
+    frames = 0;
+    resyncs = 0;
+    totalJitterUs = 0;
+    maxJitterUs = 0;
+}
+
+void Pacer::pace(uint64_t clock_time_ps) {
+    lastClockPs = clock_time_ps;
+    if( multiplier == 0 ) {
+        return;
+    }
+    uint64_t hostNs = (clock_time_ps - startClockPs) / 1000 / multiplier;
+    Clock::time_point deadline = hostStart + std::chrono::nanoseconds(hostNs);
+
+    Clock::time_point now = Clock::now();
+    if( now < deadline ) {
+        Clock::time_point sleepStart = now;
+        std::this_thread::sleep_until(deadline);
+        now = Clock::now();
+        totalSleptNs += std::chrono::duration_cast<std::chrono::nanoseconds>(now - sleepStart).count();
+    }
+    else if( now - deadline > MAX_LAG ) {
+        // Host stalled, carry on from here instead of running flat out to catch up
+        hostStart = now - std::chrono::nanoseconds(hostNs);
+        resyncs++;
+    }
+
+    double jitterUs = std::chrono::duration<double, std::micro>(now - deadline).count();
+    if( jitterUs < 0 ) jitterUs = -jitterUs;
+
+    frames++;
+    totalJitterUs += jitterUs;
+    if( jitterUs > maxJitterUs ) maxJitterUs = jitterUs;
+}
+
+void Pacer::report(uint64_t targetSpeedHz) {
+    double hostSeconds = std::chrono::duration<double>(Clock::now() - runStart).count();
+    double emulatedSeconds = (lastClockPs - startClockPs) / 1e12;
+    double mhz = hostSeconds > 0 ? (emulatedSeconds / hostSeconds) * targetSpeedHz / 1000000 : 0;
+
+    std::cout << "Speed " << std::setprecision(2) << std::fixed << mhz << " Mhz";
+    if( frames > 0 ) {
+        std::cout << ", frame jitter " << (totalJitterUs / frames) << "us mean, " << maxJitterUs << "us max";
+        if( resyncs > 0 ) {
+            std::cout << ", " << resyncs << " resyncs";
+        }
+    }
+    std::cout << std::endl;
+}
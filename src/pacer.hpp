@@ -0,0 +1,83 @@
+#pragma once
+#include <stdint.h>
+#include <chrono>
+
+/**
+ * Keeps emulated time in step with host time.
+ *
+ * tick() counts cycles down to the next frame boundary, so the run loop does no
+ * timer work per cycle. At each boundary pace() compares the emulated clock with
+ * a monotonic host deadline and sleeps once until it is reached.
+ */
+class Pacer {
+    public:
+        void setCyclesPerFrame(uint64_t cycles);
+
+        // Run at this many times real time, or as fast as possible if 0
+        void setMultiplier(int multiplier);
+
+        // Restart frame counting, e.g. after a reset puts the cycle count back to zero
+        void resetFrame() {
+            remaining = 0;
+        }
+
+        // Count a cycle, or a whole instruction, returns true if it reached a frame boundary
+        bool tick(uint64_t cycles) {
+            if( cycles <= remaining ) {
+                remaining -= cycles;
+                return false;
+            }
+            remaining = cyclesPerFrame - (cycles - remaining);
+            return true;
+        }
+
+        // Cycles that can pass before the next frame boundary
+        uint64_t cyclesToFrame() const {
+            return remaining;
+        }
+
+        // Put the next frame boundary back where it was, e.g. at a rewind checkpoint
+        void setCyclesToFrame(uint64_t cycles) {
+            remaining = cycles;
+        }
+
+        // Count several cycles at once, no more than cyclesToFrame()
+        void skip(uint64_t cycles) {
+            remaining -= cycles;
+        }
+
+        // Line up host time with the emulated clock at the start of a run
+        void start(uint64_t clock_time_ps);
+
+        // Sleep until the host has caught up with the emulated clock
+        void pace(uint64_t clock_time_ps);
+
+        // Total host time spent asleep in pace()
+        uint64_t sleptNs() const {
+            return totalSleptNs;
+        }
+
+        // Print achieved speed and frame jitter since start()
+        void report(uint64_t targetSpeedHz);
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        // Falling further behind than this restarts the timeline rather than racing to catch up
+        const std::chrono::milliseconds MAX_LAG = std::chrono::milliseconds(100);
+
+        int      multiplier = 1;
+        uint64_t cyclesPerFrame = 1;
+        uint64_t remaining = 0;
+
+        Clock::time_point runStart;
+        Clock::time_point hostStart;
+        uint64_t          startClockPs = 0;
+        uint64_t          lastClockPs = 0;
+
+        uint64_t totalSleptNs = 0;
+        uint64_t frames = 0;
+        uint64_t resyncs = 0;
+        double   totalJitterUs = 0;
+        double   maxJitterUs = 0;
+};
@@ -0,0 +1,198 @@
+#pragma once
+#include <stdint.h>
+
+/**
+ * profiler.hpp - Where host time goes inside the run loop
+ *
+ * Only built when BEASTEM_PROFILE is defined (cmake -DBEASTEM_PROFILE=ON), otherwise
+ * PROFILE() expands to nothing and the Profiler does nothing.
+ *
+ * PROFILE(section) charges the host time until the end of the enclosing scope to the
+ * section. Time is exclusive: a scope opened inside another pauses the outer one, so
+ * the flash and VideoBeast accesses made by an instruction count as memory rather than
+ * Z80, and anything outside every scope is charged to "other". Each switch costs one
+ * read of the time stamp counter, or of the steady clock where there is none.
+ *
+ * Once a second each section's time is turned into microseconds per second and added
+ * to a histogram of power-of-two buckets, so a device that is usually cheap but now
+ * and then slow stands out. The histograms are printed on exit, or when asked for.
+ */
+#ifdef BEASTEM_PROFILE
+
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define PROFILER_TSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PROFILER_TSC
+#endif
+
+#define PROFILE_JOIN(a, b) a##b
+#define PROFILE_SCOPE(line) PROFILE_JOIN(profileScope, line)
+#define PROFILE(section) Profiler::Scope PROFILE_SCOPE(__LINE__)(profiler, Profiler::SECTION_##section)
+
+class Profiler {
+    public:
+        enum Section {SECTION_OTHER, SECTION_IDLE, SECTION_Z80, SECTION_PIO, SECTION_I2C, SECTION_RTC, SECTION_UART,
+                      SECTION_MEMORY, SECTION_IO, SECTION_VIDEOBEAST, SECTION_AUDIO, SECTION_DEBUG, SECTION_EVENTS,
+                      SECTION_COUNT};
+
+        static const int BUCKETS = 24;                  // Up to 2^23us, more than a whole second
+
+        class Scope {
+            public:
+                Scope(Profiler &profiler, Section section) : profiler(profiler), parent(profiler.enter(section)) {}
+                ~Scope() { profiler.leave(parent); }
+
+            private:
+                Profiler &profiler;
+                Section  parent;
+        };
+
+        /* Drop the part sample, e.g. after being stopped in the debugger */
+        void restart() {
+            sampleNs = steadyNs();
+            sampleTicks = last = now();
+            for( int i=0; i<SECTION_COUNT; i++ ) {
+                ticks[i] = 0;
+                calls[i] = 0;
+            }
+        }
+
+        /* Call at each frame boundary on the emulation thread. Takes a sample once a second */
+        void onFrame() {
+            uint64_t ns = steadyNs();
+            if( sampleNs == 0 ) {
+                restart();
+                return;
+            }
+            if( ns - sampleNs >= SAMPLE_INTERVAL_NS ) {
+                takeSample(ns);
+            }
+            if( reportRequested.exchange(false, std::memory_order_relaxed) ) {
+                report(std::cout);
+            }
+        }
+
+        /* Print the report at the next frame boundary. Safe from any thread */
+        void requestReport() {
+            reportRequested.store(true, std::memory_order_relaxed);
+        }
+
+        void report(std::ostream &out) const {
+            if( samples == 0 ) {
+                return;
+            }
+            out << "Run loop profile over " << samples << " seconds, host us per second" << std::endl;
+            out << std::left << std::setw(12) << "section" << std::right << std::setw(10) << "mean" << std::setw(10) << "min"
+                << std::setw(10) << "max" << std::setw(12) << "calls/s" << "  seconds by us/s" << std::endl;
+            out << std::fixed << std::setprecision(1);
+            for( int i=0; i<SECTION_COUNT; i++ ) {
+                out << std::left << std::setw(12) << SECTION_NAMES[i] << std::right << std::setw(10) << totalUs[i] / samples
+                    << std::setw(10) << minUs[i] << std::setw(10) << maxUs[i] << std::setw(12) << (double)totalCalls[i] / samples << " ";
+                for( int b=0; b<BUCKETS; b++ ) {
+                    if( histogram[i][b] ) {
+                        out << " " << (b ? 1ULL << (b-1) : 0) << "-" << (1ULL << b) << ":" << histogram[i][b];
+                    }
+                }
+                out << std::endl;
+            }
+            out << std::defaultfloat;
+        }
+
+    private:
+        static constexpr uint64_t SAMPLE_INTERVAL_NS = 1000000000ULL;
+        static constexpr const char* SECTION_NAMES[SECTION_COUNT] = {"other", "idle", "z80", "pio", "i2c", "rtc", "uart",
+                                                                      "memory", "io", "videobeast", "audio", "debug", "events"};
+
+        static uint64_t steadyNs() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        static uint64_t now() {
+#ifdef PROFILER_TSC
+            return __rdtsc();
+#else
+            return steadyNs();
+#endif
+        }
+
+        Section enter(Section section) {
+            Section parent = current;
+            switchTo(section);
+            calls[section]++;
+            return parent;
+        }
+
+        void leave(Section parent) {
+            switchTo(parent);
+        }
+
+        void switchTo(Section section) {
+            uint64_t t = now();
+            ticks[current] += t - last;
+            last = t;
+            current = section;
+        }
+
+        void takeSample(uint64_t ns) {
+            switchTo(current);
+            // Counter ticks are calibrated against the steady clock over each sample
+            double seconds = (ns - sampleNs) / 1e9;
+            double ticksPerUs = (last - sampleTicks) / (seconds * 1e6);
+            if( ticksPerUs <= 0 ) {
+                restart();
+                return;
+            }
+            for( int i=0; i<SECTION_COUNT; i++ ) {
+                double us = ticks[i] / ticksPerUs / seconds;
+                totalUs[i] += us;
+                minUs[i] = samples == 0 || us < minUs[i] ? us : minUs[i];
+                maxUs[i] = us > maxUs[i] ? us : maxUs[i];
+                totalCalls[i] += calls[i] / seconds;
+
+                int bucket = 0;
+                while( bucket < BUCKETS-1 && us >= (double)(1ULL << bucket) ) {
+                    bucket++;
+                }
+                histogram[i][bucket]++;
+            }
+            samples++;
+            restart();
+        }
+
+        std::atomic<bool> reportRequested {false};
+
+        Section  current = SECTION_OTHER;
+        uint64_t last = 0;
+        uint64_t sampleNs = 0;
+        uint64_t sampleTicks = 0;
+        uint64_t ticks[SECTION_COUNT] = {0};
+        uint64_t calls[SECTION_COUNT] = {0};
+
+        uint64_t samples = 0;
+        double   totalUs[SECTION_COUNT] = {0};
+        double   minUs[SECTION_COUNT] = {0};
+        double   maxUs[SECTION_COUNT] = {0};
+        double   totalCalls[SECTION_COUNT] = {0};
+        uint32_t histogram[SECTION_COUNT][BUCKETS] = {{0}};
+};
+
+#else
+
+#define PROFILE(section)
+
+class Profiler {
+    public:
+        void restart() {}
+        void onFrame() {}
+        void requestReport() {}
+        template <typename Stream> void report(Stream &) const {}
+};
+
+#endif
@@ -0,0 +1,172 @@
+#pragma once
+#include <stdint.h>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <vector>
+
+/**
+ * rewind.hpp - Checkpoints of recent history for stepping backwards
+ *
+ * Memory is seen as one run of 16K pages: ROM, then RAM, then video RAM if there
+ * is any. Each write path marks the page it changed as dirty, and a checkpoint
+ * keeps a copy of only the pages dirtied since the one before, along with the
+ * rest of the machine state. The oldest checkpoint always holds every page, so
+ * memory as it was at any checkpoint is the newest copy of each page up to it.
+ *
+ * Checkpoints are dropped oldest first to stay within the memory budget. The
+ * pages of a dropped checkpoint that the next one doesn't have are handed on to
+ * it, so it becomes the new complete oldest.
+ */
+class Rewind {
+    public:
+        static const int PAGE_SIZE = 1 << 14;
+        static const int MAX_PAGES = 128;           // 512K ROM, 512K RAM, 1M video RAM
+
+        struct Checkpoint {
+            uint64_t                               tickCount;
+            uint64_t                               cyclesToFrame;   // Where the next frame boundary falls, see Pacer
+            std::vector<uint8_t>                   machine;     // Everything but memory, see StateWriter
+            std::map<int, std::vector<uint8_t>>    pages;
+        };
+
+        /* Keep up to this many bytes of history, 0 to keep none */
+        void setBudget(size_t bytes) {
+            budget = bytes;
+            trim();
+        }
+
+        bool isEnabled() const {
+            return budget != 0;
+        }
+
+        /* Memory that is checkpointed, as consecutive pages. Starts a new history */
+        void setMemory(uint8_t *rom, size_t romLength, uint8_t *ram, size_t ramLength, uint8_t *videoRam, size_t videoLength) {
+            pageCount = 0;
+            addPages(rom, romLength);
+            addPages(ram, ramLength);
+            addPages(videoRam, videoLength);
+            clear();
+        }
+
+        /* A byte was changed at this address in the run of pages */
+        void written(uint32_t address) {
+            int page = (address >> 14) & (MAX_PAGES-1);
+            dirty[page >> 6] |= 1ULL << (page & 63);
+        }
+
+        /* Memory may have changed anywhere, e.g. loaded from a file */
+        void allWritten() {
+            dirty[0] = dirty[1] = ~0ULL;
+        }
+
+        /* Forget all history, e.g. after a reset. The next checkpoint holds every page */
+        void clear() {
+            checkpoints.clear();
+            used = 0;
+            allWritten();
+        }
+
+        void checkpoint(uint64_t tickCount, uint64_t cyclesToFrame, std::vector<uint8_t> &&machine) {
+            if( !isEnabled() ) {
+                return;
+            }
+            checkpoints.push_back(Checkpoint{tickCount, cyclesToFrame, std::move(machine), {}});
+            Checkpoint &latest = checkpoints.back();
+            for( int page=0; page<pageCount; page++ ) {
+                if( dirty[page >> 6] & (1ULL << (page & 63)) ) {
+                    latest.pages[page].assign(pages[page], pages[page] + PAGE_SIZE);
+                }
+            }
+            dirty[0] = dirty[1] = 0;
+            used += size(latest);
+            trim();
+        }
+
+        /* Index of the newest checkpoint taken before this cycle count, or -1 */
+        int before(uint64_t tickCount) const {
+            for( int i=(int)checkpoints.size()-1; i>=0; i-- ) {
+                if( checkpoints[i].tickCount < tickCount ) {
+                    return i;
+                }
+            }
+            return -1;
+        }
+
+        const Checkpoint& at(int index) const {
+            return checkpoints[index];
+        }
+
+        int count() const {
+            return checkpoints.size();
+        }
+
+        /* Put memory back as it was at the checkpoint and drop everything after it */
+        void restore(int index) {
+            for( int page=0; page<pageCount; page++ ) {
+                for( int i=index; i>=0; i-- ) {
+                    auto found = checkpoints[i].pages.find(page);
+                    if( found != checkpoints[i].pages.end() ) {
+                        // Pages left alone stay clean, e.g. in a mapped flash image
+                        if( memcmp(pages[page], found->second.data(), PAGE_SIZE) != 0 ) {
+                            memcpy(pages[page], found->second.data(), PAGE_SIZE);
+                        }
+                        break;
+                    }
+                }
+            }
+            while( (int)checkpoints.size() > index+1 ) {
+                used -= size(checkpoints.back());
+                checkpoints.pop_back();
+            }
+            dirty[0] = dirty[1] = 0;
+        }
+
+        /* Seconds of emulated history, given the clock rate */
+        double seconds(uint64_t tickCount, uint64_t clockHz) const {
+            return checkpoints.empty() ? 0 : (double)(tickCount - checkpoints.front().tickCount) / clockHz;
+        }
+
+        size_t bytesUsed() const {
+            return used;
+        }
+
+    private:
+        size_t   budget = 0;
+        size_t   used = 0;
+        uint8_t  *pages[MAX_PAGES];
+        int      pageCount = 0;
+        uint64_t dirty[2] = {~0ULL, ~0ULL};
+
+        std::deque<Checkpoint> checkpoints;
+
+        void addPages(uint8_t *memory, size_t length) {
+            for( size_t offset=0; memory && offset<length && pageCount<MAX_PAGES; offset+=PAGE_SIZE ) {
+                pages[pageCount++] = memory + offset;
+            }
+        }
+
+        static size_t size(const Checkpoint &checkpoint) {
+            return sizeof(Checkpoint) + checkpoint.machine.size() + checkpoint.pages.size() * (PAGE_SIZE + 64);
+        }
+
+        void trim() {
+            if( !isEnabled() ) {
+                checkpoints.clear();
+                used = 0;
+                return;
+            }
+            while( used > budget && checkpoints.size() > 1 ) {
+                Checkpoint &oldest = checkpoints[0];
+                Checkpoint &next = checkpoints[1];
+                used -= size(oldest) + size(next);
+                for( auto &page : oldest.pages ) {
+                    if( next.pages.find(page.first) == next.pages.end() ) {
+                        next.pages[page.first] = std::move(page.second);
+                    }
+                }
+                used += size(next);
+                checkpoints.pop_front();
+            }
+        }
+};
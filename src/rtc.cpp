@@ -1,5 +1,8 @@
 #include "rtc.hpp"
+#include "savestate.hpp"
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 
 I2cRTC::I2cRTC(uint8_t address, uint64_t intMask) {
@@ -10,7 +13,9 @@ I2cRTC::I2cRTC(uint8_t address, uint64_t intMask) {
     }
 }
 
-void I2cRTC::tick(uint64_t* busState, uint64_t clock_time_ps) {
+uint64_t I2cRTC::tick(uint64_t* busState, uint64_t clock_time_ps) {
+    uint64_t nextTime = NEVER;
+
     if( setTime ) {
         setTime = false;
         startTime = clock_time_ps;
@@ -41,6 +46,7 @@ void I2cRTC::tick(uint64_t* busState, uint64_t clock_time_ps) {
                 }
             }
         }
+        nextTime = startTime + PICOSECONDS_IN_SECOND + 1;
     }
     if( mem[REG_CONTROL] & FLAG_SQWEN ) {
         uint64_t tickTime = 0;
@@ -65,7 +71,9 @@ void I2cRTC::tick(uint64_t* busState, uint64_t clock_time_ps) {
             }
             //std::cout << "Tick " << (*busState & intMask) << " from " << squareWave << std::endl;
         }
+        nextTime = std::min(nextTime, squareWaveTime + tickTime + 1);
     }
+    return nextTime;
 }
 
 bool I2cRTC::atAddress(uint8_t address) {
@@ -196,4 +204,44 @@ void I2cRTC::write(uint8_t ioByte) {
     byteCount++;
 }
 
+void I2cRTC::readSram(uint8_t *data) const {
+    memcpy(data, mem + SRAM_ADDR, SRAM_LENGTH);
+}
 
+void I2cRTC::writeSram(const uint8_t *data) {
+    memcpy(mem + SRAM_ADDR, data, SRAM_LENGTH);
+}
+
+void I2cRTC::save(StateWriter &out) const {
+    out.value(byteCount);
+    out.value(currentAddress);
+    // Field by field, as the rest of struct tm differs between C libraries and holds a pointer
+    for( int field : {clock.tm_sec, clock.tm_min, clock.tm_hour, clock.tm_mday, clock.tm_mon,
+                      clock.tm_year, clock.tm_wday, clock.tm_yday, clock.tm_isdst} ) {
+        out.value((int32_t)field);
+    }
+    out.value(startTime);
+    out.value(weekOffset);
+    out.value(setTime);
+    out.value(squareWave);
+    out.value(squareWaveTime);
+    out.bytes(mem, sizeof(mem));
+}
+
+void I2cRTC::load(StateReader &in) {
+    in.value(byteCount);
+    in.value(currentAddress);
+    clock = tm{};
+    for( int *field : {&clock.tm_sec, &clock.tm_min, &clock.tm_hour, &clock.tm_mday, &clock.tm_mon,
+                       &clock.tm_year, &clock.tm_wday, &clock.tm_yday, &clock.tm_isdst} ) {
+        int32_t value = 0;
+        in.value(value);
+        *field = value;
+    }
+    in.value(startTime);
+    in.value(weekOffset);
+    in.value(setTime);
+    in.value(squareWave);
+    in.value(squareWaveTime);
+    in.bytes(mem, sizeof(mem));
+}
@@ -1,29 +1,37 @@
 #pragma once
 
 #include <ctime>
-#include "SDL.h"
+#include <cstdint>
 #include "i2c.hpp"
-#include "digit.hpp"
 
 class I2cRTC: public I2cDevice {
 
     public:
         I2cRTC(uint8_t address, uint64_t intMask);
 
-        void tick(uint64_t* busState, uint64_t clock_time_ps );
+        // Returns the time of the next clock or square wave change
+        uint64_t tick(uint64_t* busState, uint64_t clock_time_ps );
 
         virtual bool    atAddress(uint8_t adddress);
         virtual void    start();
         virtual uint8_t readNext();
         virtual void    write(uint8_t value);
         virtual void    stop();
+
+        void save(StateWriter &out) const;
+        void load(StateReader &in);
+
+        // The battery backed SRAM, which powers up holding whatever rand() gave it
+        static const int SRAM_LENGTH= 64;
+        void readSram(uint8_t *data) const;
+        void writeSram(const uint8_t *data);
     private:
         uint8_t address;
         uint16_t byteCount = 0;
         uint8_t currentAddress = 0;
         uint64_t intMask;
 
-        tm clock = {0};
+        tm clock = {};
         uint64_t startTime = 0;
         int weekOffset = 0;
         bool setTime = false;
@@ -42,6 +50,8 @@ class I2cRTC: public I2cDevice {
         static const uint64_t PICOSECONDS_IN_4kHz   = PICOSECONDS_IN_SECOND / 8192;
         static const uint64_t PICOSECONDS_IN_1Hz    = PICOSECONDS_IN_SECOND / 2;
 
+        static const uint64_t NEVER = UINT64_MAX;
+
         uint8_t mem[MAX_MEM] = {0};
 
         static const int OSC_EN  = 0x80;
@@ -73,5 +83,4 @@ class I2cRTC: public I2cDevice {
         const int MONTH_DAYS[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
 
         static const int SRAM_ADDR  = 0x20;
-        static const int SRAM_LENGTH= 64;
 };
\ No newline at end of file
@@ -0,0 +1,216 @@
+#include "savestate.hpp"
+
+#include <iostream>
+
+static const char STATE_MAGIC[8] = {'B', 'E', 'A', 'S', 'T', 'S', 'A', 'V'};
+
+StateWriter::StateWriter(FILE *file) : file(file) {
+    if( file ) {
+        uint32_t version = VERSION;
+        write(STATE_MAGIC, sizeof(STATE_MAGIC));
+        write(&version, sizeof(version));
+    }
+}
+
+StateWriter::StateWriter(std::vector<uint8_t> &memory) : file(nullptr), memory(&memory) {
+    uint32_t version = VERSION;
+    write(STATE_MAGIC, sizeof(STATE_MAGIC));
+    write(&version, sizeof(version));
+}
+
+void StateWriter::begin(const char *tag) {
+    this->tag = stateTag(tag);
+    buffer.clear();
+}
+
+void StateWriter::end() {
+    uint32_t length = buffer.size();
+    layout.push_back(Chunk{tag, length});
+    if( file || memory ) {
+        write(&tag, sizeof(tag));
+        write(&length, sizeof(length));
+        write(buffer.data(), length);
+    }
+}
+
+void StateWriter::bytes(const void *data, size_t length) {
+    const uint8_t *start = (const uint8_t *)data;
+    buffer.insert(buffer.end(), start, start + length);
+}
+
+void StateWriter::block(const char *tag, const void *data, size_t length) {
+    uint32_t id = stateTag(tag);
+    uint32_t size = length;
+    layout.push_back(Chunk{id, size});
+    if( file || memory ) {
+        write(&id, sizeof(id));
+        write(&size, sizeof(size));
+        write(data, length);
+    }
+}
+
+bool StateWriter::ok() const {
+    return !failed;
+}
+
+const std::vector<StateWriter::Chunk>& StateWriter::chunks() const {
+    return layout;
+}
+
+void StateWriter::write(const void *data, size_t length) {
+    if( memory ) {
+        const uint8_t *start = (const uint8_t *)data;
+        memory->insert(memory->end(), start, start + length);
+    }
+    else if( length && fwrite(data, 1, length, file) != length ) {
+        failed = true;
+    }
+}
+
+StateReader::~StateReader() {
+    if( file ) {
+        fclose(file);
+    }
+}
+
+bool StateReader::open(const char *filename) {
+    file = fopen(filename, "rb");
+    if( !file ) {
+        std::cout << "Could not open state file " << filename << std::endl;
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    memoryLength = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    return readHeader(filename);
+}
+
+bool StateReader::open(const std::vector<uint8_t> &memory) {
+    this->memory = memory.data();
+    memoryLength = memory.size();
+    position = 0;
+    return readHeader("State");
+}
+
+bool StateReader::readHeader(const char *name) {
+    char magic[sizeof(STATE_MAGIC)];
+    uint32_t version;
+    if( !read(magic, sizeof(magic)) || memcmp(magic, STATE_MAGIC, sizeof(magic)) != 0 ) {
+        std::cout << name << " is not a state file" << std::endl;
+        return false;
+    }
+    if( !read(&version, sizeof(version)) || version != StateWriter::VERSION ) {
+        std::cout << name << " was saved by a different version of BeastEm" << std::endl;
+        return false;
+    }
+
+    // Note where each chunk is, the data is only read when it's wanted
+    uint32_t header[2];
+    while( read(header, sizeof(header)) ) {
+        long offset = tell();
+        if( offset + (size_t)header[1] > memoryLength ) {
+            std::cout << name << " is truncated" << std::endl;
+            return false;
+        }
+        chunks.push_back(Chunk{header[0], header[1], offset});
+        skip(header[1]);
+    }
+    return true;
+}
+
+bool StateReader::matches(const StateWriter &layout) const {
+    for( const StateWriter::Chunk &expected : layout.chunks() ) {
+        const Chunk *chunk = find(expected.tag);
+        if( !chunk || chunk->length != expected.length ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void StateReader::begin(const char *tag) {
+    const Chunk *chunk = find(stateTag(tag));
+    buffer.clear();
+    position = 0;
+    if( !chunk ) {
+        failed = true;
+        return;
+    }
+    buffer.resize(chunk->length);
+    if( !readChunk(*chunk, buffer.data()) ) {
+        failed = true;
+    }
+}
+
+void StateReader::end() {
+    if( position != buffer.size() ) {
+        failed = true;
+    }
+}
+
+void StateReader::bytes(void *data, size_t length) {
+    if( position + length > buffer.size() ) {
+        failed = true;
+        return;
+    }
+    memcpy(data, buffer.data() + position, length);
+    position += length;
+}
+
+void StateReader::block(const char *tag, void *data, size_t length) {
+    const Chunk *chunk = find(stateTag(tag));
+    if( !chunk || chunk->length != length || !readChunk(*chunk, data) ) {
+        failed = true;
+    }
+}
+
+bool StateReader::has(const char *tag) const {
+    return find(stateTag(tag)) != nullptr;
+}
+
+bool StateReader::ok() const {
+    return !failed;
+}
+
+const StateReader::Chunk* StateReader::find(uint32_t tag) const {
+    for( const Chunk &chunk : chunks ) {
+        if( chunk.tag == tag ) {
+            return &chunk;
+        }
+    }
+    return nullptr;
+}
+
+// Sequential reads while finding the chunks
+bool StateReader::read(void *data, size_t length) {
+    if( file ) {
+        return fread(data, 1, length, file) == length;
+    }
+    if( position + length > memoryLength ) {
+        return false;
+    }
+    memcpy(data, memory + position, length);
+    position += length;
+    return true;
+}
+
+long StateReader::tell() const {
+    return file ? ftell(file) : (long)position;
+}
+
+void StateReader::skip(long length) {
+    if( file ) {
+        fseek(file, length, SEEK_CUR);
+    }
+    else {
+        position += length;
+    }
+}
+
+bool StateReader::readChunk(const Chunk &chunk, void *data) {
+    if( file ) {
+        return fseek(file, chunk.offset, SEEK_SET) == 0 && fread(data, 1, chunk.length, file) == chunk.length;
+    }
+    memcpy(data, memory + chunk.offset, chunk.length);
+    return true;
+}
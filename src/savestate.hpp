@@ -0,0 +1,116 @@
+#pragma once
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+/**
+ * savestate.hpp - Binary snapshots of the whole machine
+ *
+ * A state file is a header and then a list of chunks, each a four character tag, a
+ * length and the data. Memory (ROM, RAM and video RAM) is a chunk to itself, written
+ * and read straight to and from the emulator's arrays with one fwrite or fread. Device
+ * registers go in small chunks of fields, written and read back in the same order.
+ *
+ * States can also be kept in memory, as the rewind checkpoints are.
+ *
+ * Fields are stored as they are laid out on the host, so a state is only good for the
+ * build that saved it. Before anything is restored, every chunk is checked against the
+ * layout of the running machine, and a file that doesn't match is refused untouched.
+ */
+class StateWriter {
+    public:
+        static const uint32_t VERSION = 3;
+
+        /* With no file, only the tags and lengths of the chunks are kept, see StateReader::matches() */
+        explicit StateWriter(FILE *file = nullptr);
+        explicit StateWriter(std::vector<uint8_t> &memory);
+
+        void begin(const char *tag);
+        void end();
+
+        template <typename T> void value(const T &value) {
+            static_assert(std::is_trivially_copyable<T>::value, "Only plain fields can be saved");
+            bytes(&value, sizeof(T));
+        }
+
+        void bytes(const void *data, size_t length);
+
+        /* A chunk on its own holding a large block, written without copying */
+        void block(const char *tag, const void *data, size_t length);
+
+        /* False if anything failed to write */
+        bool ok() const;
+
+        struct Chunk {
+            uint32_t tag;
+            uint32_t length;
+        };
+        const std::vector<Chunk>& chunks() const;
+
+    private:
+        FILE                 *file;
+        std::vector<uint8_t> *memory = nullptr;
+        bool                 failed = false;
+        uint32_t             tag = 0;
+        std::vector<uint8_t> buffer;
+        std::vector<Chunk>   layout;
+
+        void write(const void *data, size_t length);
+};
+
+class StateReader {
+    public:
+        ~StateReader();
+
+        /* Reads the header and finds the chunks. False if this isn't a state file of this version */
+        bool open(const char *filename);
+        bool open(const std::vector<uint8_t> &memory);
+
+        /* True if the file has every chunk in the layout, at the same length */
+        bool matches(const StateWriter &layout) const;
+
+        void begin(const char *tag);
+        void end();
+
+        template <typename T> void value(T &value) {
+            static_assert(std::is_trivially_copyable<T>::value, "Only plain fields can be loaded");
+            bytes(&value, sizeof(T));
+        }
+
+        void bytes(void *data, size_t length);
+
+        /* Read a whole chunk straight into place */
+        void block(const char *tag, void *data, size_t length);
+
+        bool has(const char *tag) const;
+        bool ok() const;
+
+    private:
+        struct Chunk {
+            uint32_t tag;
+            uint32_t length;
+            long     offset;
+        };
+
+        FILE                 *file = nullptr;
+        const uint8_t        *memory = nullptr;
+        size_t               memoryLength = 0;
+        bool                 failed = false;
+        std::vector<Chunk>   chunks;
+        std::vector<uint8_t> buffer;
+        size_t               position = 0;
+
+        const Chunk* find(uint32_t tag) const;
+        bool read(void *data, size_t length);
+        bool readChunk(const Chunk &chunk, void *data);
+        long tell() const;
+        void skip(long length);
+        bool readHeader(const char *name);
+};
+
+// Tags are four characters, read as a little-endian number
+inline uint32_t stateTag(const char *tag) {
+    return (uint32_t)(uint8_t)tag[0] | ((uint32_t)(uint8_t)tag[1] << 8) | ((uint32_t)(uint8_t)tag[2] << 16) | ((uint32_t)(uint8_t)tag[3] << 24);
+}
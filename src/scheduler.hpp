@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+
+/**
+ * scheduler.hpp - Peripheral deadline tracking for the run loop
+ *
+ * Each timed peripheral (RTC square wave/clock, UART bit clock, VideoBeast
+ * line renderer and audio sampler) reports the emulated time, in picoseconds,
+ * at which it next needs servicing. The run loop compares the clock against
+ * the single earliest deadline each cycle, and only services the devices that
+ * are due, instead of calling every device on every T-state.
+ */
+class Scheduler {
+    public:
+        enum Event {RTC, UART, VIDEOBEAST, AUDIO, EVENT_COUNT};
+
+        static const uint64_t NEVER = UINT64_MAX;
+
+        Scheduler() {
+            reset();
+        }
+
+        /* Clear all deadlines */
+        void reset() {
+            for( int i=0; i<EVENT_COUNT; i++ ) {
+                deadlines[i] = NEVER;
+            }
+            next = NEVER;
+        }
+
+        /* Set the time an event is next due, or NEVER to disable it */
+        void schedule(Event event, uint64_t time_ps) {
+            deadlines[event] = time_ps;
+            next = deadlines[0];
+            for( int i=1; i<EVENT_COUNT; i++ ) {
+                if( deadlines[i] < next ) next = deadlines[i];
+            }
+        }
+
+        bool isDue(Event event, uint64_t time_ps) const {
+            return deadlines[event] <= time_ps;
+        }
+
+        uint64_t deadline(Event event) const {
+            return deadlines[event];
+        }
+
+        /* Earliest deadline of all events */
+        uint64_t nextDeadline() const {
+            return next;
+        }
+
+    private:
+        uint64_t deadlines[EVENT_COUNT];
+        uint64_t next;
+};
@@ -0,0 +1,94 @@
+#include "stats.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+const char* Stats::DEVICE_NAMES[DEVICE_COUNT] = {"pio", "i2c", "rtc", "uart", "videobeast", "audio"};
+
+bool Stats::openFile(const char *filename) {
+    file.open(filename, std::ios::out | std::ios::trunc);
+    if( !file.is_open() ) {
+        std::cout << "Could not open stats file " << filename << std::endl;
+        return false;
+    }
+    setTiming(true);
+    return true;
+}
+
+void Stats::setTiming(bool timing) {
+    // Always keep device times when writing to a file
+    this->timing.store(timing || file.is_open(), std::memory_order_relaxed);
+}
+
+bool Stats::isTiming() const {
+    return timing.load(std::memory_order_relaxed);
+}
+
+void Stats::restart(uint64_t tickCount, uint64_t clock_time_ps, uint64_t sleptNs, uint64_t videoFrames, uint64_t uartBytes) {
+    lastNs = nowNs();
+    if( firstNs == 0 ) {
+        firstNs = lastNs;
+    }
+    lastTickCount = tickCount;
+    lastClockPs = clock_time_ps;
+    lastSleptNs = sleptNs;
+    lastVideoFrames = videoFrames;
+    lastUartBytes = uartBytes;
+
+    audioDropped = 0;
+    for( int i=0; i<DEVICE_COUNT; i++ ) {
+        deviceNs[i] = 0;
+    }
+}
+
+bool Stats::onFrame(uint64_t tickCount, uint64_t clock_time_ps, uint64_t sleptNs, uint64_t videoFrames, uint64_t uartBytes) {
+    uint64_t now = nowNs();
+    if( lastNs == 0 ) {
+        restart(tickCount, clock_time_ps, sleptNs, videoFrames, uartBytes);
+        return false;
+    }
+    if( now - lastNs < SAMPLE_INTERVAL_NS ) {
+        return false;
+    }
+
+    double hostSeconds = (now - lastNs) / 1e9;
+    double emulatedSeconds = (clock_time_ps - lastClockPs) / 1e12;
+    // Counters can go backwards over a reset
+    uint64_t cycles = tickCount >= lastTickCount ? tickCount - lastTickCount : tickCount;
+    uint64_t uart = uartBytes >= lastUartBytes ? uartBytes - lastUartBytes : uartBytes;
+    uint64_t workNs = (now - lastNs) - std::min(now - lastNs, sleptNs - lastSleptNs);
+
+    sample.valid = true;
+    sample.seconds = (now - firstNs) / 1e9;
+    sample.mhz = cycles / hostSeconds / 1e6;
+    sample.hostMsPerSecond = emulatedSeconds > 0 ? (workNs / 1e6) / emulatedSeconds : 0;
+    sample.videoFps = (videoFrames - lastVideoFrames) / hostSeconds;
+    sample.audioDropped = audioDropped;
+    sample.uartBytesPerSecond = uart / hostSeconds;
+    for( int i=0; i<DEVICE_COUNT; i++ ) {
+        sample.deviceUsPerSecond[i] = (deviceNs[i] / 1e3) / hostSeconds;
+    }
+
+    if( file.is_open() ) {
+        writeSample();
+    }
+
+    restart(tickCount, clock_time_ps, sleptNs, videoFrames, uartBytes);
+    return true;
+}
+
+void Stats::writeSample() {
+    file << std::fixed << std::setprecision(3);
+    file << "{\"time\":" << sample.seconds
+         << ",\"mhz\":" << sample.mhz
+         << ",\"host_ms_per_emulated_s\":" << sample.hostMsPerSecond
+         << ",\"video_fps\":" << sample.videoFps
+         << ",\"audio_dropped\":" << sample.audioDropped
+         << ",\"uart_bytes_per_s\":" << sample.uartBytesPerSecond
+         << ",\"device_us_per_s\":{";
+    for( int i=0; i<DEVICE_COUNT; i++ ) {
+        file << (i ? "," : "") << "\"" << DEVICE_NAMES[i] << "\":" << sample.deviceUsPerSecond[i];
+    }
+    file << "}}" << std::endl;
+}
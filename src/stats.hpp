@@ -0,0 +1,86 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+
+/**
+ * Running performance counters for the emulator.
+ *
+ * The run loop reports cheap counts as they happen and calls onFrame() at each
+ * frame boundary. About once a second the counts are turned into a Sample of
+ * rates, which is written as a JSON line if a stats file is open, and shown on
+ * the overlay. Time spent in each device is only measured while timing is on.
+ */
+class Stats {
+    public:
+        enum Device {DEVICE_PIO, DEVICE_I2C, DEVICE_RTC, DEVICE_UART, DEVICE_VIDEOBEAST, DEVICE_AUDIO, DEVICE_COUNT};
+
+        struct Sample {
+            bool     valid = false;
+            double   seconds = 0;               // Host time since the stats started
+            double   mhz = 0;                   // Emulated clock rate achieved
+            double   hostMsPerSecond = 0;       // Host time spent working (not sleeping) per emulated second
+            double   videoFps = 0;
+            uint64_t audioDropped = 0;          // Samples lost to a full audio buffer
+            double   uartBytesPerSecond = 0;
+            double   deviceUsPerSecond[DEVICE_COUNT] = {0};   // Host time in each device tick
+        };
+
+        static const char* DEVICE_NAMES[DEVICE_COUNT];
+
+        bool openFile(const char *filename);
+
+        // Timing costs two clock reads per device tick, so it is only on when asked for
+        void setTiming(bool timing);
+        bool isTiming() const;
+
+        uint64_t startTimer() const {
+            return timing.load(std::memory_order_relaxed) ? nowNs() : 0;
+        }
+
+        void stopTimer(Device device, uint64_t startNs) {
+            if( startNs ) {
+                deviceNs[device] += nowNs() - startNs;
+            }
+        }
+
+        void audioSampleDropped() {
+            audioDropped++;
+        }
+
+        // Start a new interval, so time spent stopped in the debugger is not counted
+        void restart(uint64_t tickCount, uint64_t clock_time_ps, uint64_t sleptNs, uint64_t videoFrames, uint64_t uartBytes);
+
+        // Returns true when a new sample has been taken
+        bool onFrame(uint64_t tickCount, uint64_t clock_time_ps, uint64_t sleptNs, uint64_t videoFrames, uint64_t uartBytes);
+
+        const Sample& latest() const {
+            return sample;
+        }
+
+    private:
+        const uint64_t SAMPLE_INTERVAL_NS = 1000000000ULL;
+
+        static uint64_t nowNs() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        void writeSample();
+
+        std::atomic<bool> timing {false};
+        std::ofstream     file;
+
+        uint64_t firstNs = 0;
+        uint64_t lastNs = 0;
+        uint64_t lastTickCount = 0;
+        uint64_t lastClockPs = 0;
+        uint64_t lastSleptNs = 0;
+        uint64_t lastVideoFrames = 0;
+        uint64_t lastUartBytes = 0;
+
+        uint64_t audioDropped = 0;
+        uint64_t deviceNs[DEVICE_COUNT] = {0};
+
+        Sample sample;
+};
@@ -0,0 +1,221 @@
+#include "testrunner.hpp"
+#include "machine.hpp"
+#include "listing.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+bool TestRunner::addCondition(const std::string &text, bool pass, Listing &listing) {
+    TestCondition condition;
+    condition.pass = pass;
+    condition.text = text;
+
+    if( text.rfind("break=", 0) == 0 ) {
+        condition.kind = TestCondition::BREAK;
+        int breaks = 0;
+        for( const TestCondition &other : conditions ) {
+            breaks += other.kind == TestCondition::BREAK;
+        }
+        // Each is a user breakpoint, of which the debugger has 8
+        if( breaks == 8 ) {
+            std::cout << "Too many break conditions, 8 at most" << std::endl;
+            return false;
+        }
+        if( !resolve(text.substr(6), listing, condition) ) {
+            return false;
+        }
+    }
+    else if( text.rfind("uart=", 0) == 0 ) {
+        condition.kind = TestCondition::UART;
+        try {
+            condition.pattern = std::regex(text.substr(5));
+        }
+        catch( const std::regex_error &error ) {
+            std::cout << "Bad pattern in " << text << ": " << error.what() << std::endl;
+            return false;
+        }
+    }
+    else if( text.rfind("mem=", 0) == 0 ) {
+        condition.kind = TestCondition::MEMORY;
+        size_t colon = text.rfind(':');
+        char *end = nullptr;
+        unsigned long value = colon == std::string::npos ? 0 : strtoul(text.c_str() + colon + 1, &end, 16);
+        if( colon == std::string::npos || colon + 1 == text.size() || *end || value > 0xFF ) {
+            std::cout << "Expected mem=<address>:<value> with a hex byte, not " << text << std::endl;
+            return false;
+        }
+        condition.value = value;
+        if( !resolve(text.substr(4, colon - 4), listing, condition) ) {
+            return false;
+        }
+    }
+    else {
+        std::cout << "Unknown condition " << text << ", expected break=, uart= or mem=" << std::endl;
+        return false;
+    }
+    conditions.push_back(condition);
+    return true;
+}
+
+// A label if a listing has it, since plenty of labels are also hex
+bool TestRunner::resolve(const std::string &text, Listing &listing, TestCondition &condition) const {
+    Listing::Symbol symbol;
+    if( listing.findSymbol(text, symbol) ) {
+        condition.address = (symbol.page << 14) | (symbol.value & 0x3FFF);
+        condition.isPhysical = true;
+        return true;
+    }
+    char *end = nullptr;
+    unsigned long address = strtoul(text.c_str(), &end, 16);
+    if( text.empty() || *end || address > 0xFFFF ) {
+        std::cout << "No label or address " << text << std::endl;
+        return false;
+    }
+    condition.address = address;
+    condition.isPhysical = false;
+    return true;
+}
+
+int TestRunner::run(Machine &machine) {
+    auto start = std::chrono::steady_clock::now();
+    machine.runTest(conditions, budget, result);
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if( result.met ) {
+        passed = result.met->pass;
+        reason = result.met->text;
+    }
+    else {
+        bool anyPass = false;
+        for( const TestCondition &condition : conditions ) {
+            anyPass |= condition.pass;
+        }
+        passed = !anyPass;
+        reason = "ran " + std::to_string(budget) + " cycles";
+    }
+    return passed ? PASSED : FAILED;
+}
+
+void TestRunner::report(std::ostream &out) const {
+    out << (passed ? "PASSED " : "FAILED ") << name << " (" << reason << ") after " << result.cycles
+        << " cycles in " << std::setprecision(2) << std::fixed << seconds << "s at PC "
+        << std::hex << std::uppercase << std::setfill('0') << std::setw(4) << result.pc
+        << std::dec << std::setfill(' ') << std::endl;
+}
+
+bool TestRunner::writeReport(const char *filename) const {
+    return writeReport(filename, std::vector<const TestRunner *>{this});
+}
+
+double TestRunner::totalSeconds(const std::vector<const TestRunner *> &tests) {
+    double total = 0;
+    for( const TestRunner *test : tests ) {
+        total += test->seconds;
+    }
+    return total;
+}
+
+bool TestRunner::writeReport(const char *filename, const std::vector<const TestRunner *> &tests) {
+    std::ofstream out(filename);
+    std::string path(filename);
+    out << std::fixed << std::setprecision(3);
+    if( path.size() > 4 && path.compare(path.size() - 4, 4, ".xml") == 0 ) {
+        int failures = 0;
+        for( const TestRunner *test : tests ) {
+            failures += !test->passed;
+        }
+        out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" << std::endl;
+        out << "<testsuite name=\"beastem\" tests=\"" << tests.size() << "\" failures=\"" << failures
+            << "\" time=\"" << totalSeconds(tests) << "\">" << std::endl;
+        for( const TestRunner *test : tests ) {
+            test->writeJUnit(out);
+        }
+        out << "</testsuite>" << std::endl;
+    }
+    else {
+        out << "[" << std::endl;
+        for( size_t i=0; i<tests.size(); i++ ) {
+            tests[i]->writeJson(out);
+            out << (i + 1 < tests.size() ? "," : "") << std::endl;
+        }
+        out << "]" << std::endl;
+    }
+    out.close();
+    if( !out ) {
+        std::cout << "Could not write test report " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Control characters aren't allowed in XML 1.0 at all, so they are written out as \xNN
+static std::string xmlEscape(const std::string &text) {
+    std::string escaped;
+    for( char c : text ) {
+        switch( c ) {
+            case '&':  escaped += "&amp;"; break;
+            case '<':  escaped += "&lt;"; break;
+            case '>':  escaped += "&gt;"; break;
+            case '"':  escaped += "&quot;"; break;
+            case '\n': case '\r': case '\t':
+                escaped += c;
+                break;
+            default:
+                if( (uint8_t)c < 0x20 ) {
+                    char hex[8];
+                    snprintf(hex, sizeof(hex), "\\x%02X", (uint8_t)c);
+                    escaped += hex;
+                }
+                else {
+                    escaped += c;
+                }
+        }
+    }
+    return escaped;
+}
+
+static std::string jsonEscape(const std::string &text) {
+    std::string escaped;
+    for( char c : text ) {
+        switch( c ) {
+            case '"':  escaped += "\\\""; break;
+            case '\\': escaped += "\\\\"; break;
+            case '\n': escaped += "\\n"; break;
+            case '\r': escaped += "\\r"; break;
+            case '\t': escaped += "\\t"; break;
+            default:
+                if( (uint8_t)c < 0x20 || (uint8_t)c >= 0x7F ) {
+                    char hex[8];
+                    snprintf(hex, sizeof(hex), "\\u%04X", (uint8_t)c);
+                    escaped += hex;
+                }
+                else {
+                    escaped += c;
+                }
+        }
+    }
+    return escaped;
+}
+
+void TestRunner::writeJUnit(std::ostream &out) const {
+    out << "  <testcase name=\"" << xmlEscape(name) << "\" classname=\"beastem\" time=\"" << seconds << "\">" << std::endl;
+    out << "    <properties>" << std::endl;
+    out << "      <property name=\"cycles\" value=\"" << result.cycles << "\"/>" << std::endl;
+    out << "      <property name=\"pc\" value=\"" << result.pc << "\"/>" << std::endl;
+    out << "    </properties>" << std::endl;
+    if( !passed ) {
+        out << "    <failure message=\"" << xmlEscape(reason) << "\"/>" << std::endl;
+    }
+    out << "    <system-out>" << xmlEscape(result.uart) << "</system-out>" << std::endl;
+    out << "  </testcase>" << std::endl;
+}
+
+void TestRunner::writeJson(std::ostream &out) const {
+    out << "  {\"name\":\"" << jsonEscape(name) << "\",\"passed\":" << (passed ? "true" : "false")
+        << ",\"reason\":\"" << jsonEscape(reason) << "\",\"cycles\":" << result.cycles
+        << ",\"seconds\":" << seconds << ",\"pc\":" << result.pc
+        << ",\"uart\":\"" << jsonEscape(result.uart) << "\"}";
+}
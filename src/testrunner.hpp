@@ -0,0 +1,97 @@
+#pragma once
+#include <stdint.h>
+#include <ostream>
+#include <regex>
+#include <string>
+#include <vector>
+
+class Machine;
+class Listing;
+
+/**
+ * testrunner.hpp - Runs a guest program headless until it passes or fails, for scripts and CI
+ *
+ * The test ends at the first of its conditions to be met, each given to --pass or --fail:
+ *
+ *   break=<address>          The CPU reaches this address
+ *   uart=<regex>             What has been sent out of the UART so far matches
+ *   mem=<address>:<value>    The byte at this address holds this value
+ *
+ * An address is a label from a loaded listing, which is in that listing's page, or else
+ * hex in the CPU's address space. Values are hex. A breakpoint is checked on the
+ * instruction, the UART on each byte, and memory on each CPU write to it (for the first
+ * few addresses) and otherwise once a frame's worth of cycles.
+ *
+ * If the cycle budget runs out first, the test fails, unless there were only --fail
+ * conditions, as for a soak test that mustn't go wrong.
+ */
+struct TestCondition {
+    enum Kind {BREAK, UART, MEMORY} kind;
+    bool        pass;               // Met means the test passed, or else failed
+    std::string text;               // As given, for the report
+    uint32_t    address = 0;
+    bool        isPhysical = false; // Labels are in their listing's page
+    uint8_t     value = 0;
+    std::regex  pattern;
+};
+
+struct TestResult {
+    const TestCondition *met = nullptr;     // Or nullptr if the budget ran out
+    uint64_t    cycles = 0;
+    uint16_t    pc = 0;
+    std::string uart;                       // Everything sent out of the UART
+};
+
+class TestRunner {
+    public:
+        static const int PASSED = 0;
+        static const int FAILED = 1;
+        static const int ERROR = 2;         // The test couldn't be run as given
+
+        /* A condition as given to --pass or --fail, as above */
+        bool addCondition(const std::string &text, bool pass, Listing &listing);
+
+        /* Most cycles to run for, 0 for no limit */
+        void setCycleBudget(uint64_t cycles) {
+            budget = cycles;
+        }
+
+        /* Names the test in the report */
+        void setName(const std::string &name) {
+            this->name = name;
+        }
+
+        bool hasConditions() const {
+            return !conditions.empty() || budget != 0;
+        }
+
+        /* Run to the end of the test from where the machine is now. Returns PASSED or FAILED */
+        int run(Machine &machine);
+
+        bool isPassed() const {
+            return passed;
+        }
+
+        /* One line saying how the test ended */
+        void report(std::ostream &out) const;
+
+        /* JUnit XML if the filename ends .xml, otherwise JSON */
+        bool writeReport(const char *filename) const;
+
+        /* The same for a suite of tests that have all been run */
+        static bool writeReport(const char *filename, const std::vector<const TestRunner *> &tests);
+
+    private:
+        std::vector<TestCondition> conditions;
+        uint64_t    budget = 0;
+        std::string name = "beastem";
+        TestResult  result;
+        bool        passed = false;
+        std::string reason;
+        double      seconds = 0;
+
+        bool resolve(const std::string &text, Listing &listing, TestCondition &condition) const;
+        void writeJUnit(std::ostream &out) const;
+        void writeJson(std::ostream &out) const;
+        static double totalSeconds(const std::vector<const TestRunner *> &tests);
+};
@@ -6,7 +6,6 @@
 
 #include <stdint.h>
 #include <stdbool.h>
-#include <SDL_net.h>
 
 #ifdef __cplusplus
 #include <iostream> // TODO: Remove debug
@@ -41,6 +40,15 @@ extern "C" {
 #define UART_SO     (1ULL<<UART_PIN_SO)
 #define UART_CTS    (1ULL<<UART_PIN_CTS)
 
+/* How the UART reaches the network, so the chip itself needs no networking library */
+typedef struct {
+    void*   (*listen)(int port);    // A server on this port, or NULL
+    void*   (*accept)(void *server); // A waiting connection, or NULL
+    int     (*receive)(void *client, uint8_t *buffer, int length); // Bytes ready now, without waiting
+    void    (*send)(void *client, uint8_t byte);
+    void    (*close)(void *client);
+} uart_network_t;
+
 typedef struct {
     uint64_t clock_hz, cycle_ps;
     uint64_t last_tick_ps;
@@ -71,26 +79,47 @@ typedef struct {
     uint8_t modem_status_register;
     uint8_t scratch_register;
 
-    TCPsocket  client, server;
-    SDLNet_SocketSet socketSet;
+    void       *client, *server;
+    const uart_network_t *network;
     int        port;
     uint8_t    rx_buffer[RX_BUFFER_SIZE];
     uint16_t   rx_available;
     uint16_t   rx_offset;
+
+    uint64_t   bytes_transferred;   // Bytes sent plus received, kept over reset for statistics
+    bool       offline;             // Nothing is sent to the console or connection, e.g. while replaying history
+
+    // Where received bytes come from if set, e.g. a journal of earlier input, instead of uart_receive()
+    int        (*receive)(void *context, uint8_t *buffer, int length);
+    void       *receive_context;
+
+    // Where sent bytes go if set, e.g. captured by a test, instead of the console and connection
+    void       (*transmit)(void *context, uint8_t byte);
+    void       *transmit_context;
 } uart_t;
 
-void uart_init(uart_t* uart, uint64_t clock_hz, uint64_t time_ps);
+/* Listens for a network connection on port, unless it is 0 or there is no network */
+void uart_init(uart_t* uart, uint64_t clock_hz, uint64_t time_ps, int port, const uart_network_t *network);
 
 void uart_reset(uart_t* uart, uint64_t clock_hz);
 
 uint64_t uart_tick(uart_t* uart, uint64_t time_ps);
 
+uint64_t uart_next_tick(uart_t* uart);
+
+bool uart_idle(uart_t* uart);
+
+uint64_t uart_skip_idle(uart_t* uart, uint64_t time_ps);
+
 void uart_write(uart_t* uart, uint8_t addr, uint8_t data, uint64_t time_ps);
 
 uint8_t uart_read(uart_t* uart, uint8_t addr);
 
 void uart_connect(uart_t* uart, bool connect);
 
+/* Bytes waiting on the network connection, up to length. Returns how many were read */
+int  uart_receive(uart_t* uart, uint8_t *buffer, int length);
+
 bool uart_connected(uart_t* uart);
 
 int  uart_port(uart_t* uart);
@@ -115,30 +144,28 @@ int  uart_port(uart_t* uart);
 #define _UART_UNREACHABLE
 #endif
 
-void uart_init(uart_t* uart, uint64_t clock_hz, uint64_t time_ps) {
+void uart_init(uart_t* uart, uint64_t clock_hz, uint64_t time_ps, int port, const uart_network_t *network) {
     std::cout << "UART init. Clock rate " << clock_hz << std::endl;
 
     CHIPS_ASSERT(uart);
     memset(uart, 0, sizeof(uart_t));
 
     uart->last_tick_ps = time_ps;
-    uart->port = 8456;
+    uart->port = port;
+    uart->network = network;
 
-    IPaddress ip;
+    // Reset first, so the UART still clocks when no network port is available
+    uart_reset(uart, clock_hz);
 
-    if (SDLNet_ResolveHost(&ip, NULL, uart->port) == -1) {
-      std::cout << "SDLNet_ResolveHost error: " << SDLNet_GetError() << std::endl;
-      return;
+    if( !port || !network ) {
+        return;
     }
 
-    uart->server = SDLNet_TCP_Open(&ip);
+    uart->server = network->listen(port);
     if (!uart->server) {
-      std::cout << "SDLNet_TCP_Open error: " << SDLNet_GetError() << std::endl;
       return;
     }
 
-    uart_reset(uart, clock_hz);
-
     std::cout << "Divisor "<< uart->divisor << " Baud rate : " << (uart->clock_hz / (uart->divisor) / 16) << std::endl;
 }
 
@@ -147,10 +174,16 @@ void uart_reset(uart_t* uart, uint64_t clock_hz) {
     uint64_t time_ps = uart->last_tick_ps;
     int port         = uart->port;
 
-    TCPsocket  client= uart->client;
-    TCPsocket  server= uart->server;
+    void       *client = uart->client;
+    void       *server = uart->server;
 
-    SDLNet_SocketSet socketSet = uart->socketSet;
+    const uart_network_t *network = uart->network;
+    uint64_t bytes_transferred = uart->bytes_transferred;
+    bool     offline           = uart->offline;
+    int      (*receive)(void*, uint8_t*, int) = uart->receive;
+    void     *receive_context  = uart->receive_context;
+    void     (*transmit)(void*, uint8_t) = uart->transmit;
+    void     *transmit_context = uart->transmit_context;
 
     // initial state as described in TI Datasheet TL16C550D
     memset(uart, 0, sizeof(uart_t));
@@ -173,19 +206,27 @@ void uart_reset(uart_t* uart, uint64_t clock_hz) {
     uart->port         = port;
     uart->client       = client;
     uart->server       = server;
-    uart->socketSet    = socketSet;
+    uart->network      = network;
+    uart->bytes_transferred = bytes_transferred;
+    uart->offline      = offline;
+    uart->receive      = receive;
+    uart->receive_context = receive_context;
+    uart->transmit     = transmit;
+    uart->transmit_context = transmit_context;
 }
 
 void uart_connect(uart_t* uart, bool connect) {
     if( !connect && uart->client ) {
-        SDLNet_TCP_Close(uart->client);
+        uart->network->close(uart->client);
         uart->client = NULL;
         return;
     }
 
-    uart->client = SDLNet_TCP_Accept(uart->server);
+    if( !uart->server ) {
+        return;
+    }
 
-    uart->rx_available = 0;
+    uart->client = uart->network->accept(uart->server);
 
     if( !uart->client ) {
         return;
@@ -193,17 +234,20 @@ void uart_connect(uart_t* uart, bool connect) {
     else {
         std::cout << "Network client created on port " << uart->port << std::endl;
 
-        uart->socketSet = SDLNet_AllocSocketSet(1);
-        if( uart->socketSet ) {
-            SDLNet_TCP_AddSocket(uart->socketSet, uart->client);
-        }
-        else {
-            std::cout << "Couldn't create socket set, closing connection" <<std::endl;
-            uart->client = NULL;
-        }
+        // Nothing left over from an earlier connection
+        uart->rx_available = 0;
+        uart->rx_offset = 0;
+        uart->is_receiving = false;
     }
 }
 
+int uart_receive(uart_t* uart, uint8_t *buffer, int length) {
+    if( !uart->client ) {
+        return 0;
+    }
+    return uart->network->receive(uart->client, buffer, length);
+}
+
 bool uart_connected(uart_t* uart) {
     return uart->client;
 }
@@ -276,10 +320,16 @@ uint64_t uart_tick(uart_t* uart, uint64_t time_ps) {
 
                             // DEBUG OUTPUT
                             //std::cout << "Sent byte :" << (0+uart->tx_shift) << "(" << (char)uart->tx_shift << ")" << std::endl;
-                            std::cout << (char)uart->tx_shift;
-                            if( uart->client ) {
-                                SDLNet_TCP_Send(uart->client, &uart->tx_shift, 1);
+                            if( !uart->offline && uart->transmit ) {
+                                uart->transmit(uart->transmit_context, (uint8_t)uart->tx_shift);
+                            }
+                            else if( !uart->offline ) {
+                                std::cout << (char)uart->tx_shift;
+                                if( uart->client ) {
+                                    uart->network->send(uart->client, (uint8_t)uart->tx_shift);
+                                }
                             }
+                            uart->bytes_transferred++;
                         }
                         else {
                             uart->tx_bit += 1;
@@ -338,6 +388,7 @@ uint64_t uart_tick(uart_t* uart, uint64_t time_ps) {
                     }
 
                     uart->line_status_register |= LSR_DR;
+                    uart->bytes_transferred++;
 
                     if(uart->rx_offset == uart->rx_available) {
                         uart->is_receiving = false;
@@ -345,31 +396,13 @@ uint64_t uart_tick(uart_t* uart, uint64_t time_ps) {
                 } 
             }
         } else {
-            if( uart->client ) {
-                int check = SDLNet_CheckSockets(uart->socketSet, 0);
-                if( check > 0) {
-                    int available = SDLNet_TCP_Recv(uart->client, uart->rx_buffer, RX_BUFFER_SIZE);
-                    if( available > 0 ) {
-                        uart->rx_available = available;
-                        uart->is_receiving = true;
-                        uart->rx_offset = 0;
-                        uart->rx_cycles = 0;
-                        /**
-                        std::cout << "Read " << available << " bytes:\n"<<std::endl;
-                        int index = 0;
-                        while( index < available ) {
-                            std::cout << std::hex << "Read " << (index) << ": ";
-                            for( int i=0; i<16; i++ ) {
-                                if(index+i < available) {
-                                    std::cout << (0+uart->rx_buffer[index+i]) << " ";
-                                }
-                            }
-                            std::cout << std::dec << std::endl;
-                            index+=16;
-                        }
-                        */
-                    }
-                }
+            int available = uart->receive ? uart->receive(uart->receive_context, uart->rx_buffer, RX_BUFFER_SIZE)
+                                          : uart_receive(uart, uart->rx_buffer, RX_BUFFER_SIZE);
+            if( available > 0 ) {
+                uart->rx_available = available;
+                uart->is_receiving = true;
+                uart->rx_offset = 0;
+                uart->rx_cycles = 0;
             }
         }
 
@@ -379,6 +412,27 @@ uint64_t uart_tick(uart_t* uart, uint64_t time_ps) {
     return uart->last_tick_ps + (uart->cycle_ps * uart->divisor);
 }
 
+// Time of the next bit clock, when uart_tick next has work to do
+uint64_t uart_next_tick(uart_t* uart) {
+    return uart->last_tick_ps + (uart->cycle_ps * uart->divisor);
+}
+
+// Nothing to send or receive, so bit clocks only poll for new input
+bool uart_idle(uart_t* uart) {
+    return (uart->tx_bytes == 0) && (uart->tx_bit == 0) && !uart->is_receiving;
+}
+
+// Move an idle UART's bit clock on to the last tick at or before time_ps in one step,
+// rather than polling on every bit clock. The next poll is then the first tick after
+// time_ps, as it would have been without the skip.
+uint64_t uart_skip_idle(uart_t* uart, uint64_t time_ps) {
+    uint64_t period = uart->cycle_ps * uart->divisor;
+    if( uart->last_tick_ps + period <= time_ps ) {
+        uart->last_tick_ps += ((time_ps - uart->last_tick_ps) / period) * period;
+    }
+    return uart_next_tick(uart);
+}
+
 void uart_write(uart_t* uart, uint8_t addr, uint8_t data, uint64_t time_ps) {
     // std::cout << "Uart write " << (0+addr) << " <- " << (0+data) << std::endl;
     switch( addr & 0x07 ) {
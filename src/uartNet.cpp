@@ -0,0 +1,65 @@
+#include "uartNet.hpp"
+
+#include <iostream>
+#include <SDL_net.h>
+
+// A connection, with the socket set that lets it be polled without blocking
+struct SdlNetClient {
+    TCPsocket        socket;
+    SDLNet_SocketSet socketSet;
+};
+
+static void *sdlnetListen(int port) {
+    IPaddress ip;
+
+    if (SDLNet_ResolveHost(&ip, NULL, port) == -1) {
+      std::cout << "SDLNet_ResolveHost error: " << SDLNet_GetError() << std::endl;
+      return NULL;
+    }
+
+    TCPsocket server = SDLNet_TCP_Open(&ip);
+    if (!server) {
+      std::cout << "SDLNet_TCP_Open error: " << SDLNet_GetError() << std::endl;
+    }
+    return server;
+}
+
+static void *sdlnetAccept(void *server) {
+    TCPsocket socket = SDLNet_TCP_Accept((TCPsocket)server);
+    if( !socket ) {
+        return NULL;
+    }
+
+    SDLNet_SocketSet socketSet = SDLNet_AllocSocketSet(1);
+    if( !socketSet ) {
+        std::cout << "Couldn't create socket set, closing connection" <<std::endl;
+        SDLNet_TCP_Close(socket);
+        return NULL;
+    }
+    SDLNet_TCP_AddSocket(socketSet, socket);
+    return new SdlNetClient{socket, socketSet};
+}
+
+static int sdlnetReceive(void *client, uint8_t *buffer, int length) {
+    SdlNetClient *connection = (SdlNetClient *)client;
+    if( SDLNet_CheckSockets(connection->socketSet, 0) <= 0 ) {
+        return 0;
+    }
+    int received = SDLNet_TCP_Recv(connection->socket, buffer, length);
+    return received > 0 ? received : 0;
+}
+
+static void sdlnetSend(void *client, uint8_t byte) {
+    SDLNet_TCP_Send(((SdlNetClient *)client)->socket, &byte, 1);
+}
+
+static void sdlnetClose(void *client) {
+    SdlNetClient *connection = (SdlNetClient *)client;
+    SDLNet_TCP_Close(connection->socket);
+    SDLNet_FreeSocketSet(connection->socketSet);
+    delete connection;
+}
+
+const uart_network_t UART_SDLNET = {
+    sdlnetListen, sdlnetAccept, sdlnetReceive, sdlnetSend, sdlnetClose
+};
@@ -0,0 +1,5 @@
+#pragma once
+#include "uart16c550.h"
+
+/* The UART's network connection over SDL_net, which must have been initialised */
+extern const uart_network_t UART_SDLNET;
@@ -0,0 +1,157 @@
+#include "videoWindow.hpp"
+#include <iostream>
+
+VideoWindow::VideoWindow(float zoom) {
+    requestedZoom = zoom;
+}
+
+void VideoWindow::init(uint64_t clock_time_ps) {
+    if( surface == nullptr ) {
+        createWindow();
+    }
+    VideoBeast::init(clock_time_ps);
+    clearWindow();
+}
+
+int VideoWindow::place(int guiWidth) {
+    SDL_DisplayMode display;
+
+    int displayIndex = SDL_GetWindowDisplayIndex(window);
+    if( SDL_GetDesktopDisplayMode(displayIndex, &display) == 0) {
+        int space = (display.w - guiWidth - (VIDEO_MODE[mode].pixelWidth * zoom))/3;
+        if( space < 0 ) space = 0;
+        SDL_SetWindowPosition(window, display.w - (VIDEO_MODE[mode].pixelWidth * zoom) - space, SDL_WINDOWPOS_CENTERED);
+
+        return space;
+    }
+    return -1;
+}
+
+uint32_t VideoWindow::mapColour(uint8_t r, uint8_t g, uint8_t b) {
+    if( window_format == nullptr ) {
+        return VideoBeast::mapColour(r, g, b);
+    }
+    return SDL_MapRGB(window_format, r, g, b);
+}
+
+void VideoWindow::drawLine(int line) {
+    if( !surface || resizePending.load(std::memory_order_acquire) ) {
+        return;
+    }
+    int step = (int)(isDoubled ? zoom * 2.0 : zoom);
+        
+    int dest = line*surface->pitch * zoom;
+
+    // TODO: This is a bit nasty - lots of assumptions about bytes per pixel..
+    for(int row=0; row<zoom; row++) {
+        if( line++ < surface->h ) {
+            for(int i=0; i<surface->w; i++) {
+                *(Uint32 *)((Uint8 *)surface->pixels+dest) = line_buffer[i/step];
+                dest += surface->format->BytesPerPixel;
+            }
+        }
+    }
+}
+
+void VideoWindow::frameDone() {
+    if( deferredPresent ) {
+        framePending.store(true);
+    }
+    else if( window ) {
+        SDL_UpdateWindowSurface(window);
+    }
+}
+
+void VideoWindow::modeChanged() {
+    if( deferredPresent ) {
+        // Surface is replaced by the resize, so stop drawing until the UI thread has done it
+        resizePending.store(true, std::memory_order_release);
+    }
+    else {
+        updateMode();
+    }
+}
+
+void VideoWindow::handleEvent(SDL_Event windowEvent)
+{
+    if( SDL_KEYDOWN == windowEvent.type && windowEvent.window.windowID == windowID ) {
+        switch( windowEvent.key.keysym.sym ) {
+            case SDLK_LEFTBRACKET : 
+                debug_layers  = !debug_layers;
+                break;
+            case SDLK_RIGHTBRACKET :
+                layer_time_alpha = 1.0-layer_time_alpha;
+                break;
+        }
+    }
+}
+
+void VideoWindow::setDeferredPresent(bool deferred) {
+    deferredPresent = deferred;
+}
+
+void VideoWindow::present() {
+    if( resizePending.load(std::memory_order_acquire) ) {
+        updateMode();
+        resizePending.store(false, std::memory_order_release);
+    }
+    if( framePending.exchange(false) && window ) {
+        SDL_UpdateWindowSurface(window);
+    }
+}
+
+void VideoWindow::createWindow() {
+    int width = VIDEO_MODE[mode].pixelWidth * requestedZoom;
+    int height = VIDEO_MODE[mode].pixelHeight * requestedZoom;
+
+    window = SDL_CreateWindow("Feersum VideoBeast Emulator (Beta) v1.0", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, width, height, SDL_WINDOW_ALLOW_HIGHDPI);
+
+    if( NULL == window ) {
+        std::cout << "Could not create window: " << SDL_GetError() << std::endl;
+        exit(1);
+    }
+
+    windowID = SDL_GetWindowID( window );
+    checkWindow(width, height);
+    window_format = SDL_AllocFormat(surface->format->format);
+}
+
+void VideoWindow::updateMode() {
+    if( window == nullptr ) {
+        return;
+    }
+    int width = VIDEO_MODE[mode].pixelWidth * requestedZoom;
+    int height = VIDEO_MODE[mode].pixelHeight * requestedZoom;
+
+    SDL_SetWindowSize(window, width, height);
+
+    checkWindow(width, height);
+}
+
+void VideoWindow::checkWindow(int width, int height) {
+    surface = SDL_GetWindowSurface(window);
+    zoom = requestedZoom;
+
+    if(surface->w != width) {
+        float widthScale = (float)surface->w / (float) (width);
+        float heightScale = (float)surface->h / (float) (height);
+
+        if(widthScale != heightScale) {
+            std::cerr << "WARNING: width scale != height scale" << std::endl;
+        }
+
+        zoom *= widthScale;
+    }
+}
+
+void VideoWindow::clearWindow() {
+    uint32_t dest = 0;
+    
+    for( int y=0; y < surface->h; y++ ) {
+        for(int x=0; x<surface->w; x++) {
+            *(Uint32 *)((uint8_t*)surface->pixels+dest) = background;
+            dest += surface->format->BytesPerPixel;
+        }
+    }
+    SDL_UpdateWindowSurface(window);
+}
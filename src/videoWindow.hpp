@@ -0,0 +1,44 @@
+#pragma once
+#include <atomic>
+#include "SDL.h"
+
+#include "videobeast.hpp"
+
+/* A VideoBeast with a window of its own to draw into */
+class VideoWindow: public VideoBeast {
+
+    public:
+        VideoWindow(float zoom);
+
+        void     init(uint64_t clock_time_ps) override;
+        // Move the window to the right of one this wide. Returns the space left either side
+        int      place(int guiWidth);
+
+        void     handleEvent(SDL_Event windowEvent);
+
+        // When emulation runs on its own thread, window updates are left for the UI thread to present()
+        void     setDeferredPresent(bool deferred);
+        void     present();
+
+    protected:
+        uint32_t mapColour(uint8_t r, uint8_t g, uint8_t b) override;
+        void     drawLine(int line) override;
+        void     frameDone() override;
+        void     modeChanged() override;
+
+    private:
+        SDL_Window *window = nullptr;
+        SDL_Surface *surface = nullptr;
+        SDL_PixelFormat *window_format = nullptr;
+        bool  deferredPresent = false;
+        std::atomic<bool> framePending {false};
+        std::atomic<bool> resizePending {false};
+        float requestedZoom = 1.0;
+        float zoom = 2.0;
+        uint32_t windowID;
+
+        void createWindow();
+        void updateMode();
+        void checkWindow(int width, int height);
+        void clearWindow();
+};
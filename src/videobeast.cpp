@@ -1,21 +1,17 @@
 #include "videobeast.hpp"
 #include "assets.hpp"
+#include "savestate.hpp"
 #include <iostream>
 #include <fstream>
 #include <algorithm> 
 
-VideoBeast::VideoBeast(float zoom) {
-    requestedZoom = zoom;
+VideoBeast::VideoBeast() {
 }
 
 VideoBeast::~VideoBeast() {
 }
 
-int VideoBeast::init(uint64_t clock_time_ps, int guiWidth) {
-    if( surface == nullptr ) {
-        createWindow();
-    }
-
+void VideoBeast::init(uint64_t clock_time_ps) {
     next_action_time_ps = clock_time_ps;
     next_line_time_ps = clock_time_ps + VIDEO_MODE[mode].totalWidth * VIDEO_MODE[mode].pixel_clock_ps;
 
@@ -23,35 +19,31 @@ int VideoBeast::init(uint64_t clock_time_ps, int guiWidth) {
     currentLine = 0;
     currentLayer = IDLE;
 
-    pixel_format = SDL_AllocFormat(SDL_PIXELFORMAT_RGB555);
-
     loadRegisters(assetPath("video_registers.mem").c_str());
     loadPalette(assetPath("palette_1.mem").c_str(), palette1, paletteReg1);
     loadPalette(assetPath("palette_2.mem").c_str(), palette2, paletteReg2);
 
     background = getColour((registers[REG_BACKGROUND_H] << 8) + registers[REG_BACKGROUND_L]);
-    clearWindow();
+}
 
-    SDL_DisplayMode display;
+uint32_t VideoBeast::getColour(uint16_t packedRGB) {
+    uint8_t r,g,b;
+    unpackRGB(packedRGB, &r, &g, &b);
+    return mapColour(r, g, b);
+}
 
-    int displayIndex = SDL_GetWindowDisplayIndex(window);
-    if( SDL_GetDesktopDisplayMode(displayIndex, &display) == 0) {
-        int space = (display.w - guiWidth - (VIDEO_MODE[mode].pixelWidth * zoom))/3;
-        if( space < 0 ) space = 0;
-        SDL_SetWindowPosition(window, display.w - (VIDEO_MODE[mode].pixelWidth * zoom) - space, SDL_WINDOWPOS_CENTERED);
+// Without a window the pixels are ARGB8888
+uint32_t VideoBeast::mapColour(uint8_t r, uint8_t g, uint8_t b) {
+    return 0xFF000000 | (r << 16) | (g << 8) | b;
+}
 
-        return space;
-    }
-    return -1;
+void VideoBeast::drawLine(int) {
 }
 
-uint32_t VideoBeast::getColour(uint16_t packedRGB) {
-    uint8_t r,g,b;
-    //SDL_GetRGB(packedRGB, pixel_format, &r, &g, &b);
-    r = (int)(((packedRGB >> 12) & 0x07) * (255/7.0));
-    g = (int)(((packedRGB >> 7) & 0x07) * (255/7.0));
-    b = (int)(((packedRGB >> 2) & 0x07) * (255/7.0));
-    return SDL_MapRGB(surface->format, r, g, b);
+void VideoBeast::frameDone() {
+}
+
+void VideoBeast::modeChanged() {
 }
 
 void VideoBeast::unpackRGB(uint16_t packedRGB, uint8_t *r, uint8_t *g, uint8_t *b) {
@@ -346,18 +338,8 @@ void VideoBeast::loadRegisters(const char *filename) {
     myfile.close();
 }
 
-void VideoBeast::handleEvent(SDL_Event windowEvent)
-{
-    if( SDL_KEYDOWN == windowEvent.type && windowEvent.window.windowID == windowID ) {
-        switch( windowEvent.key.keysym.sym ) {
-            case SDLK_LEFTBRACKET : 
-                debug_layers  = !debug_layers;
-                break;
-            case SDLK_RIGHTBRACKET :
-                layer_time_alpha = 1.0-layer_time_alpha;
-                break;
-        }
-    }
+uint64_t VideoBeast::getFrameCount() {
+    return frameCount;
 }
 
 void VideoBeast::tickNextFrame() {
@@ -365,7 +347,7 @@ void VideoBeast::tickNextFrame() {
     displayLine = 0;
     currentLine = 0;
     frameCount++;
-    SDL_UpdateWindowSurface(window);
+    frameDone();
     isDoubled = (registers[REG_MODE] & 0x08) != 0;
 
     if( mode != (registers[REG_MODE] & 0x7) ) {
@@ -374,7 +356,7 @@ void VideoBeast::tickNextFrame() {
             std::cout << "Unsupported video mode " << mode << std::endl;
         } 
         else {
-            updateMode();
+            modeChanged();
         }
     }
 }
@@ -423,24 +405,10 @@ uint64_t VideoBeast::tick(uint64_t clock_time_ps) {
         }
 
         if( displayLine > 0 && displayLine <= VIDEO_MODE[mode].pixelHeight ) {
-            int step = (int)(isDoubled ? zoom * 2.0 : zoom);
-                
-            int dest = (displayLine-1)*surface->pitch * zoom;
-            int line = (displayLine-1);
-
-            // TODO: This is a bit nasty - lots of assumptions about bytes per pixel..
-            // ;VIDEO_MODE[mode].pixelWidth
             if( debugFromNs != 0 ) {
                 std::cout << "Draw line " << (displayLine-1) << " current line " << currentLine << " time " << (clock_time_ps/1000 - debugFromNs) << std::endl;
             }
-            for(int row=0; row<zoom; row++) {
-                if( line++ < surface->h ) {
-                    for(int i=0; i<surface->w; i++) {
-                        *(Uint32 *)((Uint8 *)surface->pixels+dest) = line_buffer[i/step];
-                        dest += surface->format->BytesPerPixel;
-                    }
-                }
-            }
+            drawLine(displayLine-1);
         }
     }
 
@@ -601,41 +569,41 @@ void VideoBeast::write(uint16_t addr, uint8_t data, uint64_t clock_time_ps) {
         // Ram access
         switch( registers[REG_MODE] >> 5) {
             case 0 : 
-                mem[ (registers[REG_PAGE_0] << 12) + (addr & 0x3FFF) ] = data;
+                writeRam((registers[REG_PAGE_0] << 12) + (addr & 0x3FFF), data);
                 break;
             case 1 :
                 if ((addr & 0x2000) == 0) { 
-                    mem[ (registers[REG_PAGE_0] << 12 ) + (addr & 0x1FFF)] = data;
+                    writeRam((registers[REG_PAGE_0] << 12 ) + (addr & 0x1FFF), data);
                 }
                 else {
-                    mem[ (registers[REG_PAGE_1] << 12 ) + (addr & 0x1FFF)] = data;
+                    writeRam((registers[REG_PAGE_1] << 12 ) + (addr & 0x1FFF), data);
                 }
                 break;
             case 2 :
                 switch ((addr >> 12) & 0x03 ) {
-                    case 0 : mem[ (registers[REG_PAGE_0] << 11 ) + (addr & 0x0FFF)] = data; break;
-                    case 1 : mem[ (registers[REG_PAGE_1] << 11 ) + (addr & 0x0FFF)] = data; break;
-                    case 2 : mem[ (registers[REG_PAGE_2] << 11 ) + (addr & 0x0FFF)] = data; break;
-                    case 3 : mem[ (registers[REG_PAGE_3] << 11 ) + (addr & 0x0FFF)] = data; break;
+                    case 0 : writeRam((registers[REG_PAGE_0] << 11 ) + (addr & 0x0FFF), data); break;
+                    case 1 : writeRam((registers[REG_PAGE_1] << 11 ) + (addr & 0x0FFF), data); break;
+                    case 2 : writeRam((registers[REG_PAGE_2] << 11 ) + (addr & 0x0FFF), data); break;
+                    case 3 : writeRam((registers[REG_PAGE_3] << 11 ) + (addr & 0x0FFF), data); break;
                     default:
                         std::cout << "VideoBeast 4K low page write error";
                 }
                 break;
             case 3 :
                 switch ((addr >> 12) & 0x03 ) {
-                    case 0 : mem[ 0x80000 | ((registers[REG_PAGE_0] << 11 ) + (addr & 0x0FFF))] = data; break;
-                    case 1 : mem[ 0x80000 | ((registers[REG_PAGE_1] << 11 ) + (addr & 0x0FFF))] = data; break;
-                    case 2 : mem[ 0x80000 | ((registers[REG_PAGE_2] << 11 ) + (addr & 0x0FFF))] = data; break;
-                    case 3 : mem[ 0x80000 | ((registers[REG_PAGE_3] << 11 ) + (addr & 0x0FFF))] = data; break;
+                    case 0 : writeRam(0x80000 | ((registers[REG_PAGE_0] << 11 ) + (addr & 0x0FFF)), data); break;
+                    case 1 : writeRam(0x80000 | ((registers[REG_PAGE_1] << 11 ) + (addr & 0x0FFF)), data); break;
+                    case 2 : writeRam(0x80000 | ((registers[REG_PAGE_2] << 11 ) + (addr & 0x0FFF)), data); break;
+                    case 3 : writeRam(0x80000 | ((registers[REG_PAGE_3] << 11 ) + (addr & 0x0FFF)), data); break;
                     default:
                         std::cout << "VideoBeast 4K high page write error";
                 }
                 break;
             case 4:
-                mem[getSinclairAddress(addr)] = data;
+                writeRam(getSinclairAddress(addr), data);
                 break;
             default:
-                mem[ (registers[REG_PAGE_0] << 12) + (addr & 0x3FFF) ] = data;
+                writeRam((registers[REG_PAGE_0] << 12) + (addr & 0x3FFF), data);
 
         } 
     }
@@ -757,7 +725,15 @@ uint8_t* VideoBeast::memoryPtr() {
 }
 
 void VideoBeast::writeRam(uint32_t address, uint8_t value)  {
-    mem[ address & (VIDEO_RAM_LENGTH-1) ] = value;
+    address &= VIDEO_RAM_LENGTH-1;
+    mem[address] = value;
+    dirtyPages |= 1ULL << (address >> 14);
+}
+
+uint64_t VideoBeast::takeDirtyPages() {
+    uint64_t pages = dirtyPages;
+    dirtyPages = 0;
+    return pages;
 }
 
 void VideoBeast::writeRegister(uint8_t address, uint8_t value) {
@@ -816,54 +792,49 @@ uint32_t VideoBeast::getSinclairAddress(uint16_t addr) {
     }
 }
 
-void VideoBeast::createWindow() {
-    int width = VIDEO_MODE[mode].pixelWidth * requestedZoom;
-    int height = VIDEO_MODE[mode].pixelHeight * requestedZoom;
-
-    window = SDL_CreateWindow("Feersum VideoBeast Emulator (Beta) v1.0", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, width, height, SDL_WINDOW_ALLOW_HIGHDPI);
-
-    if( NULL == window ) {
-        std::cout << "Could not create window: " << SDL_GetError() << std::endl;
-        exit(1);
-    }
-
-    windowID = SDL_GetWindowID( window );
-    checkWindow(width, height);
+void VideoBeast::save(StateWriter &out) const {
+    out.bytes(registers, sizeof(registers));
+    out.bytes(palette1, sizeof(palette1));
+    out.bytes(palette2, sizeof(palette2));
+    out.bytes(paletteReg1, sizeof(paletteReg1));
+    out.bytes(paletteReg2, sizeof(paletteReg2));
+    out.value(mode);
+    out.value(nextMode);
+    out.value(isDoubled);
+    out.value(next_action_time_ps);
+    out.value(next_line_time_ps);
+    out.value(next_multiply_available_ps);
+    out.value(frameCount);
+    out.value(currentLine);
+    out.value(displayLine);
+    out.value(currentLayer);
+    out.value(drawNextLine);
+    out.value(background);
+    out.bytes(line_buffer, sizeof(line_buffer));
 }
 
-void VideoBeast::updateMode() {
-    int width = VIDEO_MODE[mode].pixelWidth * requestedZoom;
-    int height = VIDEO_MODE[mode].pixelHeight * requestedZoom;
-
-    SDL_SetWindowSize(window, width, height);
-
-    checkWindow(width, height);
-}
-
-void VideoBeast::checkWindow(int width, int height) {
-    surface = SDL_GetWindowSurface(window);
-    zoom = requestedZoom;
-
-    if(surface->w != width) {
-        float widthScale = (float)surface->w / (float) (width);
-        float heightScale = (float)surface->h / (float) (height);
-
-        if(widthScale != heightScale) {
-            std::cerr << "WARNING: width scale != height scale" << std::endl;
-        }
-
-        zoom *= widthScale;
-    }
-}
-
-void VideoBeast::clearWindow() {
-    uint32_t dest = 0;
-    
-    for( int y=0; y < surface->h; y++ ) {
-        for(int x=0; x<surface->w; x++) {
-            *(Uint32 *)((uint8_t*)surface->pixels+dest) = background;
-            dest += surface->format->BytesPerPixel;
-        }
+void VideoBeast::load(StateReader &in) {
+    int lastMode = mode;
+    in.bytes(registers, sizeof(registers));
+    in.bytes(palette1, sizeof(palette1));
+    in.bytes(palette2, sizeof(palette2));
+    in.bytes(paletteReg1, sizeof(paletteReg1));
+    in.bytes(paletteReg2, sizeof(paletteReg2));
+    in.value(mode);
+    in.value(nextMode);
+    in.value(isDoubled);
+    in.value(next_action_time_ps);
+    in.value(next_line_time_ps);
+    in.value(next_multiply_available_ps);
+    in.value(frameCount);
+    in.value(currentLine);
+    in.value(displayLine);
+    in.value(currentLayer);
+    in.value(drawNextLine);
+    in.value(background);
+    in.bytes(line_buffer, sizeof(line_buffer));
+
+    if( mode != lastMode && mode < VIDEO_MODES ) {
+        modeChanged();
     }
-    SDL_UpdateWindowSurface(window);
 }
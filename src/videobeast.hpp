@@ -1,7 +1,10 @@
 #pragma once
 #include <set>
 #include <vector>
-#include "SDL.h"
+#include <cstdint>
+
+class StateWriter;
+class StateReader;
 
 class VideoBeast {
 
@@ -81,10 +84,10 @@ class VideoBeast {
     };
 
     public:
-        VideoBeast(float zoom);
-        ~VideoBeast();
+        VideoBeast();
+        virtual ~VideoBeast();
 
-        int     init(uint64_t clock_time_ps, int guiWidth);
+        virtual void init(uint64_t clock_time_ps);
 
         uint64_t tick(uint64_t clock_time_ps);
 
@@ -99,6 +102,8 @@ class VideoBeast {
         uint8_t* memoryPtr();
 
         void     writeRam(uint32_t address, uint8_t value);
+        // Bit n set for each 16K page of video RAM written since the last call
+        uint64_t takeDirtyPages();
         void     writeRegister(uint8_t address, uint8_t value);
         void     writePalette(int palette, uint16_t address, uint8_t value);
         void     writeSprite(uint16_t address, uint8_t value);
@@ -107,7 +112,11 @@ class VideoBeast {
         uint32_t getColour(uint16_t packedRGB);
         void     unpackRGB(uint16_t packedRGB, uint8_t *r, uint8_t *g, uint8_t *b);
 
-        void     handleEvent(SDL_Event windowEvent);
+        uint64_t getFrameCount();
+
+        // Video RAM, registers, palettes and where the renderer is in the frame
+        void     save(StateWriter &out) const;
+        void     load(StateReader &in);
     
         // Note these must all be a power of 2
         static const int VIDEO_RAM_LENGTH = 1024*1024;
@@ -116,8 +125,33 @@ class VideoBeast {
         static const int SPRITE_LENGTH    = 256;
         static const int SPRITE_BYTES     = 8;
 
+    protected:
+        // The picture, which VideoWindow puts on the screen. Without one only the
+        // timing and memory are emulated
+        virtual uint32_t mapColour(uint8_t r, uint8_t g, uint8_t b);
+        // Each line of the frame, as it is finished in line_buffer
+        virtual void     drawLine(int line);
+        virtual void     frameDone();
+        virtual void     modeChanged();
+
+        const VideoMode VIDEO_MODE[VIDEO_MODES] = {
+            VideoMode{ 640, 480, 800, 525, 40000ULL }, // 25Mhz pixel clock
+            VideoMode{ 848, 480, 1088, 517, 29767ULL}  // 33.594Mhz pixel clock
+        };
+
+        // Screen modes
+        int mode = 0;
+        bool isDoubled = false;
+
+        bool     debug_layers = false;
+        float    layer_time_alpha = 0.7;
+
+        uint32_t line_buffer[MAX_LINE_WIDTH];
+        uint32_t background;
+
     private:
         uint8_t mem[VIDEO_RAM_LENGTH];
+        uint64_t dirtyPages = ~0ULL;
 
         uint8_t registers[REGISTERS_LENGTH];
 
@@ -127,12 +161,8 @@ class VideoBeast {
         uint16_t paletteReg1[PALETTE_LENGTH];
         uint16_t paletteReg2[PALETTE_LENGTH];
 
-        // Screen modes
-        int mode = 0;
         int nextMode = 0;
 
-        bool isDoubled = false;
-
         uint64_t next_action_time_ps;
         uint64_t next_line_time_ps;
         uint64_t next_multiply_available_ps = 0;
@@ -147,37 +177,13 @@ class VideoBeast {
 
         uint64_t layer_times_ps[MAX_LAYER_TIMES];
         int      layer_time_index;
-        bool     debug_layers = false;
-
-        float    layer_time_alpha = 0.7;
         
         int layer_col_r[MAX_LAYER_TIMES];
         int layer_col_g[MAX_LAYER_TIMES];
         int layer_col_b[MAX_LAYER_TIMES];
 
-        const VideoMode VIDEO_MODE[VIDEO_MODES] = {
-            VideoMode{ 640, 480, 800, 525, 40000ULL }, // 25Mhz pixel clock
-            VideoMode{ 848, 480, 1088, 517, 29767ULL}  // 33.594Mhz pixel clock
-        };
-
-        SDL_Window *window = nullptr;
-        SDL_Surface *surface = nullptr;
-        SDL_PixelFormat *pixel_format = nullptr;
-        float requestedZoom = 1.0;
-        float zoom = 2.0;
-        uint32_t windowID;
-
-        uint32_t line_buffer[MAX_LINE_WIDTH];
-
-        uint32_t background;
-
         void tickNextFrame();
 
-        void createWindow();
-        void updateMode();
-        void checkWindow(int width, int height);
-        void clearWindow();
-
         void loadPalette(const char *filename, uint32_t *palette, uint16_t *paletteReg);
         void loadRegisters(const char *filename);
 
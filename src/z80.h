@@ -63,6 +63,18 @@
         Helper function to detect whether the z80_t instance has completed
         an instruction.
 
+    ~~~C
+    void z80_set_banks(z80_t* cpu, uint8_t* const read[4], uint8_t* const write[4])
+    ~~~
+        Optionally let the CPU access plain memory itself. Each entry points
+        to the host memory behind one 16 KByte bank of the address space, or
+        is null. Reads and writes that hit a non-null bank are resolved inside
+        z80_tick() and come back with the MREQ pin cleared, so the caller only
+        sees accesses to banks left null (e.g. memory mapped devices). A write
+        that changes a byte sets bit (addr >> 14) of cpu->bank_written, which
+        the caller may clear.
+        Pass nulls to go back to handling every access through the pins.
+
     ## HOWTO
 
     Initialize a new z80_t instance and start ticking it:
@@ -363,6 +375,9 @@ typedef struct {
     uint16_t af2, bc2, de2, hl2; // shadow register bank
     uint8_t im;
     bool iff1, iff2;
+    uint8_t* read_bank[4];      // optional host memory for each 16K bank, see z80_set_banks()
+    uint8_t* write_bank[4];
+    uint8_t bank_written;       // bit n set when a write through write_bank[n] changed a byte
 } z80_t;
 
 // initialize a new Z80 instance and return initial pin mask
@@ -375,6 +390,8 @@ uint64_t z80_tick(z80_t* cpu, uint64_t pins);
 uint64_t z80_prefetch(z80_t* cpu, uint16_t new_pc);
 // return true when full instruction has finished
 bool z80_opdone(z80_t* cpu);
+// resolve plain memory accesses inside z80_tick()
+void z80_set_banks(z80_t* cpu, uint8_t* const read[4], uint8_t* const write[4]);
 
 #ifdef __cplusplus
 } // extern C
@@ -426,6 +443,14 @@ bool z80_opdone(z80_t* cpu) {
     return ((cpu->pins & (Z80_M1|Z80_RD)) == (Z80_M1|Z80_RD)) && !cpu->prefix_active;
 }
 
+void z80_set_banks(z80_t* cpu, uint8_t* const read[4], uint8_t* const write[4]) {
+    CHIPS_ASSERT(cpu);
+    for (int i = 0; i < 4; i++) {
+        cpu->read_bank[i] = read[i];
+        cpu->write_bank[i] = write[i];
+    }
+}
+
 static inline uint64_t _z80_halt(z80_t* cpu, uint64_t pins) {
     cpu->pc--;
     return pins | Z80_HALT;
@@ -1690,6 +1715,31 @@ static inline uint64_t _z80_refresh(z80_t* cpu, uint64_t pins) {
     return pins;
 }
 
+// complete a memory read from the bank pointers if possible, hiding it from the caller
+static inline uint64_t _z80_bank_read(z80_t* cpu, uint64_t pins) {
+    const uint16_t addr = Z80_GET_ADDR(pins);
+    const uint8_t* bank = cpu->read_bank[addr >> 14];
+    if (bank) {
+        pins = (pins & ~(Z80_MREQ|0xFF0000ULL)) | ((uint64_t)bank[addr & 0x3FFF] << 16);
+    }
+    return pins;
+}
+
+// same for memory writes
+static inline uint64_t _z80_bank_write(z80_t* cpu, uint64_t pins) {
+    const uint16_t addr = Z80_GET_ADDR(pins);
+    uint8_t* bank = cpu->write_bank[addr >> 14];
+    if (bank) {
+        const uint8_t data = _z80_get_db(pins);
+        if (bank[addr & 0x3FFF] != data) {
+            bank[addr & 0x3FFF] = data;
+            cpu->bank_written |= 1 << (addr >> 14);
+        }
+        pins &= ~Z80_MREQ;
+    }
+    return pins;
+}
+
 // initiate a fetch machine cycle for regular (non-prefixed) instructions, or initiate interrupt handling
 static inline uint64_t _z80_fetch(z80_t* cpu, uint64_t pins) {
     cpu->hlx_idx = 0;
@@ -1697,7 +1747,7 @@ static inline uint64_t _z80_fetch(z80_t* cpu, uint64_t pins) {
     // shortcut no interrupts requested
     if (cpu->int_bits == 0) {
         cpu->step = 0xFFFF;
-        return _z80_set_ab_x(pins, cpu->pc++, Z80_M1|Z80_MREQ|Z80_RD);
+        return _z80_bank_read(cpu, _z80_set_ab_x(pins, cpu->pc++, Z80_M1|Z80_MREQ|Z80_RD));
     }
     else if (cpu->int_bits & Z80_NMI) {
         // non-maskable interrupt starts with a regular M1 machine cycle
@@ -1708,7 +1758,7 @@ static inline uint64_t _z80_fetch(z80_t* cpu, uint64_t pins) {
             cpu->pc++;
         }
         // NOTE: PC is *not* incremented!
-        return _z80_set_ab_x(pins, cpu->pc, Z80_M1|Z80_MREQ|Z80_RD);
+        return _z80_bank_read(cpu, _z80_set_ab_x(pins, cpu->pc, Z80_M1|Z80_MREQ|Z80_RD));
     }
     else if (cpu->int_bits & Z80_INT) {
         if (cpu->iff1) {
@@ -1728,7 +1778,7 @@ static inline uint64_t _z80_fetch(z80_t* cpu, uint64_t pins) {
         else {
             // oops, maskable interrupt requested but disabled
             cpu->step = 0xFFFF;
-            return _z80_set_ab_x(pins, cpu->pc++, Z80_M1|Z80_MREQ|Z80_RD);
+            return _z80_bank_read(cpu, _z80_set_ab_x(pins, cpu->pc++, Z80_M1|Z80_MREQ|Z80_RD));
         }
     }
     else {
@@ -1752,7 +1802,7 @@ static inline uint64_t _z80_fetch_cb(z80_t* cpu, uint64_t pins) {
         // handle DD/FD prefix and then branches either to the
         // special CB or CBHL decoder block
         cpu->step = 21; // => step 22: opcode fetch for CB prefixed instructions
-        pins = _z80_set_ab_x(pins, cpu->pc++, Z80_M1|Z80_MREQ|Z80_RD);
+        pins = _z80_bank_read(cpu, _z80_set_ab_x(pins, cpu->pc++, Z80_M1|Z80_MREQ|Z80_RD));
     }
     return pins;
 }
@@ -1761,21 +1811,21 @@ static inline uint64_t _z80_fetch_dd(z80_t* cpu, uint64_t pins) {
     cpu->step = 2;   // => step 3: opcode fetch for DD/FD prefixed instructions
     cpu->hlx_idx = 1;
     cpu->prefix_active = true;
-    return _z80_set_ab_x(pins, cpu->pc++, Z80_M1|Z80_MREQ|Z80_RD);
+    return _z80_bank_read(cpu, _z80_set_ab_x(pins, cpu->pc++, Z80_M1|Z80_MREQ|Z80_RD));
 }
 
 static inline uint64_t _z80_fetch_fd(z80_t* cpu, uint64_t pins) {
     cpu->step = 2;   // => step 3: opcode fetch for DD/FD prefixed instructions
     cpu->hlx_idx = 2;
     cpu->prefix_active = true;
-    return _z80_set_ab_x(pins, cpu->pc++, Z80_M1|Z80_MREQ|Z80_RD);
+    return _z80_bank_read(cpu, _z80_set_ab_x(pins, cpu->pc++, Z80_M1|Z80_MREQ|Z80_RD));
 }
 
 static inline uint64_t _z80_fetch_ed(z80_t* cpu, uint64_t pins) {
     cpu->step = 24; // => step 25: opcode fetch for ED prefixed instructions
     cpu->hlx_idx = 0;
     cpu->prefix_active = true;
-    return _z80_set_ab_x(pins, cpu->pc++, Z80_M1|Z80_MREQ|Z80_RD);
+    return _z80_bank_read(cpu, _z80_set_ab_x(pins, cpu->pc++, Z80_M1|Z80_MREQ|Z80_RD));
 }
 
 uint64_t z80_prefetch(z80_t* cpu, uint16_t new_pc) {
@@ -1798,8 +1848,8 @@ uint64_t z80_prefetch(z80_t* cpu, uint16_t new_pc) {
 #define _fetch_fd()     pins=_z80_fetch_fd(cpu,pins);
 #define _fetch_ed()     pins=_z80_fetch_ed(cpu,pins);
 #define _fetch_cb()     pins=_z80_fetch_cb(cpu,pins);
-#define _mread(ab)      _sax(ab,Z80_MREQ|Z80_RD)
-#define _mwrite(ab,d)   _sadx(ab,d,Z80_MREQ|Z80_WR)
+#define _mread(ab)      pins=_z80_bank_read(cpu,_z80_set_ab_x(pins,ab,Z80_MREQ|Z80_RD))
+#define _mwrite(ab,d)   pins=_z80_bank_write(cpu,_z80_set_ab_db_x(pins,ab,d,Z80_MREQ|Z80_WR))
 #define _ioread(ab)     _sax(ab,Z80_IORQ|Z80_RD)
 #define _iowrite(ab,d)  _sadx(ab,d,Z80_IORQ|Z80_WR)
 #define _wait()         {if(pins&Z80_WAIT)goto track_int_bits;}
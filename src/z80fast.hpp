@@ -0,0 +1,854 @@
+#pragma once
+#include <stdint.h>
+#include "z80.h"
+
+/**
+ * z80fast.hpp - Instruction stepped Z80 engine
+ *
+ * Runs one whole instruction per call against the same z80_t as the cycle
+ * stepped z80_tick(), calling the bus directly for each memory and IO access
+ * rather than handing the pins back on every T-state. It starts and finishes
+ * in the state z80_opdone() reports, with the next opcode already fetched
+ * onto the data bus, so the two engines can take turns at any instruction
+ * boundary. Registers, flags, WZ and R follow z80.h exactly and each call
+ * returns the T-states z80_tick() would have taken; only where each access
+ * falls within the instruction is lost.
+ *
+ * The Bus provides:
+ *   uint8_t memoryRead(uint16_t addr)
+ *   void    memoryWrite(uint16_t addr, uint8_t data)
+ *   uint8_t ioRead(uint16_t port)
+ *   void    ioWrite(uint16_t port, uint8_t data)
+ *   uint8_t interruptAcknowledge()      M1|IORQ cycle, returns the data bus
+ *   void    interruptReturn()           RETI decoded, for the daisy chain
+ *
+ * The INT and HALT pins are read from and left in the shared pin mask.
+ * NMI is not emulated, nothing on the MicroBeast drives it.
+ */
+template <class Bus>
+class Z80Fast {
+    public:
+        Z80Fast(z80_t &cpu, uint64_t &pins, Bus &bus) : cpu(cpu), pins(pins), bus(bus) {
+            for( int i=0; i<3; i++ ) {
+                uint8_t *table[8] = {&cpu.b, &cpu.c, &cpu.d, &cpu.e, &cpu.hlx[i].h, &cpu.hlx[i].l, nullptr, &cpu.a};
+                for( int r=0; r<8; r++ ) {
+                    regs[i][r] = table[r];
+                }
+            }
+        }
+
+        /* Execute the instruction on the data bus at an opdone boundary, and fetch the next. Returns T-states taken.
+           operands, if given, holds the bytes after the opcode so they need not be read over the bus */
+        int step(const uint8_t *operands = nullptr) {
+            after = NEXT;
+            code = operands;
+            refresh();
+            int cycles = execute(Z80_GET_DATA(pins), 0);
+            code = nullptr;
+
+            switch( after ) {
+                case NEXT:
+                    cycles += fetch();
+                    break;
+                case ENABLE:
+                    // No interrupt is taken straight after EI
+                    cpu.iff1 = cpu.iff2 = false;
+                    cycles += fetch();
+                    cpu.iff1 = cpu.iff2 = true;
+                    break;
+                case RESTORE:
+                    cycles += fetch();
+                    cpu.iff1 = cpu.iff2;
+                    break;
+            }
+            return cycles;
+        }
+
+    private:
+        enum After {NEXT, ENABLE, RESTORE};
+
+        z80_t    &cpu;
+        uint64_t &pins;
+        Bus      &bus;
+        uint8_t  *regs[3][8];    // B,C,D,E,H,L,-,A with H and L mapped to HL, IX or IY
+        After    after = NEXT;
+        const uint8_t *code = nullptr;  // Rest of the current instruction, when known
+
+        uint8_t read(uint16_t addr) {
+            return bus.memoryRead(addr);
+        }
+
+        void write(uint16_t addr, uint8_t data) {
+            bus.memoryWrite(addr, data);
+        }
+
+        uint8_t imm8() {
+            if( code ) {
+                cpu.pc++;
+                return *code++;
+            }
+            return read(cpu.pc++);
+        }
+
+        uint16_t imm16() {
+            uint8_t low = imm8();
+            return low | (imm8() << 8);
+        }
+
+        void push(uint16_t value) {
+            write(--cpu.sp, value >> 8);
+            write(--cpu.sp, value & 0xFF);
+        }
+
+        uint16_t pop() {
+            uint8_t low = read(cpu.sp++);
+            return low | (read(cpu.sp++) << 8);
+        }
+
+        void refresh() {
+            cpu.r = (cpu.r & 0x80) | ((cpu.r + 1) & 0x7F);
+        }
+
+        uint8_t fetchOpcode() {
+            uint8_t opcode = imm8();
+            refresh();
+            return opcode;
+        }
+
+        // Effective address for (HL), or (IX+d)/(IY+d) after reading d, which takes 8 more T-states
+        uint16_t indirect(int idx, int &cycles) {
+            if( idx == 0 ) {
+                return cpu.hl;
+            }
+            cpu.wz = cpu.hlx[idx].hl + (int8_t)imm8();
+            cycles += 8;
+            return cpu.wz;
+        }
+
+        // Take a pending interrupt, then fetch the next opcode and leave the pins as z80_tick() would
+        int fetch() {
+            int cycles = 0;
+            if( (pins & Z80_INT) && cpu.iff1 ) {
+                cycles = interrupt();
+            }
+            uint16_t addr = cpu.pc++;
+            uint8_t opcode = read(addr);
+            pins = (pins & Z80_PIN_MASK & ~(Z80_CTRL_PIN_MASK|Z80_RETI|0xFFFFFFULL)) | Z80_M1|Z80_MREQ|Z80_RD | addr | ((uint64_t)opcode << 16);
+
+            cpu.step = 0;
+            cpu.hlx_idx = 0;
+            cpu.prefix_active = false;
+            cpu.pins = pins;
+            cpu.int_bits = pins & Z80_INT;
+            return cycles;
+        }
+
+        int interrupt() {
+            if( pins & Z80_HALT ) {
+                pins &= ~Z80_HALT;
+                cpu.pc++;
+            }
+            cpu.iff1 = cpu.iff2 = false;
+            uint8_t data = bus.interruptAcknowledge();
+            refresh();
+
+            switch( cpu.im ) {
+                case 0:
+                    // The data bus holds an opcode, usually an RST
+                    return 5 + execute(data, 0) - 3;
+                case 1:
+                    push(cpu.pc);
+                    cpu.wz = cpu.pc = 0x0038;
+                    return 13;
+                default: {
+                    push(cpu.pc);
+                    cpu.wzl = data;
+                    cpu.wzh = cpu.i;
+                    uint8_t low = read(cpu.wz++);
+                    cpu.wzh = read(cpu.wz);
+                    cpu.wzl = low;
+                    cpu.pc = cpu.wz;
+                    return 19;
+                }
+            }
+        }
+
+        bool condition(int cc) const {
+            switch( cc ) {
+                case 0: return !(cpu.f & Z80_ZF);
+                case 1: return cpu.f & Z80_ZF;
+                case 2: return !(cpu.f & Z80_CF);
+                case 3: return cpu.f & Z80_CF;
+                case 4: return !(cpu.f & Z80_PF);
+                case 5: return cpu.f & Z80_PF;
+                case 6: return !(cpu.f & Z80_SF);
+                default: return cpu.f & Z80_SF;
+            }
+        }
+
+        int jumpRelative(bool taken) {
+            int8_t d = (int8_t)imm8();
+            if( !taken ) {
+                return 7;
+            }
+            cpu.pc += d;
+            cpu.wz = cpu.pc;
+            return 12;
+        }
+
+        // Unprefixed opcodes, with HL replaced by IX or IY when idx is 1 or 2
+        int execute(uint8_t op, int idx) {
+            auto &hlx = cpu.hlx[idx];
+            int cycles = 0;
+
+            if( op >= 0x40 && op < 0x80 ) {
+                int dst = (op >> 3) & 7;
+                int src = op & 7;
+                if( op == 0x76 ) {
+                    // HALT refetches itself until an interrupt
+                    pins |= Z80_HALT;
+                    cpu.pc--;
+                    return 4;
+                }
+                // (IX+d) forms still use the real H and L
+                if( src == 6 ) {
+                    uint16_t addr = indirect(idx, cycles);
+                    *regs[0][dst] = read(addr);
+                    return cycles + 7;
+                }
+                if( dst == 6 ) {
+                    uint16_t addr = indirect(idx, cycles);
+                    write(addr, *regs[0][src]);
+                    return cycles + 7;
+                }
+                *regs[idx][dst] = *regs[idx][src];
+                return 4;
+            }
+
+            if( op >= 0x80 && op < 0xC0 ) {
+                int src = op & 7;
+                uint8_t value;
+                if( src == 6 ) {
+                    value = read(indirect(idx, cycles));
+                    cycles += 7;
+                }
+                else {
+                    value = *regs[idx][src];
+                    cycles = 4;
+                }
+                alu((op >> 3) & 7, value);
+                return cycles;
+            }
+
+            switch( op ) {
+                case 0x00: return 4;
+                case 0x01: cpu.bc = imm16(); return 10;
+                case 0x02: write(cpu.bc, cpu.a); cpu.wzl = cpu.c + 1; cpu.wzh = cpu.a; return 7;
+                case 0x03: cpu.bc++; return 6;
+                case 0x04: cpu.b = inc8(cpu.b); return 4;
+                case 0x05: cpu.b = dec8(cpu.b); return 4;
+                case 0x06: cpu.b = imm8(); return 7;
+                case 0x07: rlca(); return 4;
+                case 0x08: { uint16_t t = cpu.af; cpu.af = cpu.af2; cpu.af2 = t; return 4; }
+                case 0x09: add16(hlx.hl, cpu.bc); return 11;
+                case 0x0A: cpu.a = read(cpu.bc); cpu.wz = cpu.bc + 1; return 7;
+                case 0x0B: cpu.bc--; return 6;
+                case 0x0C: cpu.c = inc8(cpu.c); return 4;
+                case 0x0D: cpu.c = dec8(cpu.c); return 4;
+                case 0x0E: cpu.c = imm8(); return 7;
+                case 0x0F: rrca(); return 4;
+
+                case 0x10: {
+                    int8_t d = (int8_t)imm8();
+                    if( --cpu.b == 0 ) {
+                        return 8;
+                    }
+                    cpu.pc += d;
+                    cpu.wz = cpu.pc;
+                    return 13;
+                }
+                case 0x11: cpu.de = imm16(); return 10;
+                case 0x12: write(cpu.de, cpu.a); cpu.wzl = cpu.e + 1; cpu.wzh = cpu.a; return 7;
+                case 0x13: cpu.de++; return 6;
+                case 0x14: cpu.d = inc8(cpu.d); return 4;
+                case 0x15: cpu.d = dec8(cpu.d); return 4;
+                case 0x16: cpu.d = imm8(); return 7;
+                case 0x17: rla(); return 4;
+                case 0x18: return jumpRelative(true);
+                case 0x19: add16(hlx.hl, cpu.de); return 11;
+                case 0x1A: cpu.a = read(cpu.de); cpu.wz = cpu.de + 1; return 7;
+                case 0x1B: cpu.de--; return 6;
+                case 0x1C: cpu.e = inc8(cpu.e); return 4;
+                case 0x1D: cpu.e = dec8(cpu.e); return 4;
+                case 0x1E: cpu.e = imm8(); return 7;
+                case 0x1F: rra(); return 4;
+
+                case 0x20: return jumpRelative(!(cpu.f & Z80_ZF));
+                case 0x21: hlx.hl = imm16(); return 10;
+                case 0x22: cpu.wz = imm16(); write(cpu.wz++, hlx.l); write(cpu.wz, hlx.h); return 16;
+                case 0x23: hlx.hl++; return 6;
+                case 0x24: hlx.h = inc8(hlx.h); return 4;
+                case 0x25: hlx.h = dec8(hlx.h); return 4;
+                case 0x26: hlx.h = imm8(); return 7;
+                case 0x27: daa(); return 4;
+                case 0x28: return jumpRelative(cpu.f & Z80_ZF);
+                case 0x29: add16(hlx.hl, hlx.hl); return 11;
+                case 0x2A: cpu.wz = imm16(); hlx.l = read(cpu.wz++); hlx.h = read(cpu.wz); return 16;
+                case 0x2B: hlx.hl--; return 6;
+                case 0x2C: hlx.l = inc8(hlx.l); return 4;
+                case 0x2D: hlx.l = dec8(hlx.l); return 4;
+                case 0x2E: hlx.l = imm8(); return 7;
+                case 0x2F:
+                    cpu.a ^= 0xFF;
+                    cpu.f = (cpu.f & (Z80_SF|Z80_ZF|Z80_PF|Z80_CF)) | Z80_HF | Z80_NF | (cpu.a & (Z80_YF|Z80_XF));
+                    return 4;
+
+                case 0x30: return jumpRelative(!(cpu.f & Z80_CF));
+                case 0x31: cpu.sp = imm16(); return 10;
+                case 0x32: cpu.wz = imm16(); write(cpu.wz++, cpu.a); cpu.wzh = cpu.a; return 13;
+                case 0x33: cpu.sp++; return 6;
+                case 0x34: {
+                    uint16_t addr = indirect(idx, cycles);
+                    write(addr, inc8(read(addr)));
+                    return cycles + 11;
+                }
+                case 0x35: {
+                    uint16_t addr = indirect(idx, cycles);
+                    write(addr, dec8(read(addr)));
+                    return cycles + 11;
+                }
+                case 0x36: {
+                    uint16_t addr = indirect(idx, cycles);
+                    write(addr, imm8());
+                    // The n read overlaps the d cycle
+                    return idx ? cycles + 7 : 10;
+                }
+                case 0x37:
+                    cpu.f = (cpu.f & (Z80_SF|Z80_ZF|Z80_PF|Z80_CF)) | Z80_CF | (cpu.a & (Z80_YF|Z80_XF));
+                    return 4;
+                case 0x38: return jumpRelative(cpu.f & Z80_CF);
+                case 0x39: add16(hlx.hl, cpu.sp); return 11;
+                case 0x3A: cpu.wz = imm16(); cpu.a = read(cpu.wz++); return 13;
+                case 0x3B: cpu.sp--; return 6;
+                case 0x3C: cpu.a = inc8(cpu.a); return 4;
+                case 0x3D: cpu.a = dec8(cpu.a); return 4;
+                case 0x3E: cpu.a = imm8(); return 7;
+                case 0x3F:
+                    cpu.f = ((cpu.f & (Z80_SF|Z80_ZF|Z80_PF|Z80_CF)) | ((cpu.f & Z80_CF) << 4) | (cpu.a & (Z80_YF|Z80_XF))) ^ Z80_CF;
+                    return 4;
+
+                case 0xC0: case 0xC8: case 0xD0: case 0xD8:
+                case 0xE0: case 0xE8: case 0xF0: case 0xF8:
+                    if( !condition((op >> 3) & 7) ) {
+                        return 5;
+                    }
+                    cpu.wz = pop();
+                    cpu.pc = cpu.wz;
+                    return 11;
+
+                case 0xC2: case 0xCA: case 0xD2: case 0xDA:
+                case 0xE2: case 0xEA: case 0xF2: case 0xFA:
+                    cpu.wz = imm16();
+                    if( condition((op >> 3) & 7) ) {
+                        cpu.pc = cpu.wz;
+                    }
+                    return 10;
+
+                case 0xC4: case 0xCC: case 0xD4: case 0xDC:
+                case 0xE4: case 0xEC: case 0xF4: case 0xFC:
+                    cpu.wz = imm16();
+                    if( !condition((op >> 3) & 7) ) {
+                        return 10;
+                    }
+                    push(cpu.pc);
+                    cpu.pc = cpu.wz;
+                    return 17;
+
+                case 0xC6: case 0xCE: case 0xD6: case 0xDE:
+                case 0xE6: case 0xEE: case 0xF6: case 0xFE:
+                    alu((op >> 3) & 7, imm8());
+                    return 7;
+
+                case 0xC7: case 0xCF: case 0xD7: case 0xDF:
+                case 0xE7: case 0xEF: case 0xF7: case 0xFF:
+                    push(cpu.pc);
+                    cpu.wz = op & 0x38;
+                    cpu.pc = cpu.wz;
+                    return 11;
+
+                case 0xC1: cpu.bc = pop(); return 10;
+                case 0xD1: cpu.de = pop(); return 10;
+                case 0xE1: hlx.hl = pop(); return 10;
+                case 0xF1: cpu.af = pop(); return 10;
+                case 0xC5: push(cpu.bc); return 11;
+                case 0xD5: push(cpu.de); return 11;
+                case 0xE5: push(hlx.hl); return 11;
+                case 0xF5: push(cpu.af); return 11;
+
+                case 0xC3: cpu.wz = imm16(); cpu.pc = cpu.wz; return 10;
+                case 0xC9: cpu.wz = pop(); cpu.pc = cpu.wz; return 10;
+                case 0xCD: cpu.wz = imm16(); push(cpu.pc); cpu.pc = cpu.wz; return 17;
+
+                case 0xD3:
+                    cpu.wzl = imm8();
+                    cpu.wzh = cpu.a;
+                    bus.ioWrite(cpu.wz, cpu.a);
+                    cpu.wzl++;
+                    return 11;
+                case 0xDB:
+                    cpu.wzl = imm8();
+                    cpu.wzh = cpu.a;
+                    cpu.a = bus.ioRead(cpu.wz++);
+                    return 11;
+                case 0xD9: {
+                    uint16_t t;
+                    t = cpu.bc; cpu.bc = cpu.bc2; cpu.bc2 = t;
+                    t = cpu.de; cpu.de = cpu.de2; cpu.de2 = t;
+                    t = cpu.hl; cpu.hl = cpu.hl2; cpu.hl2 = t;
+                    return 4;
+                }
+                case 0xE3: {
+                    cpu.wzl = read(cpu.sp);
+                    cpu.wzh = read(cpu.sp + 1);
+                    write(cpu.sp + 1, hlx.h);
+                    write(cpu.sp, hlx.l);
+                    hlx.hl = cpu.wz;
+                    return 19;
+                }
+                case 0xE9: cpu.pc = hlx.hl; return 4;
+                case 0xEB: { uint16_t t = cpu.hl; cpu.hl = cpu.de; cpu.de = t; return 4; }
+                case 0xF3: cpu.iff1 = cpu.iff2 = false; return 4;
+                case 0xF9: cpu.sp = hlx.hl; return 6;
+                case 0xFB: after = ENABLE; return 4;
+
+                case 0xCB: return 4 + executeCB(fetchOpcode());
+                case 0xED: return 4 + executeED(fetchOpcode());
+                case 0xDD:
+                case 0xFD: {
+                    // Only the last of a run of DD/FD prefixes counts
+                    int prefixCycles = 4;
+                    int prefixIdx = op == 0xDD ? 1 : 2;
+                    uint8_t next = fetchOpcode();
+                    while( next == 0xDD || next == 0xFD ) {
+                        prefixIdx = next == 0xDD ? 1 : 2;
+                        prefixCycles += 4;
+                        next = fetchOpcode();
+                    }
+                    if( next == 0xCB ) {
+                        return prefixCycles + 4 + executeIndexedCB(prefixIdx);
+                    }
+                    if( next == 0xED ) {
+                        return prefixCycles + 4 + executeED(fetchOpcode());
+                    }
+                    return prefixCycles + execute(next, prefixIdx);
+                }
+            }
+            return 4;
+        }
+
+        // CB prefixed, after the CB fetch
+        int executeCB(uint8_t op) {
+            int z = op & 7;
+            if( z != 6 ) {
+                uint8_t result;
+                cbAction(op, *regs[0][z], false, result, z);
+                return 4;
+            }
+            uint8_t result;
+            if( !cbAction(op, read(cpu.hl), true, result, 6) ) {
+                return 8;
+            }
+            write(cpu.hl, result);
+            return 11;
+        }
+
+        // DD CB d op / FD CB d op, after the CB fetch. The opcode is read without a refresh cycle
+        int executeIndexedCB(int idx) {
+            uint16_t addr = cpu.hlx[idx].hl + (int8_t)imm8();
+            cpu.wz = addr;
+            uint8_t op = imm8();
+            uint8_t result;
+            if( !cbAction(op, read(addr), true, result, op & 7) ) {
+                return 12;
+            }
+            write(addr, result);
+            return 15;
+        }
+
+        // Returns false for BIT, which has nothing to write back. Other results are also copied to register z1
+        bool cbAction(uint8_t op, uint8_t value, bool memory, uint8_t &result, int z1) {
+            int x = op >> 6;
+            int y = (op >> 3) & 7;
+            switch( x ) {
+                case 0:
+                    result = rotate(y, value);
+                    break;
+                case 1:
+                    result = value & (1 << y);
+                    cpu.f = (cpu.f & Z80_CF) | Z80_HF | (result ? (result & Z80_SF) : (Z80_ZF|Z80_PF));
+                    cpu.f |= (memory ? (cpu.wz >> 8) : value) & (Z80_YF|Z80_XF);
+                    return false;
+                case 2:
+                    result = value & ~(1 << y);
+                    break;
+                default:
+                    result = value | (1 << y);
+                    break;
+            }
+            if( z1 != 6 ) {
+                *regs[0][z1] = result;
+            }
+            return true;
+        }
+
+        uint8_t rotate(int y, uint8_t value) {
+            uint8_t result;
+            uint8_t carry;
+            switch( y ) {
+                case 0: result = (value << 1) | (value >> 7); carry = value >> 7; break;
+                case 1: result = (value >> 1) | (value << 7); carry = value & 1; break;
+                case 2: result = (value << 1) | (cpu.f & Z80_CF); carry = value >> 7; break;
+                case 3: result = (value >> 1) | ((cpu.f & Z80_CF) << 7); carry = value & 1; break;
+                case 4: result = value << 1; carry = value >> 7; break;
+                case 5: result = (value >> 1) | (value & 0x80); carry = value & 1; break;
+                case 6: result = (value << 1) | 1; carry = value >> 7; break;
+                default: result = value >> 1; carry = value & 1; break;
+            }
+            cpu.f = SZP[result] | (carry & Z80_CF);
+            return result;
+        }
+
+        // ED prefixed, after the ED fetch
+        int executeED(uint8_t op) {
+            int y = (op >> 3) & 7;
+            if( op >= 0x40 && op < 0x80 ) {
+                uint16_t *pairs[4] = {&cpu.bc, &cpu.de, &cpu.hl, &cpu.sp};
+                switch( op & 7 ) {
+                    case 0: {
+                        uint8_t value = bus.ioRead(cpu.bc);
+                        cpu.wz = cpu.bc + 1;
+                        cpu.f = (cpu.f & Z80_CF) | SZP[value];
+                        if( y != 6 ) {
+                            *regs[0][y] = value;
+                        }
+                        return 8;
+                    }
+                    case 1:
+                        bus.ioWrite(cpu.bc, y == 6 ? 0 : *regs[0][y]);
+                        cpu.wz = cpu.bc + 1;
+                        return 8;
+                    case 2:
+                        if( y & 1 ) {
+                            adc16(*pairs[y >> 1]);
+                        }
+                        else {
+                            sbc16(*pairs[y >> 1]);
+                        }
+                        return 11;
+                    case 3: {
+                        uint16_t &pair = *pairs[y >> 1];
+                        cpu.wz = imm16();
+                        if( y & 1 ) {
+                            uint8_t low = read(cpu.wz++);
+                            pair = low | (read(cpu.wz) << 8);
+                        }
+                        else {
+                            uint16_t value = pair;
+                            write(cpu.wz++, value & 0xFF);
+                            write(cpu.wz, value >> 8);
+                        }
+                        return 16;
+                    }
+                    case 4: {
+                        uint8_t value = cpu.a;
+                        cpu.a = 0;
+                        sub8(value, 0);
+                        return 4;
+                    }
+                    case 5:
+                        cpu.wzl = read(cpu.sp++);
+                        if( y != 0 ) {
+                            bus.interruptReturn();
+                        }
+                        cpu.wzh = read(cpu.sp++);
+                        cpu.pc = cpu.wz;
+                        after = RESTORE;
+                        return 10;
+                    case 6: {
+                        static const uint8_t modes[4] = {0, 0, 1, 2};
+                        cpu.im = modes[y & 3];
+                        return 4;
+                    }
+                    default:
+                        switch( y ) {
+                            case 0: cpu.i = cpu.a; return 5;
+                            case 1: cpu.r = cpu.a; return 5;
+                            case 2: cpu.a = cpu.i; cpu.f = iff2Flags(cpu.i); return 5;
+                            case 3: cpu.a = cpu.r; cpu.f = iff2Flags(cpu.r); return 5;
+                            case 4: {
+                                uint8_t value = read(cpu.hl);
+                                uint8_t low = cpu.a & 0x0F;
+                                cpu.a = (cpu.a & 0xF0) | (value & 0x0F);
+                                value = (value >> 4) | (low << 4);
+                                cpu.f = (cpu.f & Z80_CF) | SZP[cpu.a];
+                                write(cpu.hl, value);
+                                cpu.wz = cpu.hl + 1;
+                                return 14;
+                            }
+                            case 5: {
+                                uint8_t value = read(cpu.hl);
+                                uint8_t low = cpu.a & 0x0F;
+                                cpu.a = (cpu.a & 0xF0) | (value >> 4);
+                                value = (value << 4) | low;
+                                cpu.f = (cpu.f & Z80_CF) | SZP[cpu.a];
+                                write(cpu.hl, value);
+                                cpu.wz = cpu.hl + 1;
+                                return 14;
+                            }
+                            default:
+                                return 4;
+                        }
+                }
+            }
+
+            if( op >= 0xA0 && op < 0xC0 && (op & 7) < 4 ) {
+                return blockOperation(op);
+            }
+            return 4;
+        }
+
+        // LDI, CPI, INI, OUTI and their decrementing and repeating forms
+        int blockOperation(uint8_t op) {
+            bool decrement = op & 0x08;
+            bool repeat = op & 0x10;
+            int step = decrement ? -1 : 1;
+            bool more;
+
+            switch( op & 3 ) {
+                case 0: {
+                    uint8_t value = read(cpu.hl);
+                    cpu.hl += step;
+                    write(cpu.de, value);
+                    cpu.de += step;
+                    uint8_t n = cpu.a + value;
+                    cpu.bc -= 1;
+                    cpu.f = (cpu.f & (Z80_SF|Z80_ZF|Z80_CF)) | ((n & 2) ? Z80_YF : 0) |
+                            ((n & 8) ? Z80_XF : 0) | (cpu.bc ? Z80_VF : 0);
+                    more = cpu.bc != 0;
+                    break;
+                }
+                case 1: {
+                    uint8_t value = read(cpu.hl);
+                    cpu.hl += step;
+                    cpu.wz += step;
+                    uint32_t res = (uint32_t)((int)cpu.a - (int)value);
+                    cpu.bc -= 1;
+                    uint8_t f = (cpu.f & Z80_CF) | Z80_NF | szFlags(res);
+                    if( (res & 0xF) > ((uint32_t)cpu.a & 0xF) ) {
+                        f |= Z80_HF;
+                        res--;
+                    }
+                    if( res & 2 ) f |= Z80_YF;
+                    if( res & 8 ) f |= Z80_XF;
+                    if( cpu.bc ) f |= Z80_VF;
+                    cpu.f = f;
+                    more = cpu.bc != 0 && !(f & Z80_ZF);
+                    break;
+                }
+                case 2: {
+                    uint8_t value = bus.ioRead(cpu.bc);
+                    cpu.wz = cpu.bc + step;
+                    cpu.b--;
+                    write(cpu.hl, value);
+                    cpu.hl += step;
+                    more = ioBlockFlags(value, (uint8_t)(cpu.c + step));
+                    break;
+                }
+                default: {
+                    uint8_t value = read(cpu.hl);
+                    cpu.hl += step;
+                    cpu.b--;
+                    bus.ioWrite(cpu.bc, value);
+                    cpu.wz = cpu.bc + step;
+                    more = ioBlockFlags(value, cpu.l);
+                    break;
+                }
+            }
+
+            if( !repeat || !more ) {
+                return 12;
+            }
+            cpu.pc--;
+            cpu.wz = cpu.pc;
+            cpu.pc--;
+            return 17;
+        }
+
+        // Flags for INI/IND (c is C+1 or C-1) and OUTI/OUTD (c is L after the step)
+        bool ioBlockFlags(uint8_t value, uint8_t c) {
+            const uint8_t b = cpu.b;
+            uint8_t f = szFlags(b) | (b & (Z80_XF|Z80_YF));
+            if( value & Z80_SF ) {
+                f |= Z80_NF;
+            }
+            uint32_t t = (uint32_t)c + value;
+            if( t & 0x100 ) {
+                f |= Z80_HF|Z80_CF;
+            }
+            f |= SZP[((uint8_t)(t & 7)) ^ b] & Z80_PF;
+            cpu.f = f;
+            return b != 0;
+        }
+
+        // Flag helpers, as in z80.h
+
+        static uint8_t szFlags(uint8_t value) {
+            return value ? (value & Z80_SF) : Z80_ZF;
+        }
+
+        static uint8_t szyxchFlags(uint8_t acc, uint8_t value, uint32_t res) {
+            return szFlags(res) | (res & (Z80_YF|Z80_XF)) | ((res >> 8) & Z80_CF) | ((acc ^ value ^ res) & Z80_HF);
+        }
+
+        uint8_t iff2Flags(uint8_t value) const {
+            return (cpu.f & Z80_CF) | szFlags(value) | (value & (Z80_YF|Z80_XF)) | (cpu.iff2 ? Z80_PF : 0);
+        }
+
+        void add8(uint8_t value, int carry) {
+            uint32_t res = cpu.a + value + carry;
+            cpu.f = szyxchFlags(cpu.a, value, res) | ((((value ^ cpu.a ^ 0x80) & (value ^ res)) >> 5) & Z80_VF);
+            cpu.a = (uint8_t)res;
+        }
+
+        void sub8(uint8_t value, int carry) {
+            uint32_t res = (uint32_t)((int)cpu.a - (int)value - carry);
+            cpu.f = Z80_NF | szyxchFlags(cpu.a, value, res) | ((((value ^ cpu.a) & (res ^ cpu.a)) >> 5) & Z80_VF);
+            cpu.a = (uint8_t)res;
+        }
+
+        void alu(int y, uint8_t value) {
+            switch( y ) {
+                case 0: add8(value, 0); break;
+                case 1: add8(value, cpu.f & Z80_CF); break;
+                case 2: sub8(value, 0); break;
+                case 3: sub8(value, cpu.f & Z80_CF); break;
+                case 4: cpu.a &= value; cpu.f = SZP[cpu.a] | Z80_HF; break;
+                case 5: cpu.a ^= value; cpu.f = SZP[cpu.a]; break;
+                case 6: cpu.a |= value; cpu.f = SZP[cpu.a]; break;
+                default: {
+                    uint32_t res = (uint32_t)((int)cpu.a - (int)value);
+                    cpu.f = Z80_NF | szFlags(res) | (value & (Z80_YF|Z80_XF)) | ((res >> 8) & Z80_CF) |
+                            ((cpu.a ^ value ^ res) & Z80_HF) | ((((value ^ cpu.a) & (res ^ cpu.a)) >> 5) & Z80_VF);
+                    break;
+                }
+            }
+        }
+
+        uint8_t inc8(uint8_t value) {
+            uint8_t res = value + 1;
+            uint8_t f = szFlags(res) | (res & (Z80_XF|Z80_YF)) | ((res ^ value) & Z80_HF);
+            if( res == 0x80 ) {
+                f |= Z80_VF;
+            }
+            cpu.f = f | (cpu.f & Z80_CF);
+            return res;
+        }
+
+        uint8_t dec8(uint8_t value) {
+            uint8_t res = value - 1;
+            uint8_t f = Z80_NF | szFlags(res) | (res & (Z80_XF|Z80_YF)) | ((res ^ value) & Z80_HF);
+            if( res == 0x7F ) {
+                f |= Z80_VF;
+            }
+            cpu.f = f | (cpu.f & Z80_CF);
+            return res;
+        }
+
+        void rlca() {
+            uint8_t res = (cpu.a << 1) | (cpu.a >> 7);
+            cpu.f = ((cpu.a >> 7) & Z80_CF) | (cpu.f & (Z80_SF|Z80_ZF|Z80_PF)) | (res & (Z80_YF|Z80_XF));
+            cpu.a = res;
+        }
+
+        void rrca() {
+            uint8_t res = (cpu.a >> 1) | (cpu.a << 7);
+            cpu.f = (cpu.a & Z80_CF) | (cpu.f & (Z80_SF|Z80_ZF|Z80_PF)) | (res & (Z80_YF|Z80_XF));
+            cpu.a = res;
+        }
+
+        void rla() {
+            uint8_t res = (cpu.a << 1) | (cpu.f & Z80_CF);
+            cpu.f = ((cpu.a >> 7) & Z80_CF) | (cpu.f & (Z80_SF|Z80_ZF|Z80_PF)) | (res & (Z80_YF|Z80_XF));
+            cpu.a = res;
+        }
+
+        void rra() {
+            uint8_t res = (cpu.a >> 1) | ((cpu.f & Z80_CF) << 7);
+            cpu.f = (cpu.a & Z80_CF) | (cpu.f & (Z80_SF|Z80_ZF|Z80_PF)) | (res & (Z80_YF|Z80_XF));
+            cpu.a = res;
+        }
+
+        void daa() {
+            uint8_t res = cpu.a;
+            if( cpu.f & Z80_NF ) {
+                if( ((cpu.a & 0xF) > 0x9) || (cpu.f & Z80_HF) ) res -= 0x06;
+                if( (cpu.a > 0x99) || (cpu.f & Z80_CF) ) res -= 0x60;
+            }
+            else {
+                if( ((cpu.a & 0xF) > 0x9) || (cpu.f & Z80_HF) ) res += 0x06;
+                if( (cpu.a > 0x99) || (cpu.f & Z80_CF) ) res += 0x60;
+            }
+            cpu.f &= Z80_CF|Z80_NF;
+            cpu.f |= (cpu.a > 0x99) ? Z80_CF : 0;
+            cpu.f |= (cpu.a ^ res) & Z80_HF;
+            cpu.f |= SZP[res];
+            cpu.a = res;
+        }
+
+        void add16(uint16_t &acc, uint16_t value) {
+            const uint16_t start = acc;
+            cpu.wz = start + 1;
+            const uint32_t res = start + value;
+            acc = res;
+            cpu.f = (cpu.f & (Z80_SF|Z80_ZF|Z80_VF)) | (((start ^ res ^ value) >> 8) & Z80_HF) |
+                    ((res >> 16) & Z80_CF) | ((res >> 8) & (Z80_YF|Z80_XF));
+        }
+
+        void adc16(uint16_t value) {
+            const uint16_t acc = cpu.hl;
+            cpu.wz = acc + 1;
+            const uint32_t res = acc + value + (cpu.f & Z80_CF);
+            cpu.hl = res;
+            cpu.f = (((value ^ acc ^ 0x8000) & (value ^ res) & 0x8000) >> 13) | (((acc ^ res ^ value) >> 8) & Z80_HF) |
+                    ((res >> 16) & Z80_CF) | ((res >> 8) & (Z80_SF|Z80_YF|Z80_XF)) | ((res & 0xFFFF) ? 0 : Z80_ZF);
+        }
+
+        void sbc16(uint16_t value) {
+            const uint16_t acc = cpu.hl;
+            cpu.wz = acc + 1;
+            const uint32_t res = acc - value - (cpu.f & Z80_CF);
+            cpu.hl = res;
+            cpu.f = (Z80_NF | (((value ^ acc) & (acc ^ res) & 0x8000) >> 13)) | (((acc ^ res ^ value) >> 8) & Z80_HF) |
+                    ((res >> 16) & Z80_CF) | ((res >> 8) & (Z80_SF|Z80_YF|Z80_XF)) | ((res & 0xFFFF) ? 0 : Z80_ZF);
+        }
+
+        // Sign, zero and parity flags for each value
+        static constexpr uint8_t SZP[256] = {
+            0x44,0x00,0x00,0x04,0x00,0x04,0x04,0x00,0x08,0x0c,0x0c,0x08,0x0c,0x08,0x08,0x0c,
+            0x00,0x04,0x04,0x00,0x04,0x00,0x00,0x04,0x0c,0x08,0x08,0x0c,0x08,0x0c,0x0c,0x08,
+            0x20,0x24,0x24,0x20,0x24,0x20,0x20,0x24,0x2c,0x28,0x28,0x2c,0x28,0x2c,0x2c,0x28,
+            0x24,0x20,0x20,0x24,0x20,0x24,0x24,0x20,0x28,0x2c,0x2c,0x28,0x2c,0x28,0x28,0x2c,
+            0x00,0x04,0x04,0x00,0x04,0x00,0x00,0x04,0x0c,0x08,0x08,0x0c,0x08,0x0c,0x0c,0x08,
+            0x04,0x00,0x00,0x04,0x00,0x04,0x04,0x00,0x08,0x0c,0x0c,0x08,0x0c,0x08,0x08,0x0c,
+            0x24,0x20,0x20,0x24,0x20,0x24,0x24,0x20,0x28,0x2c,0x2c,0x28,0x2c,0x28,0x28,0x2c,
+            0x20,0x24,0x24,0x20,0x24,0x20,0x20,0x24,0x2c,0x28,0x28,0x2c,0x28,0x2c,0x2c,0x28,
+            0x80,0x84,0x84,0x80,0x84,0x80,0x80,0x84,0x8c,0x88,0x88,0x8c,0x88,0x8c,0x8c,0x88,
+            0x84,0x80,0x80,0x84,0x80,0x84,0x84,0x80,0x88,0x8c,0x8c,0x88,0x8c,0x88,0x88,0x8c,
+            0xa4,0xa0,0xa0,0xa4,0xa0,0xa4,0xa4,0xa0,0xa8,0xac,0xac,0xa8,0xac,0xa8,0xa8,0xac,
+            0xa0,0xa4,0xa4,0xa0,0xa4,0xa0,0xa0,0xa4,0xac,0xa8,0xa8,0xac,0xa8,0xac,0xac,0xa8,
+            0x84,0x80,0x80,0x84,0x80,0x84,0x84,0x80,0x88,0x8c,0x8c,0x88,0x8c,0x88,0x88,0x8c,
+            0x80,0x84,0x84,0x80,0x84,0x80,0x80,0x84,0x8c,0x88,0x88,0x8c,0x88,0x8c,0x8c,0x88,
+            0xa0,0xa4,0xa4,0xa0,0xa4,0xa0,0xa0,0xa4,0xac,0xa8,0xa8,0xac,0xa8,0xac,0xac,0xa8,
+            0xa4,0xa0,0xa0,0xa4,0xa0,0xa4,0xa4,0xa0,0xa8,0xac,0xac,0xa8,0xac,0xa8,0xa8,0xac,
+        };
+};
@@ -0,0 +1,327 @@
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#define CHIPS_IMPL
+#include "../src/z80.h"
+#include "../src/z80fast.hpp"
+#include "../src/blockcache.hpp"
+
+// Simple test framework
+#define TEST(name) void test_##name()
+#define RUN_TEST(name) do { \
+    std::cout << "Running " #name "..." << std::flush; \
+    test_##name(); \
+    std::cout << " PASSED" << std::endl; \
+} while(0)
+
+#define ASSERT_EQ(expected, actual) do { \
+    if ((expected) != (actual)) { \
+        std::cerr << "\nAssertion failed: " << #actual << " == " << #expected << std::endl; \
+        std::cerr << "  Expected: " << (expected) << std::endl; \
+        std::cerr << "  Actual:   " << (actual) << std::endl; \
+        exit(1); \
+    } \
+} while(0)
+
+#define ASSERT_TRUE(condition) do { \
+    if (!(condition)) { \
+        std::cerr << "\nAssertion failed: " << #condition << std::endl; \
+        exit(1); \
+    } \
+} while(0)
+
+// Interrupt vector supplied on the data bus, RST 38h in IM0
+const uint8_t VECTOR = 0xFF;
+
+// 64K of RAM and ports that return a function of the address. Writes are
+// logged so both engines can be checked for the same bus activity.
+struct Machine {
+    z80_t    cpu;
+    uint64_t pins = 0;
+    uint8_t  memory[1 << 16];
+    std::vector<uint32_t> writes;
+    int      retis = 0;
+    BlockCache cache;
+
+    static uint8_t portValue(uint16_t port) {
+        return (uint8_t)((port >> 8) ^ (port * 7));
+    }
+
+    uint8_t memoryRead(uint16_t addr) {
+        return memory[addr];
+    }
+
+    void memoryWrite(uint16_t addr, uint8_t data) {
+        if( memory[addr] != data ) {
+            cache.written(addr);
+        }
+        memory[addr] = data;
+        writes.push_back((addr << 8) | data);
+    }
+
+    uint8_t ioRead(uint16_t port) {
+        return portValue(port);
+    }
+
+    void ioWrite(uint16_t port, uint8_t data) {
+        writes.push_back(0x1000000 | (port << 8) | data);
+    }
+
+    uint8_t interruptAcknowledge() {
+        return VECTOR;
+    }
+
+    void interruptReturn() {
+        retis++;
+    }
+
+    // One cycle stepped tick, servicing the bus as Beast::runUntil() does
+    void tick() {
+        pins = z80_tick(&cpu, pins);
+        if( pins & Z80_MREQ ) {
+            uint16_t addr = Z80_GET_ADDR(pins);
+            if( pins & Z80_RD ) {
+                Z80_SET_DATA(pins, memoryRead(addr));
+            }
+            else if( pins & Z80_WR ) {
+                memoryWrite(addr, Z80_GET_DATA(pins));
+            }
+        }
+        else if( pins & Z80_IORQ ) {
+            uint16_t port = Z80_GET_ADDR(pins);
+            if( pins & Z80_RD ) {
+                Z80_SET_DATA(pins, ioRead(port));
+            }
+            else if( pins & Z80_WR ) {
+                ioWrite(port, Z80_GET_DATA(pins));
+            }
+            else if( pins & Z80_M1 ) {
+                Z80_SET_DATA(pins, interruptAcknowledge());
+            }
+        }
+        if( pins & Z80_RETI ) {
+            interruptReturn();
+        }
+    }
+
+    // Tick to the next instruction boundary, returns T-states
+    int tickInstruction() {
+        int cycles = 0;
+        do {
+            tick();
+            cycles++;
+        } while( !z80_opdone(&cpu) );
+        return cycles;
+    }
+
+    // Operands of the instruction on the data bus, as Beast::stepInstruction() finds them
+    const uint8_t* cachedOperands() {
+        uint16_t addr = cpu.pc - 1;
+        const BlockCache::Instruction *instruction = cache.find(addr, memory + (addr & 0xC000));
+        return instruction && instruction->code[0] == Z80_GET_DATA(pins) ? instruction->code + 1 : nullptr;
+    }
+
+    void setInt(bool active) {
+        pins = active ? (pins | Z80_INT) : (pins & ~Z80_INT);
+    }
+};
+
+// Random registers and memory, stopped at the first instruction boundary
+static void randomMachine(Machine &m, unsigned seed) {
+    srand(seed);
+    for( int i=0; i < (1 << 16); i++ ) {
+        m.memory[i] = rand() & 0xFF;
+    }
+    m.pins = z80_init(&m.cpu);
+    m.cpu.af = rand(); m.cpu.bc = rand(); m.cpu.de = rand(); m.cpu.hl = rand();
+    m.cpu.ix = rand(); m.cpu.iy = rand(); m.cpu.sp = rand(); m.cpu.wz = rand();
+    m.cpu.af2 = rand(); m.cpu.bc2 = rand(); m.cpu.de2 = rand(); m.cpu.hl2 = rand();
+    m.cpu.i = rand(); m.cpu.r = rand();
+    m.cpu.im = rand() % 3;
+    m.pins = z80_prefetch(&m.cpu, rand());
+    m.tickInstruction();
+    m.writes.clear();
+}
+
+static bool sameState(const Machine &a, const Machine &b, uint64_t ignorePins = 0) {
+    const z80_t &x = a.cpu;
+    const z80_t &y = b.cpu;
+    return x.pc == y.pc && x.af == y.af && x.bc == y.bc && x.de == y.de && x.hl == y.hl &&
+           x.ix == y.ix && x.iy == y.iy && x.wz == y.wz && x.sp == y.sp && x.ir == y.ir &&
+           x.af2 == y.af2 && x.bc2 == y.bc2 && x.de2 == y.de2 && x.hl2 == y.hl2 &&
+           x.im == y.im && x.iff1 == y.iff1 && x.iff2 == y.iff2 &&
+           x.step == y.step && x.prefix_active == y.prefix_active && x.int_bits == y.int_bits &&
+           (a.pins & Z80_PIN_MASK & ~ignorePins) == (b.pins & Z80_PIN_MASK & ~ignorePins) && a.retis == b.retis;
+}
+
+// Runs the same random program on the cycle stepped core and on a machine that
+// picks an engine at random for each instruction, checking they never diverge
+static void lockstep(unsigned seed, int instructions, int interruptChance, bool cached = false) {
+    static Machine reference, mixed;
+    randomMachine(reference, seed);
+    mixed = reference;
+    Z80Fast<Machine> fast(mixed.cpu, mixed.pins, mixed);
+
+    for( int i=0; i<instructions; i++ ) {
+        bool irq = (rand() % 100) < interruptChance;
+        reference.setInt(irq);
+        mixed.setInt(irq);
+
+        uint16_t pc = reference.cpu.pc - 1;
+        int expected = reference.tickInstruction();
+        int actual = (rand() & 1) ? fast.step(cached ? mixed.cachedOperands() : nullptr) : mixed.tickInstruction();
+
+        if( !sameState(reference, mixed) || expected != actual || reference.writes != mixed.writes ) {
+            std::cerr << "\nDiverged at seed " << seed << " instruction " << i << " pc " << std::hex << pc
+                      << " opcode " << (int)reference.memory[pc] << " " << (int)reference.memory[(uint16_t)(pc+1)]
+                      << std::dec << " cycles " << expected << "/" << actual << std::endl;
+        }
+        ASSERT_TRUE(sameState(reference, mixed));
+        ASSERT_EQ(expected, actual);
+        ASSERT_TRUE(reference.writes == mixed.writes);
+        reference.writes.clear();
+        mixed.writes.clear();
+    }
+    ASSERT_TRUE(memcmp(reference.memory, mixed.memory, sizeof(reference.memory)) == 0);
+}
+
+// Every opcode, with random operands, registers and flags
+TEST(random_instructions_match_cycle_core) {
+    for( unsigned seed=1; seed<=200; seed++ ) {
+        lockstep(seed, 5000, 0);
+    }
+}
+
+// Interrupts taken in each mode, including out of HALT and after EI or RETI
+TEST(interrupts_match_cycle_core) {
+    for( unsigned seed=1000; seed<1200; seed++ ) {
+        lockstep(seed, 5000, 20);
+    }
+}
+
+// Operands taken from decoded blocks, which the random writes keep invalidating
+TEST(block_cache_matches_cycle_core) {
+    for( unsigned seed=2000; seed<2200; seed++ ) {
+        lockstep(seed, 5000, 10, true);
+    }
+}
+
+// A loop that rewrites its own operand must see the new value on every pass
+TEST(block_cache_sees_code_writes) {
+    static Machine m;
+    const uint8_t code[] = {
+        0x3E, 0x00,             // LD A,0
+        0x3C,                   // INC A
+        0x32, 0x01, 0x01,       // LD (0101h),A
+        0x18, 0xF8              // JR 0100h
+    };
+    memset(m.memory, 0, sizeof(m.memory));
+    memcpy(m.memory + 0x100, code, sizeof(code));
+    m.pins = z80_init(&m.cpu);
+    m.pins = z80_prefetch(&m.cpu, 0x100);
+    m.tickInstruction();
+
+    Z80Fast<Machine> fast(m.cpu, m.pins, m);
+    for( int i=0; i<4*25; i++ ) {
+        fast.step(m.cachedOperands());
+    }
+    ASSERT_EQ(25, m.memory[0x101]);
+    ASSERT_EQ(25, m.cpu.a);
+}
+
+// z80_set_banks() resolves accesses to the given banks inside z80_tick(), which
+// must leave the CPU and memory exactly as handling them on the pins does
+TEST(inline_banks_match_pins) {
+    static Machine reference, banked;
+    for( unsigned seed=3000; seed<3100; seed++ ) {
+        randomMachine(reference, seed);
+        banked = reference;
+        // Banks 1 and 3 stay on the pins, and bank 2 is read-only
+        uint8_t *read[4] = {banked.memory, nullptr, banked.memory + 0x8000, nullptr};
+        uint8_t *write[4] = {banked.memory, nullptr, nullptr, nullptr};
+        z80_set_banks(&banked.cpu, read, write);
+
+        for( int i=0; i<5000; i++ ) {
+            bool irq = (rand() % 100) < 10;
+            reference.setInt(irq);
+            banked.setInt(irq);
+            ASSERT_EQ(reference.tickInstruction(), banked.tickInstruction());
+            ASSERT_TRUE(sameState(reference, banked, Z80_MREQ));
+        }
+        ASSERT_TRUE(memcmp(reference.memory, banked.memory, sizeof(reference.memory)) == 0);
+    }
+}
+
+// Instruction timings from the Z80 manual
+TEST(instruction_cycles) {
+    static Machine m;
+    struct { uint8_t code[4]; int cycles; } cases[] = {
+        {{0x00}, 4},                    // NOP
+        {{0x01, 0x34, 0x12}, 10},       // LD BC,nn
+        {{0xDD, 0x7E, 0x05}, 19},       // LD A,(IX+5)
+        {{0xDD, 0x36, 0x05, 0x12}, 19}, // LD (IX+5),n
+        {{0xFD, 0x34, 0x05}, 23},       // INC (IY+5)
+        {{0xDD, 0xCB, 0x05, 0x06}, 23}, // RLC (IX+5)
+        {{0xDD, 0xCB, 0x05, 0x46}, 20}, // BIT 0,(IX+5)
+        {{0xCB, 0x46}, 12},             // BIT 0,(HL)
+        {{0xCB, 0x16}, 15},             // RL (HL)
+        {{0xED, 0x47}, 9},              // LD I,A
+        {{0xED, 0xB0}, 21},             // LDIR, repeating
+        {{0xE3}, 19},                   // EX (SP),HL
+        {{0xCD, 0x00, 0x80}, 17},       // CALL nn
+    };
+    for( auto &c : cases ) {
+        memset(m.memory, 0, sizeof(m.memory));
+        memcpy(m.memory + 0x100, c.code, sizeof(c.code));
+        m.pins = z80_init(&m.cpu);
+        m.cpu.bc = 2;
+        m.pins = z80_prefetch(&m.cpu, 0x100);
+        m.tickInstruction();
+
+        Z80Fast<Machine> fast(m.cpu, m.pins, m);
+        ASSERT_EQ(c.cycles, fast.step());
+    }
+}
+
+// HALT holds the CPU on the same address until an interrupt arrives
+TEST(halt_waits_for_interrupt) {
+    static Machine m;
+    memset(m.memory, 0, sizeof(m.memory));
+    m.memory[0x100] = 0xFB;             // EI
+    m.memory[0x101] = 0x76;             // HALT
+    m.pins = z80_init(&m.cpu);
+    m.cpu.im = 1;
+    m.cpu.sp = 0x8000;
+    m.pins = z80_prefetch(&m.cpu, 0x100);
+    m.tickInstruction();
+
+    Z80Fast<Machine> fast(m.cpu, m.pins, m);
+    fast.step();
+    for( int i=0; i<10; i++ ) {
+        ASSERT_EQ(4, fast.step());
+        ASSERT_TRUE((m.pins & Z80_HALT) != 0);
+        ASSERT_EQ(0x102, m.cpu.pc);
+    }
+    m.setInt(true);
+    ASSERT_EQ(4 + 13, fast.step());
+    ASSERT_TRUE((m.pins & Z80_HALT) == 0);
+    ASSERT_EQ(0x39, m.cpu.pc);
+    ASSERT_EQ(0x02, m.memory[0x7FFE]);
+    ASSERT_EQ(0x01, m.memory[0x7FFF]);
+}
+
+int main() {
+    std::cout << "=== Z80 Fast Engine Tests ===" << std::endl;
+
+    RUN_TEST(instruction_cycles);
+    RUN_TEST(halt_waits_for_interrupt);
+    RUN_TEST(random_instructions_match_cycle_core);
+    RUN_TEST(interrupts_match_cycle_core);
+    RUN_TEST(block_cache_sees_code_writes);
+    RUN_TEST(block_cache_matches_cycle_core);
+    RUN_TEST(inline_banks_match_pins);
+
+    std::cout << "\nAll tests passed!" << std::endl;
+    return 0;
+}
@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../src/assets.hpp"
+#include "../src/bench.hpp"
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+/* Times the fixed workloads in src/bench.hpp and writes the results as JSON. Each
+ * workload runs in a copy of this program started with --only, so that its peak RSS is
+ * its own. Exits with 0 if every workload ran to the end, 1 if any didn't, or 2 if they
+ * couldn't be run.
+ */
+const char *VERSION = "1.0";
+const int DEFAULT_REWIND_MB = 64;
+
+enum ExitCode {COMPLETED = 0, INCOMPLETE = 1, ERROR = 2};
+
+void printHelp() {
+    std::cout << "Usage: beastem_bench <options> [workload...]" << std::endl;
+    std::cout << "Workloads are:";
+    for( const std::string &name : Bench::workloads() ) {
+        std::cout << " " << name;
+    }
+    std::cout << " (default all of them)" << std::endl;
+    std::cout << "Options are:" << std::endl;
+    std::cout << "   -A <asset-path>                  : Path to asset files (default: BEASTEM_ASSETS env or cwd)" << std::endl;
+    std::cout << "   --fast                           : Run whole instructions at a time instead of every clock cycle" << std::endl;
+    std::cout << "   --rewind <MB>                    : Memory kept for rewinding, 0 for none (default 64, as beastem)" << std::endl;
+    std::cout << "   --only <workload>                : Run one workload in this process and write just its result" << std::endl;
+}
+
+std::string resultJson(const BenchResult &result) {
+    std::ostringstream json;
+    json << "{\"name\": \"" << result.name << "\", ";
+    json << "\"completed\": " << (result.completed ? "true" : "false") << ", ";
+    json << "\"cycles\": " << result.cycles << ", ";
+    json << "\"seconds\": " << result.seconds << ", ";
+    json << "\"emulated_mhz\": " << (result.seconds > 0 ? result.cycles / result.seconds / 1e6 : 0) << ", ";
+    json << "\"ns_per_cycle\": " << (result.cycles > 0 ? result.seconds * 1e9 / result.cycles : 0) << ", ";
+    json << "\"peak_rss_kb\": " << result.peakRssKb << "}";
+    return json.str();
+}
+
+// Run a workload here, with the machine's own logging kept off stdout
+int runOnly(const std::string &name, Machine::Engine engine, size_t rewindMegabytes) {
+    std::ostringstream log;
+    std::streambuf *stdoutBuffer = std::cout.rdbuf(log.rdbuf());
+    BenchResult result;
+    bool found = Bench(engine, rewindMegabytes).run(name, result);
+    std::cout.rdbuf(stdoutBuffer);
+
+    if( !found ) {
+        std::cerr << "No workload " << name << std::endl;
+        return ERROR;
+    }
+    std::cout << resultJson(result) << std::endl;
+    return result.completed ? COMPLETED : INCOMPLETE;
+}
+
+// Run a workload in a copy of this program, for the line of JSON it writes
+bool runChild(const std::string &program, const std::string &arguments, const std::string &name, std::string &json) {
+    std::string command = "\"" + program + "\" --only " + name + arguments;
+#ifdef _WIN32
+    command = "\"" + command + "\"";    // cmd.exe strips the outer quotes
+#endif
+    FILE *child = popen(command.c_str(), "r");
+    if( !child ) {
+        std::cerr << "Couldn't run " << command << std::endl;
+        return false;
+    }
+    char buffer[256];
+    while( fgets(buffer, sizeof(buffer), child) ) {
+        json += buffer;
+    }
+    int status = pclose(child);
+    while( !json.empty() && (json.back() == '\n' || json.back() == '\r') ) {
+        json.pop_back();
+    }
+    if( json.empty() || json[0] != '{' ) {
+        std::cerr << "No result from workload " << name << " (status " << status << ")" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main( int argc, char *argv[] ) {
+
+    bool fastEngine = false;
+    int rewindMegabytes = DEFAULT_REWIND_MB;
+    std::string assetPathArg;
+    std::string only;
+    std::vector<std::string> names;
+
+    for( int index = 1; index < argc; index++ ) {
+        std::string option = argv[index];
+        bool hasValue = index+1 < argc;
+        if( option == "-A" && hasValue ) {
+            assetPathArg = argv[++index];
+        }
+        else if( option == "--fast" ) {
+            fastEngine = true;
+        }
+        else if( option == "--rewind" && hasValue ) {
+            rewindMegabytes = atoi(argv[++index]);
+        }
+        else if( option == "--only" && hasValue ) {
+            only = argv[++index];
+        }
+        else if( option[0] != '-' ) {
+            names.push_back(option);
+        }
+        else {
+            std::cerr << "** Unknown or incomplete option: " << option << std::endl;
+            printHelp();
+            exit(ERROR);
+        }
+    }
+    if( rewindMegabytes < 0 ) {
+        printHelp();
+        exit(ERROR);
+    }
+
+    Machine::Engine engine = fastEngine ? Machine::ENGINE_FAST : Machine::ENGINE_CYCLE;
+    if( !only.empty() ) {
+        initAssetPath(assetPathArg);
+        return runOnly(only, engine, rewindMegabytes);
+    }
+
+    if( names.empty() ) {
+        names = Bench::workloads();
+    }
+    for( const std::string &name : names ) {
+        if( std::find(Bench::workloads().begin(), Bench::workloads().end(), name) == Bench::workloads().end() ) {
+            std::cerr << "** Unknown workload: " << name << std::endl;
+            printHelp();
+            exit(ERROR);
+        }
+    }
+
+    // The children get the same options, with the asset path as it was given
+    std::string arguments = " --rewind " + std::to_string(rewindMegabytes);
+    if( fastEngine ) {
+        arguments += " --fast";
+    }
+    if( !assetPathArg.empty() ) {
+        arguments += " -A \"" + assetPathArg + "\"";
+    }
+
+    int exitCode = COMPLETED;
+    std::cout << "{\"version\": \"" << VERSION << "\", ";
+    std::cout << "\"engine\": \"" << (fastEngine ? "fast" : "cycle") << "\", ";
+    std::cout << "\"rewind_mb\": " << rewindMegabytes << ", ";
+    std::cout << "\"workloads\": [";
+    for( size_t index = 0; index < names.size(); index++ ) {
+        std::string json;
+        if( !runChild(argv[0], arguments, names[index], json) ) {
+            BenchResult result;
+            result.name = names[index];
+            json = resultJson(result);
+            exitCode = ERROR;
+        }
+        else if( json.find("\"completed\": true") == std::string::npos && exitCode == COMPLETED ) {
+            exitCode = INCOMPLETE;
+        }
+        std::cout << (index ? ",\n  " : "\n  ") << json;
+    }
+    std::cout << "\n]}" << std::endl;
+
+    return exitCode;
+}
@@ -0,0 +1,115 @@
+#include <chrono>
+#include <iostream>
+#include <fstream>
+#include <string>
+
+#include "../src/assets.hpp"
+#include "../src/binaryFile.hpp"
+#include "../src/farm.hpp"
+#include "../src/listing.hpp"
+#include "../src/machine.hpp"
+#include "../src/testrunner.hpp"
+
+/* Runs a manifest of headless tests in parallel, see src/farm.hpp. Exits with 0 if
+ * every test passed, 1 if any failed, or 2 if the tests couldn't be run.
+ */
+const int ONE_KILOHERTZ = 1000; // 1 KHz
+const int DEFAULT_SPEED = 8000;
+
+void printHelp() {
+    std::cout << "Usage: beastem-farm <options> <manifest>" << std::endl;
+    std::cout << "Options are:" << std::endl;
+    std::cout << "   -j <threads>                     : Tests to run at once (default one per core)" << std::endl;
+    std::cout << "   -k <CPU speed>                   : Integer KHz the tests see (default 8000), they run unthrottled" << std::endl;
+    std::cout << "   -A <asset-path>                  : Path to asset files (default: BEASTEM_ASSETS env or cwd)" << std::endl;
+    std::cout << "   --rom <filename> | --rom none    : Flash ROM every test starts with (default the firmware)" << std::endl;
+    std::cout << "   --fast                           : Run whole instructions at a time instead of every clock cycle" << std::endl;
+    std::cout << "   --report <filename>              : Write the results as JUnit XML (.xml) or else JSON" << std::endl;
+}
+
+int main( int argc, char *argv[] ) {
+
+    int threads = 0;
+    int targetSpeed = DEFAULT_SPEED;
+    bool fastEngine = false;
+    std::string romFile;
+    std::string reportFile;
+    std::string manifestFile;
+    std::string assetPathArg;
+
+    for( int index = 1; index < argc; index++ ) {
+        std::string option = argv[index];
+        bool hasValue = index+1 < argc;
+        if( option == "-j" && hasValue ) {
+            threads = atoi(argv[++index]);
+        }
+        else if( option == "-k" && hasValue ) {
+            targetSpeed = atoi(argv[++index]);
+        }
+        else if( option == "-A" && hasValue ) {
+            assetPathArg = argv[++index];
+        }
+        else if( option == "--rom" && hasValue ) {
+            romFile = argv[++index];
+        }
+        else if( option == "--fast" ) {
+            fastEngine = true;
+        }
+        else if( option == "--report" && hasValue ) {
+            reportFile = argv[++index];
+        }
+        else if( option[0] != '-' && manifestFile.empty() ) {
+            manifestFile = option;
+        }
+        else {
+            std::cout << "** Unknown or incomplete option: " << option << std::endl;
+            printHelp();
+            exit(TestRunner::ERROR);
+        }
+    }
+    if( manifestFile.empty() || targetSpeed <= 0 ) {
+        printHelp();
+        exit(TestRunner::ERROR);
+    }
+
+    initAssetPath(assetPathArg);
+    if( romFile.empty() ) {
+        romFile = assetPath("flash_v1.7.bin");
+    }
+    std::vector<BinaryFile> binaries;
+    if( romFile != "none" ) {
+        if( !std::ifstream(romFile).good() ) {
+            std::cout << "No ROM file " << romFile << std::endl;
+            exit(TestRunner::ERROR);
+        }
+        binaries.push_back(BinaryFile(romFile, 0, false));
+    }
+
+    Farm farm;
+    if( !farm.load(manifestFile.c_str()) ) {
+        exit(TestRunner::ERROR);
+    }
+
+    // Every test starts as a copy of this machine, just after reset
+    Listing listing;
+    Machine machine(listing, binaries);
+    machine.setUartPort(0);
+    machine.init(targetSpeed*ONE_KILOHERTZ, Machine::NOT_SET, nullptr);
+    if( fastEngine ) {
+        machine.setEngine(Machine::ENGINE_FAST);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    farm.run(machine, threads);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    farm.report(std::cout);
+    std::cout << farm.passed() << " of " << farm.size() << " tests passed in " << seconds << "s" << std::endl;
+
+    int exitCode = farm.passed() == farm.size() ? TestRunner::PASSED : TestRunner::FAILED;
+    if( !reportFile.empty() && !farm.writeReport(reportFile.c_str()) ) {
+        exitCode = TestRunner::ERROR;
+    }
+
+    return exitCode;
+}